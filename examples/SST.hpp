@@ -38,8 +38,9 @@ struct SST<table> {
     }
   }
 
-  static const char* match(const char* a, const char* b) {
-    if (!a || *a == 0) return nullptr;
+  // Index of the text in the table, or -1.
+  static int find(const char* a, const char* b) {
+    if (!a || *a == 0) return -1;
     size_t bit = top_bit(N);
     size_t index = 0;
 
@@ -49,23 +50,27 @@ struct SST<table> {
       while(1) {
         size_t new_index = index | bit;
         if (new_index < N) {
-          auto lit = table[new_index];
-          auto c = strcmp_span(a, b, lit);
-          if (c == 0) return lit;
+          auto c = strcmp_span(a, b, table[new_index]);
+          if (c == 0) return int(new_index);
           if (c > 0) index = new_index;
         }
-        if (bit == 0) return nullptr;
+        if (bit == 0) return -1;
         bit >>= 1;
       }
     }
     else {
       // Linear scan for small tables
-      for (auto lit : table) {
-        if (strcmp_span(a, b, lit) == 0) return lit;
+      for (size_t i = 0; i < N; i++) {
+        if (strcmp_span(a, b, table[i]) == 0) return int(i);
       }
     }
 
-    return nullptr;
+    return -1;
+  }
+
+  static const char* match(const char* a, const char* b) {
+    auto index = find(a, b);
+    return index < 0 ? nullptr : table[index];
   }
 };
 
@@ -0,0 +1,90 @@
+// SPDX-FileCopyrightText:  2023 Austin Appleby <aappleby@gmail.com>
+// SPDX-License-Identifier: MIT License
+
+#include "CInterner.hpp"
+
+#include "../c_parser/c_constants.hpp"
+#include "matcheroni/Utilities.hpp"
+
+#include <string.h>
+
+using namespace matcheroni;
+
+//------------------------------------------------------------------------------
+
+CInterner::CInterner() {
+  names.push_back({0, 0});
+  slots.resize(1024, {0, 0});
+
+  for (auto t : stddef_typedefs) intern(utils::to_span(t));
+  for (auto t : stdio_typedefs)  intern(utils::to_span(t));
+  for (auto t : stdint_typedefs) intern(utils::to_span(t));
+}
+
+const CInterner& CInterner::builtins() {
+  static const CInterner interner;
+  return interner;
+}
+
+//------------------------------------------------------------------------------
+
+uint32_t CInterner::hash(TextSpan text) {
+  uint32_t h = 2166136261u;
+  for (auto c = text.begin; c < text.end; c++) {
+    h = (h ^ uint8_t(*c)) * 16777619u;
+  }
+  // Zero marks an empty slot.
+  return h ? h : 1;
+}
+
+// Returns the index of the name's slot, or of the empty slot where it would go.
+size_t CInterner::lookup(TextSpan text, uint32_t h) const {
+  size_t mask = slots.size() - 1;
+  size_t len = text.len();
+  for (size_t i = h & mask;; i = (i + 1) & mask) {
+    auto& slot = slots[i];
+    if (!slot.hash) return i;
+    if (slot.hash != h) continue;
+    auto& n = names[slot.id];
+    if (n.len == len && memcmp(chars.data() + n.offset, text.begin, len) == 0) {
+      return i;
+    }
+  }
+}
+
+uint32_t CInterner::find(TextSpan text) const {
+  return slots[lookup(text, hash(text))].id;
+}
+
+uint32_t CInterner::intern(TextSpan text) {
+  uint32_t h = hash(text);
+  size_t i = lookup(text, h);
+  if (slots[i].id) return slots[i].id;
+
+  // Keep the table at most half full.
+  if (names.size() * 2 >= slots.size()) {
+    grow();
+    i = lookup(text, h);
+  }
+
+  uint32_t id = uint32_t(names.size());
+  slots[i] = {h, id};
+  names.push_back({uint32_t(chars.size()), uint32_t(text.len())});
+  chars.append(text.begin, text.end);
+  return id;
+}
+
+void CInterner::grow() {
+  std::vector<Slot> old_slots(slots.size() * 2, {0, 0});
+  old_slots.swap(slots);
+
+  size_t mask = slots.size() - 1;
+  for (auto& s : old_slots) {
+    if (!s.hash) continue;
+    size_t i = s.hash & mask;
+    while (slots[i].hash) i = (i + 1) & mask;
+    slots[i] = s;
+  }
+}
+
+//------------------------------------------------------------------------------
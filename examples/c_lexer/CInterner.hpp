@@ -0,0 +1,61 @@
+// SPDX-FileCopyrightText:  2023 Austin Appleby <aappleby@gmail.com>
+// SPDX-License-Identifier: MIT License
+
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "matcheroni/Matcheroni.hpp"
+
+//------------------------------------------------------------------------------
+// Gives every distinct identifier a small integer id, so the parser can look
+// identifiers up by id instead of comparing strings. Ids start at 1 - 0 means
+// "not interned".
+//
+// The builtin typedef names from c_constants.hpp are interned first, in the
+// same order, by every interner - so they have the same ids everywhere and
+// builtins() can look them up without knowing which interner a token came
+// from.
+//
+// Names are copied into the interner, so ids stay valid after the source text
+// is gone.
+
+struct CInterner {
+  CInterner();
+
+  uint32_t intern(matcheroni::TextSpan text);
+  uint32_t find(matcheroni::TextSpan text) const;
+
+  // Number of ids handed out so far, plus one for the unused id 0.
+  size_t size() const { return names.size(); }
+
+  matcheroni::TextSpan name(uint32_t id) const {
+    auto begin = chars.data() + names[id].offset;
+    return matcheroni::TextSpan(begin, begin + names[id].len);
+  }
+
+  static const CInterner& builtins();
+
+  //----------------------------------------
+
+  struct Name {
+    uint32_t offset;
+    uint32_t len;
+  };
+
+  struct Slot {
+    uint32_t hash;
+    uint32_t id;
+  };
+
+  static uint32_t hash(matcheroni::TextSpan text);
+  size_t lookup(matcheroni::TextSpan text, uint32_t h) const;
+  void grow();
+
+  std::string       chars;
+  std::vector<Name> names;
+  std::vector<Slot> slots; // Open addressed, power-of-two size
+};
+
+//------------------------------------------------------------------------------
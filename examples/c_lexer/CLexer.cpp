@@ -9,6 +9,12 @@
 #include "matcheroni/Utilities.hpp"
 #include "matcheroni/Cookbook.hpp"
 
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 using namespace matcheroni;
 
 template <typename M>
@@ -26,7 +32,7 @@ TextSpan  match_comment    (TextMatchContext& ctx, TextSpan body);
 TextSpan  match_preproc    (TextMatchContext& ctx, TextSpan body);
 TextSpan  match_float      (TextMatchContext& ctx, TextSpan body);
 TextSpan  match_int        (TextMatchContext& ctx, TextSpan body);
-TextSpan  match_punct      (TextMatchContext& ctx, TextSpan body);
+TextSpan  match_punct      (TextMatchContext& ctx, TextSpan body, uint32_t& id);
 TextSpan  match_splice     (TextMatchContext& ctx, TextSpan body);
 TextSpan  match_formfeed   (TextMatchContext& ctx, TextSpan body);
 TextSpan  match_eof        (TextMatchContext& ctx, TextSpan body);
@@ -34,65 +40,382 @@ TextSpan  match_eof        (TextMatchContext& ctx, TextSpan body);
 
 //------------------------------------------------------------------------------
 
-CLexer::CLexer() { tokens.reserve(65536); }
+CLexer::CLexer() {
+  tokens.reserve(65536);
+  trivia.reserve(65536);
+  trivia_end.reserve(65536);
+}
 
-void CLexer::reset() { tokens.clear(); }
+void CLexer::reset() {
+  tokens.clear();
+  trivia.clear();
+  trivia_end.clear();
+}
 
 //------------------------------------------------------------------------------
 
 bool CLexer::lex(TextSpan text) {
-  tokens.push_back(CToken(LEX_BOF, TextSpan(text.begin, text.begin)));
+  start(text);
+  while (!done()) {
+    if (!pull()) return false;
+  }
+  return true;
+}
 
+void CLexer::start(TextSpan text) {
+  tokens.push_back(CToken(LEX_BOF, TextSpan(text.begin, text.begin)));
+  trivia_end.push_back(uint32_t(trivia.size()));
+  rest = text;
+}
 
-  TextMatchContext ctx;
-  while (text.is_valid()) {
+bool CLexer::pull() {
+  while (true) {
     // Don't pass begin context here or we will slow way down doing rewinds
-    auto token = next_lexeme(ctx, text);
+    auto token = next_lexeme(ctx, rest);
+    if (token.type == LEX_IDENTIFIER) {
+      // CToken only has room for 24-bit ids.
+      auto id = interner->intern(token.text());
+      matcheroni_assert(id < (1 << 24));
+      token.id = id;
+    }
+    if (token.is_gap()) {
+      trivia.push_back(token);
+      rest.begin = token.text().end;
+      continue;
+    }
+
     tokens.push_back(token);
-    if (token.type == LEX_INVALID) {
-      return false;
+    trivia_end.push_back(uint32_t(trivia.size()));
+    if (token.type == LEX_INVALID) return false;
+    if (token.type != LEX_EOF) rest.begin = token.text().end;
+    return true;
+  }
+}
+
+void CLexer::discard(size_t count) {
+  if (count == 0) return;
+  auto trivia_count = trivia_end[count - 1];
+  tokens.erase(tokens.begin(), tokens.begin() + count);
+  trivia_end.erase(trivia_end.begin(), trivia_end.begin() + count);
+  trivia.erase(trivia.begin(), trivia.begin() + trivia_count);
+  for (auto& end : trivia_end) end -= trivia_count;
+}
+
+//------------------------------------------------------------------------------
+// Incremental relexing
+//
+// Matching a lexeme only looks at the text from its start on, so once a new
+// token starts where an old one did after the edit, the rest of the file lexes
+// exactly as before.
+//
+// Looking back from the edit, matchers give up at the end of the line, so
+// tokens on earlier lines don't change. The exceptions are a "/*" with no
+// "*/" and a raw string with no terminator, which lexed as punctuators or
+// identifiers but might not if the edit closes them. We restart from the
+// first of those if there are any.
+
+bool CLexer::relex(const CLexer& old, TextSpan old_text, TextSpan new_text,
+                   const parseroni::SpanEdit& edit) {
+  matcheroni_assert(&old != this && interner == old.interner);
+  reset();
+
+  auto& old_tokens = old.tokens;
+  if (old_tokens.empty() || old_tokens.back().type != LEX_EOF) return lex(new_text);
+
+  auto edit_begin = old_text.begin + edit.begin;
+  auto line = edit_begin;
+  while (line > old_text.begin && line[-1] != '\n') line--;
+
+  // The last token starting at or before the edit's line. We relex from the
+  // end of the token before it.
+  auto by_begin = [](const char* p, const CToken& t) { return p < t.begin; };
+  size_t k = std::upper_bound(old_tokens.begin() + 1, old_tokens.end() - 1, line, by_begin) -
+             old_tokens.begin() - 1;
+
+  // Raw string prefixes are compared by id, so we only look at the text
+  // after the few tokens that could be unclosed.
+  uint32_t raw_prefixes[5];
+  uint32_t* prefix = raw_prefixes;
+  for (auto p : {"R", "LR", "uR", "UR", "u8R"}) *prefix++ = interner->find(utils::to_span(p));
+
+  auto unclosed = [&](const CToken& t) {
+    bool slash = t.is_punct(punct_id("/"));
+    bool raw = t.type == LEX_IDENTIFIER &&
+               std::find(raw_prefixes, prefix, t.id) != prefix;
+    if (!slash && !raw) return false;
+    if (t.begin + t.len >= edit_begin) return false;
+    return t.begin[t.len] == (slash ? '*' : '"');
+  };
+
+  for (size_t i = 1; i < k; i++) {
+    if (unclosed(old_tokens[i])) {
+      k = i;
+      break;
     }
-    if (token.type == LEX_EOF) break;
-    text.begin = token.text.end;
+  }
+  if (k == 0) return lex(new_text);
+
+  // Copies old lexemes, moved onto the new text.
+  auto copy = [&](std::vector<CToken>& out, const std::vector<CToken>& in,
+                  size_t a, size_t b, int64_t delta) {
+    out.reserve(out.size() + (b - a));
+    for (size_t i = a; i < b; i++) {
+      auto t = in[i];
+      t.begin = new_text.begin + (t.begin - old_text.begin) + delta;
+      out.push_back(t);
+    }
+  };
+
+  copy(tokens, old_tokens, 0, k, 0);
+  copy(trivia, old.trivia, 0, old.trivia_end[k - 1], 0);
+  trivia_end.assign(old.trivia_end.begin(), old.trivia_end.begin() + k);
+  rest = TextSpan(new_text.begin + (old_tokens[k - 1].text().end - old_text.begin), new_text.end);
+
+  // New tokens are checked against the old ones from the end of the edit on.
+  auto delta = edit.delta();
+  auto by_offset = [](const CToken& t, const char* p) { return t.begin < p; };
+  size_t m = std::lower_bound(old_tokens.begin() + k, old_tokens.end(),
+                              old_text.begin + edit.old_end, by_offset) - old_tokens.begin();
+
+  while (!done()) {
+    if (!pull()) return false;
+
+    auto offset = tokens.back().begin - new_text.begin - delta;
+    while (m < old_tokens.size() && old_tokens[m].begin - old_text.begin < offset) m++;
+    if (m == old_tokens.size() || old_tokens[m].begin - old_text.begin != offset) continue;
+
+    // Back in step, copy the rest.
+    auto old_base = old.trivia_end[m];
+    auto new_base = trivia_end.back();
+    copy(trivia, old.trivia, old_base, old.trivia.size(), delta);
+    copy(tokens, old_tokens, m + 1, old_tokens.size(), delta);
+    for (size_t i = m + 1; i < old_tokens.size(); i++) {
+      trivia_end.push_back(old.trivia_end[i] - old_base + new_base);
+    }
+    break;
   }
 
   return true;
 }
 
 //------------------------------------------------------------------------------
+// Every byte that can start a lexeme has a class that picks the matchers that
+// could match there, so we don't have to try them all. Where more than one
+// matcher applies they're tried in the same order as always - strings before
+// character constants before identifiers for the u/U/L/R prefixes, comments
+// before punctuators, floats before ints.
+
+enum ByteClass : uint8_t {
+  BYTE_INVALID = 0,
+  BYTE_SPACE,     // space
+  BYTE_NEWLINE,   // newline
+  BYTE_DQUOTE,    // string
+  BYTE_SQUOTE,    // char
+  BYTE_PREFIX,    // string, char, identifier
+  BYTE_IDENT,     // identifier
+  BYTE_BACKSLASH, // identifier, splice
+  BYTE_SLASH,     // comment, punct
+  BYTE_HASH,      // preproc, punct
+  BYTE_DOT,       // float, punct
+  BYTE_DIGIT,     // float, int
+  BYTE_PUNCT,     // punct
+  BYTE_FORMFEED,  // formfeed
+  BYTE_NUL,       // eof
+};
+
+consteval std::array<ByteClass, 256> make_byte_classes() {
+  std::array<ByteClass, 256> classes = {};
+  for (int c = 'a'; c <= 'z'; c++) classes[c] = BYTE_IDENT;
+  for (int c = 'A'; c <= 'Z'; c++) classes[c] = BYTE_IDENT;
+  for (int c = '0'; c <= '9'; c++) classes[c] = BYTE_DIGIT;
+  for (int c = 128; c <= 255; c++) classes[c] = BYTE_IDENT;
+  for (auto p : c_punctuators) classes[uint8_t(p[0])] = BYTE_PUNCT;
+
+  classes['_']  = BYTE_IDENT;
+  classes['$']  = BYTE_IDENT;
+  classes['u']  = BYTE_PREFIX;
+  classes['U']  = BYTE_PREFIX;
+  classes['L']  = BYTE_PREFIX;
+  classes['R']  = BYTE_PREFIX;
+  classes[' ']  = BYTE_SPACE;
+  classes['\t'] = BYTE_SPACE;
+  classes['\r'] = BYTE_NEWLINE;
+  classes['\n'] = BYTE_NEWLINE;
+  classes['"']  = BYTE_DQUOTE;
+  classes['\''] = BYTE_SQUOTE;
+  classes['\\'] = BYTE_BACKSLASH;
+  classes['/']  = BYTE_SLASH;
+  classes['#']  = BYTE_HASH;
+  classes['.']  = BYTE_DOT;
+  classes['\f'] = BYTE_FORMFEED;
+  classes[0]    = BYTE_NUL;
+  return classes;
+}
 
-CToken next_lexeme(TextMatchContext& ctx, TextSpan body) {
-  TextSpan tail;
-
-  if (auto tail = match_space(ctx, body)  ) return CToken(LEX_SPACE, TextSpan(body.begin, tail.begin));
-  if (auto tail = match_newline(ctx, body)) return CToken(LEX_NEWLINE, TextSpan(body.begin, tail.begin));
-  if (auto tail = match_string(ctx, body) ) return CToken(LEX_STRING, TextSpan(body.begin, tail.begin));
-
-  // Match char needs to come before match identifier because of its possible
-  // L'_' prefix...
-  if (auto tail = match_char(ctx, body)   ) return CToken(LEX_CHAR, TextSpan(body.begin, tail.begin));
-
-  if (auto tail = match_identifier(ctx, body)) {
-    auto text = TextSpan(body.begin, tail.begin);
-    if (SST<c_keywords>::match(text.begin, text.end)) {
-      return CToken(LEX_KEYWORD, text);
-    } else {
-      return CToken(LEX_IDENTIFIER, text);
-    }
+constexpr std::array<ByteClass, 256> byte_classes = make_byte_classes();
+
+CToken lex_identifier(TextSpan text) {
+  auto keyword = SST<c_keywords>::find(text.begin, text.end);
+  if (keyword >= 0) {
+    return CToken(LEX_KEYWORD, text, keyword + 1);
+  } else {
+    return CToken(LEX_IDENTIFIER, text);
+  }
+}
+
+CToken lex_punct(TextMatchContext& ctx, TextSpan body) {
+  uint32_t punct;
+  if (auto tail = match_punct(ctx, body, punct)) {
+    return CToken(LEX_PUNCT, TextSpan(body.begin, tail.begin), punct);
   }
+  return CToken(LEX_INVALID, body.fail());
+}
+
+CToken next_lexeme(TextMatchContext& ctx, TextSpan body) {
+  if (body.is_empty()) return CToken(LEX_EOF, TextSpan(body.begin, body.begin));
 
-  if (auto tail = match_comment(ctx, body) ) return CToken(LEX_COMMENT, TextSpan(body.begin, tail.begin));
-  if (auto tail = match_preproc(ctx, body) ) return CToken(LEX_PREPROC, TextSpan(body.begin, tail.begin));
-  if (auto tail = match_float(ctx, body)   ) return CToken(LEX_FLOAT, TextSpan(body.begin, tail.begin));
-  if (auto tail = match_int(ctx, body)     ) return CToken(LEX_INT, TextSpan(body.begin, tail.begin));
-  if (auto tail = match_punct(ctx, body)   ) return CToken(LEX_PUNCT, TextSpan(body.begin, tail.begin));
-  if (auto tail = match_splice(ctx, body)  ) return CToken(LEX_SPLICE, TextSpan(body.begin, tail.begin));
-  if (auto tail = match_formfeed(ctx, body)) return CToken(LEX_FORMFEED, TextSpan(body.begin, tail.begin));
-  if (auto tail = match_eof(ctx, body)     ) return CToken(LEX_EOF, TextSpan(body.begin, tail.begin));
+  auto lexeme = [&](LexemeType type, TextSpan tail) {
+    return CToken(type, TextSpan(body.begin, tail.begin));
+  };
+
+  // clang-format off
+  switch (byte_classes[uint8_t(*body.begin)]) {
+    case BYTE_SPACE:
+      if (auto tail = match_space(ctx, body)) return lexeme(LEX_SPACE, tail);
+      break;
+    case BYTE_NEWLINE:
+      if (auto tail = match_newline(ctx, body)) return lexeme(LEX_NEWLINE, tail);
+      break;
+    case BYTE_DQUOTE:
+      if (auto tail = match_string(ctx, body)) return lexeme(LEX_STRING, tail);
+      break;
+    case BYTE_SQUOTE:
+      if (auto tail = match_char(ctx, body)) return lexeme(LEX_CHAR, tail);
+      break;
+    case BYTE_PREFIX:
+      // Match char needs to come before match identifier because of its
+      // possible L'_' prefix...
+      if (auto tail = match_string(ctx, body))     return lexeme(LEX_STRING, tail);
+      if (auto tail = match_char(ctx, body))       return lexeme(LEX_CHAR, tail);
+      if (auto tail = match_identifier(ctx, body)) return lex_identifier(TextSpan(body.begin, tail.begin));
+      break;
+    case BYTE_IDENT:
+      if (auto tail = match_identifier(ctx, body)) return lex_identifier(TextSpan(body.begin, tail.begin));
+      break;
+    case BYTE_BACKSLASH:
+      // Universal character names can start identifiers.
+      if (auto tail = match_identifier(ctx, body)) return lex_identifier(TextSpan(body.begin, tail.begin));
+      if (auto tail = match_splice(ctx, body))     return lexeme(LEX_SPLICE, tail);
+      break;
+    case BYTE_SLASH:
+      if (auto tail = match_comment(ctx, body)) return lexeme(LEX_COMMENT, tail);
+      return lex_punct(ctx, body);
+    case BYTE_HASH:
+      if (auto tail = match_preproc(ctx, body)) return lexeme(LEX_PREPROC, tail);
+      return lex_punct(ctx, body);
+    case BYTE_DOT:
+      if (auto tail = match_float(ctx, body)) return lexeme(LEX_FLOAT, tail);
+      return lex_punct(ctx, body);
+    case BYTE_DIGIT:
+      if (auto tail = match_float(ctx, body)) return lexeme(LEX_FLOAT, tail);
+      if (auto tail = match_int(ctx, body))   return lexeme(LEX_INT, tail);
+      break;
+    case BYTE_PUNCT:
+      return lex_punct(ctx, body);
+    case BYTE_FORMFEED:
+      if (auto tail = match_formfeed(ctx, body)) return lexeme(LEX_FORMFEED, tail);
+      break;
+    case BYTE_NUL:
+      if (auto tail = match_eof(ctx, body)) return lexeme(LEX_EOF, tail);
+      break;
+    default:
+      break;
+  }
+  // clang-format on
 
   return CToken(LEX_INVALID, body.fail());
 }
 
+//------------------------------------------------------------------------------
+// Scanning kernels for the matchers that spend most of their time walking
+// over long runs of bytes. Each one returns the first byte in [a, b) that ends
+// the run, or b. With SSE2 they look at 16 bytes at a time and finish the last
+// few one at a time.
+
+#if defined(__SSE2__)
+
+// 0xFF in every lane where lo <= x <= hi.
+inline __m128i in_range(__m128i x, char lo, char hi) {
+  auto offset = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+  auto over = _mm_subs_epu8(offset, _mm_set1_epi8(char(hi - lo)));
+  return _mm_cmpeq_epi8(over, _mm_setzero_si128());
+}
+
+inline const char* first_lane(const char* a, int mask) {
+  return a + __builtin_ctz(uint32_t(mask));
+}
+
+#endif
+
+inline bool is_ascii_ident(char c) {
+  return uint8_t((c | 0x20) - 'a') < 26 || uint8_t(c - '0') < 10 || c == '_' || c == '$';
+}
+
+// Spaces and tabs
+const char* skip_space(const char* a, const char* b) {
+#if defined(__SSE2__)
+  for (; b - a >= 16; a += 16) {
+    auto x = _mm_loadu_si128((const __m128i*)a);
+    auto space = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')),
+                              _mm_cmpeq_epi8(x, _mm_set1_epi8('\t')));
+    if (auto stop = ~_mm_movemask_epi8(space) & 0xFFFF) return first_lane(a, stop);
+  }
+#endif
+  while (a < b && (*a == ' ' || *a == '\t')) a++;
+  return a;
+}
+
+// ASCII letters, digits, '_' and '$'
+const char* skip_ascii_ident(const char* a, const char* b) {
+#if defined(__SSE2__)
+  for (; b - a >= 16; a += 16) {
+    auto x = _mm_loadu_si128((const __m128i*)a);
+    auto ident = _mm_or_si128(
+      _mm_or_si128(in_range(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 'z'), in_range(x, '0', '9')),
+      _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('_')), _mm_cmpeq_epi8(x, _mm_set1_epi8('$'))));
+    if (auto stop = ~_mm_movemask_epi8(ident) & 0xFFFF) return first_lane(a, stop);
+  }
+#endif
+  while (a < b && is_ascii_ident(*a)) a++;
+  return a;
+}
+
+// Up to a newline
+const char* find_newline(const char* a, const char* b) {
+#if defined(__SSE2__)
+  for (; b - a >= 16; a += 16) {
+    auto x = _mm_loadu_si128((const __m128i*)a);
+    if (auto stop = _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')))) return first_lane(a, stop);
+  }
+#endif
+  while (a < b && *a != '\n') a++;
+  return a;
+}
+
+// Up to a newline or a backslash
+const char* find_newline_or_backslash(const char* a, const char* b) {
+#if defined(__SSE2__)
+  for (; b - a >= 16; a += 16) {
+    auto x = _mm_loadu_si128((const __m128i*)a);
+    auto stops = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')),
+                              _mm_cmpeq_epi8(x, _mm_set1_epi8('\\')));
+    if (auto stop = _mm_movemask_epi8(stops)) return first_lane(a, stop);
+  }
+#endif
+  while (a < b && *a != '\n' && *a != '\\') a++;
+  return a;
+}
+
 //------------------------------------------------------------------------------
 // Misc helpers
 
@@ -107,9 +430,10 @@ TextSpan match_formfeed(TextMatchContext& ctx, TextSpan body) {
 }
 
 TextSpan match_space(TextMatchContext& ctx, TextSpan body) {
-  using ws = Atoms<' ', '\t'>;
-  using pattern = Some<ws>;
-  return pattern::match(ctx, body);
+  // Some<Atoms<' ', '\t'>>
+  auto end = skip_space(body.begin, body.end);
+  if (end == body.begin) return body.fail();
+  return TextSpan(end, body.end);
 }
 
 TextSpan match_newline(TextMatchContext& ctx, TextSpan body) {
@@ -233,6 +557,14 @@ TextSpan match_utf8_bom(TextMatchContext& ctx, TextSpan body) {
 // 6.4.2 Identifiers - GCC allows dollar signs in identifiers?
 
 TextSpan match_identifier(TextMatchContext& ctx, TextSpan body) {
+  // Almost every identifier is plain ASCII. Ones that run into a backslash or a
+  // high-bit byte might continue with a universal character name or UTF-8, so
+  // they go through the full pattern below.
+  if (!body.is_empty() && is_ascii_ident(*body.begin) && uint8_t(*body.begin - '0') >= 10) {
+    auto end = skip_ascii_ident(body.begin + 1, body.end);
+    if (end == body.end || (*end != '\\' && !(*end & 0x80))) return TextSpan(end, body.end);
+  }
+
   // clang-format off
   using digit = Range<'0', '9'>;
 
@@ -447,10 +779,48 @@ TextSpan match_string(TextMatchContext& ctx, TextSpan body) {
 //------------------------------------------------------------------------------
 // 6.4.6 Punctuators
 
-TextSpan match_punct(TextMatchContext& ctx, TextSpan body) {
-  // We're just gonna match these one punct at a time
-  using punctuator = Charset<"-,;:!?.()[]{}*/&#%^+<=>|~">;
-  return punctuator::match(ctx, body);
+// c_punctuators grouped by their first character, longest first, so the
+// first one that matches is the longest. "a+++b" is "a ++ + b".
+
+struct PunctTable {
+  uint8_t first[257]; // Punctuators starting with c are order[first[c]..first[c+1])
+  uint8_t order[c_punctuators.size()];
+};
+
+consteval PunctTable make_punct_table() {
+  PunctTable t = {};
+  uint8_t count[256] = {};
+  for (auto p : c_punctuators) count[uint8_t(p[0])]++;
+  for (int c = 0; c < 256; c++) t.first[c + 1] = t.first[c] + count[c];
+
+  uint8_t cursor[256] = {};
+  for (int len = 3; len > 0; len--) {
+    for (size_t i = 0; i < c_punctuators.size(); i++) {
+      auto p = c_punctuators[i];
+      if (__builtin_strlen(p) != size_t(len)) continue;
+      auto c = uint8_t(p[0]);
+      t.order[t.first[c] + cursor[c]++] = uint8_t(i);
+    }
+  }
+  return t;
+}
+
+constexpr PunctTable punct_table = make_punct_table();
+
+TextSpan match_punct(TextMatchContext&, TextSpan body, uint32_t& id) {
+  if (body.is_empty()) return body.fail();
+  auto c = uint8_t(*body.begin);
+
+  for (int i = punct_table.first[c]; i < punct_table.first[c + 1]; i++) {
+    auto p = c_punctuators[punct_table.order[i]];
+    int len = 1;
+    while (p[len] && len < body.len() && p[len] == body.begin[len]) len++;
+    if (p[len] == 0) {
+      id = punct_table.order[i] + 1;
+      return body.advance(len);
+    }
+  }
+  return body.fail();
 }
 
 // Yeaaaah, not gonna try to support trigraphs, they're obsolete and have been
@@ -463,9 +833,9 @@ TextSpan match_punct(TextMatchContext& ctx, TextSpan body) {
 // 6.4.9 Comments
 
 TextSpan match_oneline_comment(TextMatchContext& ctx, TextSpan body) {
-  // Single-line comments
-  using slc = Seq<Lit<"//">, Until<EOL>>;
-  return slc::match(ctx, body);
+  // Single-line comments - Seq<Lit<"//">, Until<EOL>>
+  if (body.len() < 2 || body.begin[0] != '/' || body.begin[1] != '/') return body.fail();
+  return TextSpan(find_newline(body.begin + 2, body.end), body.end);
 }
 
 TextSpan match_multiline_comment(TextMatchContext& ctx, TextSpan body) {
@@ -513,16 +883,19 @@ TextSpan match_splice(TextMatchContext& ctx, TextSpan body) {
 //------------------------------------------------------------------------------
 
 TextSpan match_preproc(TextMatchContext& ctx, TextSpan body) {
-  // clang-format off
-  using pattern = Seq<
-    Atom<'#'>,
-    Any<
-      Ref<match_splice>,
-      NotAtom<'\n'>
-    >
-  >;
-  // clang-format on
-  return pattern::match(ctx, body);
+  // Seq<Atom<'#'>, Any<Ref<match_splice>, NotAtom<'\n'>>>, jumping from one
+  // newline or backslash to the next.
+  if (body.is_empty() || *body.begin != '#') return body.fail();
+
+  auto tail = body.advance(1);
+  while (1) {
+    tail.begin = find_newline_or_backslash(tail.begin, tail.end);
+    if (tail.is_empty() || *tail.begin == '\n') return tail;
+
+    // A backslash that doesn't start a splice is just part of the line.
+    auto splice = match_splice(ctx, tail);
+    tail = splice.is_valid() ? splice : tail.advance(1);
+  }
 }
 
 //------------------------------------------------------------------------------
@@ -5,8 +5,10 @@
 
 #include <vector>
 #include <string>
+#include "CInterner.hpp"
 #include "CToken.hpp"
 #include "matcheroni/Matcheroni.hpp"
+#include "matcheroni/Parseroni.hpp"
 
 //------------------------------------------------------------------------------
 
@@ -15,7 +17,54 @@ struct CLexer {
   void reset();
   bool lex(matcheroni::TextSpan text);
 
+  // Pull-based lexing. start() puts the BOF token for 'text' on 'tokens', and
+  // each pull() lexes up to and including the next significant token. lex()
+  // is just start() and pull() until done(). pull() returns false if the text
+  // doesn't lex.
+  void start(matcheroni::TextSpan text);
+  bool pull();
+  bool done() const {
+    return !tokens.empty() && (tokens.back().type == LEX_EOF || tokens.back().type == LEX_INVALID);
+  }
+
+  // Drops the first 'count' tokens and the trivia in front of them, once
+  // nothing points at them any more. The rest move down to the front.
+  void discard(size_t count);
+
+  // Lexes 'new_text', which is 'old_text' with 'edit' applied, reusing the
+  // tokens 'old' lexed from 'old_text'. Only the lines around the edit are
+  // lexed again - we stop as soon as a token starts where an old one did, and
+  // copy the rest. Only the old text in front of the edit is read, so it can
+  // be the same buffer edited in place. The two lexers have to share an
+  // interner.
+  bool relex(const CLexer& old, matcheroni::TextSpan old_text,
+             matcheroni::TextSpan new_text, const parseroni::SpanEdit& edit);
+
+  // Leading trivia of tokens[i], see below.
+  matcheroni::Span<CToken> trivia_before(size_t i) const {
+    auto begin = trivia.data() + (i ? trivia_end[i - 1] : 0);
+    return matcheroni::Span<CToken>(begin, trivia.data() + trivia_end[i]);
+  }
+
+  // The tokens the parser sees, from BOF to EOF. The parser uses this array
+  // in place, so it has to outlive the parse tree.
   std::vector<CToken> tokens;
+
+  // Spaces, newlines, comments, splices and form feeds go here instead. The
+  // trivia in front of tokens[i] end at trivia[trivia_end[i]], so the text
+  // can still be rebuilt exactly.
+  std::vector<CToken>   trivia;
+  std::vector<uint32_t> trivia_end;
+
+  // Identifier tokens get their ids from here. reset() keeps the ids, and
+  // lexers whose tokens go to the same CContext (like the old and new text of
+  // a reparse) must share an interner.
+  CInterner* interner = &own_interner;
+  CInterner own_interner;
+
+  // The text pull() hasn't lexed yet.
+  matcheroni::TextSpan rest;
+  matcheroni::TextMatchContext ctx;
 };
 
 CToken next_lexeme(matcheroni::TextMatchContext& ctx, matcheroni::TextSpan body);
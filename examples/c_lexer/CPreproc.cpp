@@ -0,0 +1,1364 @@
+// SPDX-FileCopyrightText:  2023 Austin Appleby <aappleby@gmail.com>
+// SPDX-License-Identifier: MIT License
+
+#include "CPreproc.hpp"
+
+#include "matcheroni/Utilities.hpp"
+
+#include <algorithm>
+#include <stdarg.h>
+#include <string_view>
+#include <sys/stat.h>
+#include <time.h>
+
+using namespace matcheroni;
+
+namespace {
+
+// PPToken flags
+enum {
+  PP_PASTE       = 1, // A ## from a macro body
+  PP_PLACEMARKER = 2, // An empty argument next to a ##
+};
+
+// Builtin macros
+enum {
+  BUILTIN_FILE = 1,
+  BUILTIN_LINE,
+  BUILTIN_COUNTER,
+  BUILTIN_INCLUDE_LEVEL,
+  BUILTIN_DATE,
+  BUILTIN_TIME,
+  BUILTIN_HAS_INCLUDE, // Only means something in #if
+};
+
+const char* predefines =
+  "#define __STDC__ 1\n"
+  "#define __STDC_VERSION__ 201710L\n"
+  "#define __STDC_HOSTED__ 1\n"
+  "#define __STDC_UTF_16__ 1\n"
+  "#define __STDC_UTF_32__ 1\n"
+  "#define __x86_64__ 1\n"
+  "#define __x86_64 1\n"
+  "#define __amd64__ 1\n"
+  "#define __amd64 1\n"
+  "#define __linux__ 1\n"
+  "#define __linux 1\n"
+  "#define __gnu_linux__ 1\n"
+  "#define __unix__ 1\n"
+  "#define __unix 1\n"
+  "#define __ELF__ 1\n"
+  "#define __LP64__ 1\n"
+  "#define _LP64 1\n"
+  "#define __CHAR_BIT__ 8\n"
+  "#define __SIZEOF_SHORT__ 2\n"
+  "#define __SIZEOF_INT__ 4\n"
+  "#define __SIZEOF_LONG__ 8\n"
+  "#define __SIZEOF_LONG_LONG__ 8\n"
+  "#define __SIZEOF_POINTER__ 8\n"
+  "#define __SIZEOF_FLOAT__ 4\n"
+  "#define __SIZEOF_DOUBLE__ 8\n"
+  "#define __SIZEOF_LONG_DOUBLE__ 16\n"
+  "#define __SIZEOF_SIZE_T__ 8\n"
+  "#define __SIZEOF_WCHAR_T__ 4\n"
+  "#define __SIZEOF_WINT_T__ 4\n"
+  "#define __SIZEOF_PTRDIFF_T__ 8\n"
+  "#define __SCHAR_MAX__ 0x7f\n"
+  "#define __SHRT_MAX__ 0x7fff\n"
+  "#define __INT_MAX__ 0x7fffffff\n"
+  "#define __LONG_MAX__ 0x7fffffffffffffffL\n"
+  "#define __LONG_LONG_MAX__ 0x7fffffffffffffffLL\n"
+  "#define __WCHAR_MAX__ 0x7fffffff\n"
+  "#define __WCHAR_MIN__ (-__WCHAR_MAX__ - 1)\n"
+  "#define __SIZE_MAX__ 0xffffffffffffffffUL\n"
+  "#define __PTRDIFF_MAX__ 0x7fffffffffffffffL\n"
+  "#define __SIZE_TYPE__ long unsigned int\n"
+  "#define __PTRDIFF_TYPE__ long int\n"
+  "#define __WCHAR_TYPE__ int\n"
+  "#define __WINT_TYPE__ unsigned int\n"
+  "#define __CHAR16_TYPE__ short unsigned int\n"
+  "#define __CHAR32_TYPE__ unsigned int\n"
+  "#define __ORDER_LITTLE_ENDIAN__ 1234\n"
+  "#define __ORDER_BIG_ENDIAN__ 4321\n"
+  "#define __ORDER_PDP_ENDIAN__ 3412\n"
+  "#define __BYTE_ORDER__ __ORDER_LITTLE_ENDIAN__\n";
+
+bool is_ident_char(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Splits a directive's text into its name and the rest of the line, without
+// lexing it - skipped groups only need the name.
+TextSpan directive_name(TextSpan text, TextSpan* rest = nullptr) {
+  auto c = text.begin + 1;
+  while (c < text.end && (*c == ' ' || *c == '\t')) c++;
+  auto name = c;
+  while (c < text.end && is_ident_char(*c)) c++;
+  if (rest) *rest = TextSpan(c, text.end);
+  return TextSpan(name, c);
+}
+
+bool is(TextSpan text, const char* s) {
+  auto len = strlen(s);
+  return size_t(text.len()) == len && memcmp(text.begin, s, len) == 0;
+}
+
+bool starts_with(TextSpan text, const char* prefix) {
+  auto len = strlen(prefix);
+  return size_t(text.len()) >= len && memcmp(text.begin, prefix, len) == 0;
+}
+
+// The newline that ends the line 'c' is on, skipping splices.
+const char* line_end(const char* c, const char* text_end) {
+  while (true) {
+    auto nl = (const char*)memchr(c, '\n', text_end - c);
+    if (!nl) return text_end;
+    auto back = nl;
+    while (back > c && (back[-1] == ' ' || back[-1] == '\t' || back[-1] == '\r')) back--;
+    if (back == c || back[-1] != '\\') return nl;
+    c = nl + 1;
+  }
+}
+
+// Finds the end of a directive that starts at 'begin' and whose first line
+// ends at 'end'. A /* comment that doesn't close on that line takes the
+// directive along to the line the comment ends on.
+const char* directive_end(const char* begin, const char* end, const char* text_end) {
+  for (auto c = begin; c < end; c++) {
+    if (*c == '"' || *c == '\'') {
+      auto quote = *c;
+      for (c++; c < end && *c != quote; c++) {
+        if (*c == '\\') c++;
+      }
+    } else if (c[0] == '/' && c + 1 < end && c[1] == '/') {
+      return end;
+    } else if (c[0] == '/' && c + 1 < end && c[1] == '*') {
+      auto close = std::string_view(c + 2, text_end - (c + 2)).find("*/");
+      if (close == std::string_view::npos) return text_end;
+      c += 2 + close + 1;
+      if (c >= end) end = line_end(c, text_end);
+    }
+  }
+  return end;
+}
+
+//----------------------------------------
+// #if expressions, evaluated in 64 bits. Unsigned if either side is, like C.
+
+struct Value {
+  int64_t i;
+  bool is_unsigned;
+};
+
+bool parse_int(TextSpan text, Value& v) {
+  uint64_t x = 0;
+  int base = 10;
+  auto c = text.begin;
+  if (c + 1 < text.end && c[0] == '0' && (c[1] == 'x' || c[1] == 'X')) {
+    base = 16;
+    c += 2;
+  } else if (c + 1 < text.end && c[0] == '0' && (c[1] == 'b' || c[1] == 'B')) {
+    base = 2;
+    c += 2;
+  } else if (c < text.end && c[0] == '0') {
+    base = 8;
+  }
+
+  v.is_unsigned = false;
+  for (; c < text.end; c++) {
+    int d;
+    if (*c >= '0' && *c <= '9') d = *c - '0';
+    else if (*c >= 'a' && *c <= 'f' && base == 16) d = *c - 'a' + 10;
+    else if (*c >= 'A' && *c <= 'F' && base == 16) d = *c - 'A' + 10;
+    else if (*c == '\'') continue;
+    else break;
+    if (d >= base) return false;
+    x = x * base + d;
+  }
+  for (; c < text.end; c++) {
+    if (*c == 'u' || *c == 'U') v.is_unsigned = true;
+    else if (*c != 'l' && *c != 'L') return false;
+  }
+
+  // Too big to be signed means it's unsigned.
+  if (x > uint64_t(INT64_MAX)) v.is_unsigned = true;
+  v.i = int64_t(x);
+  return true;
+}
+
+bool parse_char(TextSpan text, Value& v) {
+  auto c = text.begin;
+  while (c < text.end && *c != '\'') c++;
+  bool wide = c != text.begin;
+  c++;
+  if (c >= text.end) return false;
+
+  int64_t x = 0;
+  if (*c != '\\') {
+    x = uint8_t(*c);
+  } else {
+    c++;
+    switch (*c) {
+      case 'n': x = '\n'; break;
+      case 't': x = '\t'; break;
+      case 'r': x = '\r'; break;
+      case 'a': x = '\a'; break;
+      case 'b': x = '\b'; break;
+      case 'f': x = '\f'; break;
+      case 'v': x = '\v'; break;
+      case 'e': x = 27; break;
+      case 'x':
+        for (c++; c < text.end && isxdigit(*c); c++) {
+          x = x * 16 + (isdigit(*c) ? *c - '0' : (*c | 0x20) - 'a' + 10);
+        }
+        break;
+      default:
+        if (*c >= '0' && *c <= '7') {
+          for (int i = 0; i < 3 && *c >= '0' && *c <= '7'; i++, c++) x = x * 8 + (*c - '0');
+        } else {
+          x = uint8_t(*c);
+        }
+        break;
+    }
+  }
+
+  // Plain chars are signed.
+  if (!wide) x = int8_t(x);
+  v = {x, false};
+  return true;
+}
+
+struct Eval {
+  CPreproc& pp;
+  const std::vector<CPreproc::PPToken>& toks;
+  size_t i = 0;
+  bool ok = true;
+
+  const CToken* peek() const { return i < toks.size() ? &toks[i].tok : nullptr; }
+
+  bool take(uint32_t punct) {
+    if (auto t = peek(); t && t->is_punct(punct)) {
+      i++;
+      return true;
+    }
+    return false;
+  }
+
+  static int precedence(const CToken* t) {
+    if (!t || t->type != LEX_PUNCT) return 0;
+    switch (t->id) {
+      case punct_id("*"): case punct_id("/"): case punct_id("%"): return 10;
+      case punct_id("+"): case punct_id("-"): return 9;
+      case punct_id("<<"): case punct_id(">>"): return 8;
+      case punct_id("<"): case punct_id("<="): case punct_id(">"): case punct_id(">="): return 7;
+      case punct_id("=="): case punct_id("!="): return 6;
+      case punct_id("&"): return 5;
+      case punct_id("^"): return 4;
+      case punct_id("|"): return 3;
+      case punct_id("&&"): return 2;
+      case punct_id("||"): return 1;
+      default: return 0;
+    }
+  }
+
+  Value expr() {
+    Value c = binary(1);
+    if (!take(punct_id("?"))) return c;
+    Value a = expr();
+    if (!take(punct_id(":"))) ok = false;
+    Value b = expr();
+    Value r = c.i ? a : b;
+    r.is_unsigned = a.is_unsigned || b.is_unsigned;
+    return r;
+  }
+
+  Value binary(int min_prec) {
+    Value a = unary();
+    while (ok) {
+      auto op = peek();
+      int prec = precedence(op);
+      if (prec < min_prec || prec == 0) break;
+      i++;
+      Value b = binary(prec + 1);
+      a = apply(op->id, a, b);
+    }
+    return a;
+  }
+
+  static Value apply(uint32_t op, Value a, Value b) {
+    bool u = a.is_unsigned || b.is_unsigned;
+    uint64_t ua = a.i, ub = b.i;
+    switch (op) {
+      // Division by zero can only be in a branch that doesn't count.
+      case punct_id("*"):  return {int64_t(ua * ub), u};
+      case punct_id("/"):  return {!b.i ? 0 : u ? int64_t(ua / ub) : b.i == -1 ? int64_t(0 - ua) : a.i / b.i, u};
+      case punct_id("%"):  return {!b.i ? 0 : u ? int64_t(ua % ub) : b.i == -1 ? 0 : a.i % b.i, u};
+      case punct_id("+"):  return {int64_t(ua + ub), u};
+      case punct_id("-"):  return {int64_t(ua - ub), u};
+      case punct_id("<<"): return {int64_t(ua << (ub & 63)), a.is_unsigned};
+      case punct_id(">>"): return {a.is_unsigned ? int64_t(ua >> (ub & 63)) : a.i >> (ub & 63), a.is_unsigned};
+      case punct_id("<"):  return {u ? ua < ub : a.i < b.i, false};
+      case punct_id("<="): return {u ? ua <= ub : a.i <= b.i, false};
+      case punct_id(">"):  return {u ? ua > ub : a.i > b.i, false};
+      case punct_id(">="): return {u ? ua >= ub : a.i >= b.i, false};
+      case punct_id("=="): return {a.i == b.i, false};
+      case punct_id("!="): return {a.i != b.i, false};
+      case punct_id("&"):  return {a.i & b.i, u};
+      case punct_id("^"):  return {a.i ^ b.i, u};
+      case punct_id("|"):  return {a.i | b.i, u};
+      case punct_id("&&"): return {a.i && b.i, false};
+      case punct_id("||"): return {a.i || b.i, false};
+    }
+    return {0, false};
+  }
+
+  // Skips a parenthesized argument list, if there is one.
+  void skip_args() {
+    if (!take(punct_id("("))) return;
+    for (int depth = 1; depth && i < toks.size(); i++) {
+      if (toks[i].tok.is_punct(punct_id("("))) depth++;
+      if (toks[i].tok.is_punct(punct_id(")"))) depth--;
+    }
+  }
+
+  Value unary() {
+    auto t = peek();
+    if (!t) {
+      ok = false;
+      return {0, false};
+    }
+    i++;
+
+    if (t->type == LEX_PUNCT) {
+      switch (t->id) {
+        case punct_id("+"): return unary();
+        case punct_id("-"): { auto v = unary(); return {int64_t(0 - uint64_t(v.i)), v.is_unsigned}; }
+        case punct_id("~"): { auto v = unary(); return {~v.i, v.is_unsigned}; }
+        case punct_id("!"): { auto v = unary(); return {!v.i, false}; }
+        case punct_id("("): {
+          auto v = expr();
+          if (!take(punct_id(")"))) ok = false;
+          return v;
+        }
+      }
+    } else if (t->type == LEX_INT) {
+      Value v;
+      if (!parse_int(t->text(), v)) ok = false;
+      return v;
+    } else if (t->type == LEX_CHAR) {
+      Value v;
+      if (!parse_char(t->text(), v)) ok = false;
+      return v;
+    } else if (t->type == LEX_IDENTIFIER || t->type == LEX_KEYWORD) {
+      // "defined" that came out of a macro.
+      if (t->type == LEX_IDENTIFIER && t->id == pp.id_defined) {
+        bool paren = take(punct_id("("));
+        auto name = peek();
+        if (!name) {
+          ok = false;
+          return {0, false};
+        }
+        i++;
+        if (paren && !take(punct_id(")"))) ok = false;
+        return {pp.find_macro(*name) != 0, false};
+      }
+      // Identifiers left after expansion are zero. So are the ones that look
+      // like calls, which covers __has_attribute() and friends.
+      skip_args();
+      return {0, false};
+    }
+
+    ok = false;
+    return {0, false};
+  }
+};
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+
+CPreproc::CPreproc() {
+  tokens.reserve(65536);
+  predefined = predefines;
+}
+
+CPreproc::~CPreproc() {}
+
+void CPreproc::add_include_path(const std::string& path) {
+  include_paths.push_back(path);
+  resolved.clear();
+}
+
+void CPreproc::define(const std::string& name, const std::string& body) {
+  predefined += "#define " + name + " " + body + "\n";
+}
+
+//------------------------------------------------------------------------------
+
+bool CPreproc::preprocess(const std::string& path) {
+  generation++;
+  tokens.clear();
+  error.clear();
+  lines = 0;
+  frames.clear();
+  conds.clear();
+  counter = 0;
+
+  macros.resize(1);
+  bodies.clear();
+  body_params.clear();
+  by_id.assign(interner->size(), 0);
+  by_keyword.assign(c_keywords.size() + 1, 0);
+  hides.resize(1);
+  arena.clear();
+  arena_used = arena_size = 0;
+
+  lexer.interner = interner;
+  id_defined          = interner->intern(utils::to_span("defined"));
+  id_va_args          = interner->intern(utils::to_span("__VA_ARGS__"));
+  id_va_opt           = interner->intern(utils::to_span("__VA_OPT__"));
+  id_pragma           = interner->intern(utils::to_span("_Pragma"));
+  id_has_include      = interner->intern(utils::to_span("__has_include"));
+  id_has_include_next = interner->intern(utils::to_span("__has_include_next"));
+
+  static const std::pair<const char*, uint8_t> builtins[] = {
+    {"__FILE__",          BUILTIN_FILE},
+    {"__LINE__",          BUILTIN_LINE},
+    {"__COUNTER__",       BUILTIN_COUNTER},
+    {"__INCLUDE_LEVEL__", BUILTIN_INCLUDE_LEVEL},
+    {"__DATE__",          BUILTIN_DATE},
+    {"__TIME__",          BUILTIN_TIME},
+    {"__has_include",      BUILTIN_HAS_INCLUDE},
+    {"__has_include_next", BUILTIN_HAS_INCLUDE},
+  };
+  for (auto [name, code] : builtins) {
+    Macro macro;
+    macro.builtin = code;
+    macros.push_back(macro);
+    auto text = utils::to_span(name);
+    set_macro(CToken(LEX_IDENTIFIER, text, interner->intern(text)), uint32_t(macros.size() - 1));
+  }
+
+  File* main = load(path);
+  if (!main) return fail("can't read %s", path.c_str());
+
+  // The predefined macros and define()s are a file of their own, which only
+  // has to be lexed again if define() changed it.
+  auto& pre = files["<built-in>"];
+  if (!pre) {
+    pre.reset(new File());
+    pre->path = "<built-in>";
+  }
+  uint64_t hash = std::hash<std::string_view>()(predefined);
+  if (pre->tokens.empty() || pre->hash != hash) {
+    pre->text = predefined;
+    pre->hash = hash;
+    if (!lex_file(pre.get())) return false;
+  }
+
+  if (!push_file(main, -1) || !push_file(pre.get(), -1)) return false;
+  lines -= pre->lines;
+
+  TextSpan text = utils::to_span(main->text);
+  tokens.push_back(CToken(LEX_BOF, TextSpan(text.begin, text.begin)));
+
+  std::vector<PPToken> stack;
+  PPToken t;
+  while (expand_next(stack, true, t)) tokens.push_back(t.tok);
+  if (!error.empty()) return false;
+
+  tokens.push_back(CToken(LEX_EOF, TextSpan(text.end, text.end)));
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// The file cache
+
+// A file is looked at once per preprocess(). Its tokens are reused if its size
+// and timestamp match what we lexed, or failing that, its contents do.
+CPreproc::File* CPreproc::load(const std::string& path) {
+  auto it = files.find(path);
+  File* file = it == files.end() ? nullptr : it->second.get();
+  if (file && file->checked == generation) return file;
+
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return nullptr;
+  int64_t mtime = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+
+  if (!file) {
+    file = new File();
+    file->path = path;
+    auto slash = path.rfind('/');
+    file->dir = slash == std::string::npos ? "." : path.substr(0, slash);
+    files[path].reset(file);
+  }
+  file->checked = generation;
+
+  if (!file->tokens.empty() && file->size == uint64_t(st.st_size) && file->mtime == mtime) {
+    cache_hits++;
+    return file;
+  }
+
+  std::string text = utils::read(path);
+  uint64_t hash = std::hash<std::string_view>()(text);
+  file->size = st.st_size;
+  file->mtime = mtime;
+  if (!file->tokens.empty() && file->hash == hash && file->text == text) {
+    cache_hits++;
+    return file;
+  }
+
+  file->text = std::move(text);
+  file->hash = hash;
+  return lex_file(file) ? file : nullptr;
+}
+
+bool CPreproc::lex_file(File* file) {
+  files_lexed++;
+  file->tokens.clear();
+  file->guard = 0;
+  file->once = false;
+
+  TextSpan text = utils::to_span(file->text);
+  lexer.reset();
+  lexer.start(text);
+  while (true) {
+    lexer.pull();
+    auto& t = lexer.tokens.back();
+    if (t.type == LEX_EOF) break;
+
+    // Stray characters get a token of their own, like in the compiler - they
+    // can be in a skipped group or stringized.
+    if (t.type == LEX_INVALID) {
+      t = CToken(LEX_INVALID, TextSpan(lexer.rest.begin, lexer.rest.begin + 1));
+      lexer.rest.begin++;
+      continue;
+    }
+
+    if (t.type == LEX_PREPROC) {
+      auto end = directive_end(t.begin, t.begin + t.len, text.end);
+      t.len = uint32_t(end - t.begin);
+      lexer.rest.begin = end;
+    }
+  }
+  file->tokens = lexer.tokens;
+
+  file->lines = std::count(text.begin, text.end, '\n');
+  if (text.len() && text.end[-1] != '\n') file->lines++;
+
+  // An include guard is an #ifndef or #if !defined at the top whose #endif is
+  // the last thing in the file.
+  auto& toks = file->tokens;
+  if (toks.size() < 4 || toks[1].type != LEX_PREPROC || toks[toks.size() - 2].type != LEX_PREPROC) {
+    return true;
+  }
+
+  TextSpan rest;
+  auto name = directive_name(toks[1].text(), &rest);
+  std::vector<CToken> line;
+  lex_line(rest, line);
+  uint32_t guard = 0;
+  if (is(name, "ifndef") && line.size() == 1 && line[0].type == LEX_IDENTIFIER) {
+    guard = line[0].id;
+  } else if (is(name, "if") && line.size() >= 3 && line[0].is_punct(punct_id("!")) &&
+             line[1].type == LEX_IDENTIFIER && line[1].id == id_defined) {
+    if (line.size() == 3 && line[2].type == LEX_IDENTIFIER) {
+      guard = line[2].id;
+    } else if (line.size() == 5 && line[2].is_punct(punct_id("(")) &&
+               line[3].type == LEX_IDENTIFIER && line[4].is_punct(punct_id(")"))) {
+      guard = line[3].id;
+    }
+  }
+  if (!guard) return true;
+
+  int depth = 0;
+  for (size_t i = 2; i < toks.size() - 1; i++) {
+    if (toks[i].type != LEX_PREPROC) continue;
+    auto name = directive_name(toks[i].text());
+    if (starts_with(name, "if")) {
+      depth++;
+    } else if (is(name, "endif")) {
+      if (depth-- == 0) {
+        if (i == toks.size() - 2) file->guard = guard;
+        return true;
+      }
+    } else if (depth == 0 && (starts_with(name, "el"))) {
+      return true;
+    }
+  }
+  return true;
+}
+
+// Quoted includes look in the including file's directory first. Then we search
+// the include paths, starting after 'after' for #include_next.
+CPreproc::File* CPreproc::find_include(const std::string& name, bool quoted, int& index, int after) {
+  if (name.empty()) return nullptr;
+  if (name[0] == '/') {
+    index = -1;
+    return load(name);
+  }
+
+  std::string key = (quoted ? frames.back().file->dir : std::string()) + '\n' + name + '\n' +
+                    std::to_string(after);
+  auto it = resolved.find(key);
+  if (it != resolved.end()) {
+    index = it->second.second;
+    return load(it->second.first->path);
+  }
+
+  File* file = nullptr;
+  index = -1;
+  if (quoted) file = load(frames.back().file->dir + "/" + name);
+  for (int i = after + 1; !file && i < int(include_paths.size()); i++) {
+    file = load(include_paths[i] + "/" + name);
+    if (file) index = i;
+  }
+  if (file) resolved[key] = {file, index};
+  return file;
+}
+
+bool CPreproc::push_file(File* file, int index) {
+  if (frames.size() >= 200) return fail("#include nested too deeply");
+  frames.push_back({file, 1, conds.size(), index, file->text.data(), 1});
+  file->included = generation;
+  lines += file->lines;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Reading tokens
+//
+// Tokens come off 'stack' (the back is next) until it's empty, then off the
+// files if 'files' is set. Directives in the files are handled as we go.
+
+bool CPreproc::read(std::vector<PPToken>& stack, bool files, PPToken& t) {
+  if (!stack.empty()) {
+    t = stack.back();
+    stack.pop_back();
+    return true;
+  }
+
+  while (files && !frames.empty() && error.empty()) {
+    auto& f = frames.back();
+    const CToken& tok = f.file->tokens[f.pos];
+
+    if (tok.type == LEX_EOF) {
+      if (conds.size() != f.conds) return fail("unterminated #if");
+      frames.pop_back();
+      continue;
+    }
+
+    f.pos++;
+    if (tok.type == LEX_PREPROC) {
+      directive(tok);
+      continue;
+    }
+
+    t.tok = tok;
+    t.hide = 0;
+    t.flags = 0;
+    return true;
+  }
+  return false;
+}
+
+// Reads the next token that isn't a macro we should expand, expanding the
+// ones in front of it onto 'stack'.
+bool CPreproc::expand_next(std::vector<PPToken>& stack, bool files, PPToken& t) {
+  std::vector<std::vector<PPToken>> args;
+
+  while (true) {
+    bool from_file = files && stack.empty();
+    if (!read(stack, files, t)) break;
+    if (t.tok.type != LEX_IDENTIFIER && t.tok.type != LEX_KEYWORD) return true;
+
+    // _Pragma("...") does nothing we care about.
+    if (t.tok.type == LEX_IDENTIFIER && t.tok.id == id_pragma) {
+      PPToken next;
+      if (!read(stack, files, next)) return true;
+      if (!next.tok.is_punct(punct_id("("))) {
+        stack.push_back(next);
+        return true;
+      }
+      for (int depth = 1; depth;) {
+        if (!read(stack, files, next)) return fail("unterminated _Pragma");
+        if (next.tok.is_punct(punct_id("("))) depth++;
+        if (next.tok.is_punct(punct_id(")"))) depth--;
+      }
+      continue;
+    }
+
+    uint32_t m = find_macro(t.tok);
+    if (!m || hidden(t.hide, m)) return true;
+
+    // Copied, as directives can add macros while we're reading arguments.
+    Macro macro = macros[m];
+    if (from_file) expand_at = t.tok.begin;
+    if (macro.builtin == BUILTIN_HAS_INCLUDE) return true;
+    if (macro.builtin) {
+      t = builtin(m, t);
+      return true;
+    }
+
+    args.clear();
+    if (!macro.function_like) {
+      substitute(m, args, hide_add(t.hide, m), stack);
+      continue;
+    }
+
+    // A function-like macro's name without arguments is just a name.
+    PPToken next;
+    if (!read(stack, files, next)) return error.empty();
+    if (!next.tok.is_punct(punct_id("("))) {
+      stack.push_back(next);
+      return true;
+    }
+
+    PPToken rparen;
+    if (!collect_args(stack, files, macro, args, rparen)) return false;
+    substitute(m, args, hide_add(hide_intersect(t.hide, rparen.hide), m), stack);
+  }
+  return false;
+}
+
+bool CPreproc::collect_args(std::vector<PPToken>& stack, bool files, const Macro& macro,
+                            std::vector<std::vector<PPToken>>& args, PPToken& rparen) {
+  args.emplace_back();
+  int depth = 0;
+  PPToken a;
+  while (true) {
+    if (!read(stack, files, a)) return fail("unterminated argument list");
+    if (a.tok.type == LEX_PUNCT) {
+      if (a.tok.id == punct_id("(")) {
+        depth++;
+      } else if (a.tok.id == punct_id(")")) {
+        if (depth-- == 0) break;
+      } else if (a.tok.id == punct_id(",") && depth == 0 &&
+                 !(macro.variadic && args.size() == macro.params)) {
+        args.emplace_back();
+        continue;
+      }
+    }
+    args.back().push_back(a);
+  }
+  rparen = a;
+
+  if (macro.params == 0 && args.size() == 1 && args[0].empty()) args.clear();
+  if (macro.variadic && args.size() == macro.params - 1) args.emplace_back();
+  if (args.size() != macro.params) {
+    return fail("macro takes %d arguments, got %d", int(macro.params), int(args.size()));
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Expanding a macro
+//
+// Parameters are replaced by their arguments - fully expanded, unless the
+// parameter is next to # or ##. Then ## pastes, and the result goes back on
+// the stack to be scanned again with the macro added to every token's hide
+// set.
+
+void CPreproc::substitute(uint32_t m, std::vector<std::vector<PPToken>>& args, uint32_t hide,
+                          std::vector<PPToken>& stack) {
+  Macro macro = macros[m];
+  const CToken* body = bodies.data() + macro.body;
+  const int32_t* params = body_params.data() + macro.body;
+
+  std::vector<PPToken> out;
+  std::vector<std::vector<PPToken>> expanded(args.size());
+  std::vector<bool> done(args.size());
+  bool pasting = false;
+  uint32_t va_opt_end = UINT32_MAX;
+
+  for (uint32_t i = 0; i < macro.len; i++) {
+    const CToken& b = body[i];
+    int32_t p = params[i];
+
+    if (i == va_opt_end) continue;
+
+    if (macro.function_like && b.is_punct(punct_id("#")) && i + 1 < macro.len && params[i + 1] >= 0) {
+      out.push_back(stringize(args[params[++i]]));
+      continue;
+    }
+
+    if (b.is_punct(punct_id("##")) && i > 0 && i + 1 < macro.len) {
+      // GNU ", ## __VA_ARGS__" drops the comma if there are no varargs.
+      int32_t next = params[i + 1];
+      if (macro.variadic && next == int32_t(macro.params - 1) && body[i - 1].is_punct(punct_id(","))) {
+        if (args[next].empty()) out.pop_back();
+        out.insert(out.end(), args[next].begin(), args[next].end());
+        i++;
+        continue;
+      }
+      PPToken op;
+      op.tok = b;
+      op.flags = PP_PASTE;
+      out.push_back(op);
+      pasting = true;
+      continue;
+    }
+
+    // __VA_OPT__(x) is x if there are varargs and nothing if not.
+    if (macro.variadic && b.type == LEX_IDENTIFIER && b.id == id_va_opt &&
+        i + 1 < macro.len && body[i + 1].is_punct(punct_id("("))) {
+      uint32_t close = i + 2;
+      for (int depth = 0; close < macro.len; close++) {
+        if (body[close].is_punct(punct_id("("))) depth++;
+        if (body[close].is_punct(punct_id(")")) && depth-- == 0) break;
+      }
+      if (args.back().empty()) {
+        PPToken empty;
+        empty.flags = PP_PLACEMARKER;
+        out.push_back(empty);
+        i = close;
+      } else {
+        va_opt_end = close;
+        i++;
+      }
+      continue;
+    }
+
+    if (p < 0) {
+      PPToken t;
+      t.tok = b;
+      out.push_back(t);
+      continue;
+    }
+
+    bool pasted = (i > 0 && body[i - 1].is_punct(punct_id("##"))) ||
+                  (i + 1 < macro.len && body[i + 1].is_punct(punct_id("##")));
+    if (pasted) {
+      if (args[p].empty()) {
+        PPToken empty;
+        empty.flags = PP_PLACEMARKER;
+        out.push_back(empty);
+      }
+      out.insert(out.end(), args[p].begin(), args[p].end());
+      continue;
+    }
+
+    if (!done[p]) {
+      std::vector<PPToken> arg(args[p].rbegin(), args[p].rend());
+      PPToken t;
+      while (expand_next(arg, false, t)) expanded[p].push_back(t);
+      done[p] = true;
+    }
+    out.insert(out.end(), expanded[p].begin(), expanded[p].end());
+  }
+
+  if (pasting) {
+    std::vector<PPToken> pasted;
+    for (size_t i = 0; i < out.size(); i++) {
+      if ((out[i].flags & PP_PASTE) && !pasted.empty() && i + 1 < out.size()) {
+        paste(pasted.back(), out[++i], pasted.back());
+      } else {
+        pasted.push_back(out[i]);
+      }
+    }
+    out.swap(pasted);
+  }
+
+  for (size_t i = out.size(); i-- > 0;) {
+    if (out[i].flags & PP_PLACEMARKER) continue;
+    out[i].hide = hide_union(out[i].hide, hide);
+    out[i].flags = 0;
+    stack.push_back(out[i]);
+  }
+}
+
+bool CPreproc::paste(const PPToken& a, const PPToken& b, PPToken& out) {
+  if (a.flags & PP_PLACEMARKER) {
+    out = b;
+    return true;
+  }
+  if (b.flags & PP_PLACEMARKER) {
+    out = a;
+    return true;
+  }
+
+  auto text = alloc_text(a.tok.len + b.tok.len);
+  memcpy(text, a.tok.begin, a.tok.len);
+  memcpy(text + a.tok.len, b.tok.begin, b.tok.len);
+
+  std::vector<CToken> line;
+  lex_line(TextSpan(text, text + a.tok.len + b.tok.len), line);
+  if (line.size() != 1) {
+    return fail("pasting \"%.*s\" and \"%.*s\" does not give a valid token",
+                int(a.tok.len), a.tok.begin, int(b.tok.len), b.tok.begin);
+  }
+  out.tok = line[0];
+  out.hide = 0;
+  out.flags = 0;
+  return true;
+}
+
+CPreproc::PPToken CPreproc::stringize(const std::vector<PPToken>& arg) {
+  std::string s = "\"";
+  for (size_t i = 0; i < arg.size(); i++) {
+    auto& t = arg[i].tok;
+    // Spaces between the tokens become one space.
+    if (i && t.begin != arg[i - 1].tok.begin + arg[i - 1].tok.len) s += ' ';
+    for (auto c = t.begin; c < t.begin + t.len; c++) {
+      if ((t.type == LEX_STRING || t.type == LEX_CHAR) && (*c == '"' || *c == '\\')) s += '\\';
+      s += *c;
+    }
+  }
+  s += '"';
+
+  auto text = alloc_text(s.size());
+  memcpy(text, s.data(), s.size());
+  PPToken out;
+  out.tok = CToken(LEX_STRING, TextSpan(text, text + s.size()));
+  return out;
+}
+
+CPreproc::PPToken CPreproc::builtin(uint32_t m, const PPToken& t) {
+  char buf[64];
+  std::string s;
+  LexemeType type = LEX_INT;
+
+  switch (macros[m].builtin) {
+    case BUILTIN_FILE:
+      type = LEX_STRING;
+      s = "\"";
+      for (auto c : frames.back().file->path) {
+        if (c == '"' || c == '\\') s += '\\';
+        s += c;
+      }
+      s += "\"";
+      break;
+    case BUILTIN_LINE:
+      // The line the outermost macro call started on.
+      s = std::to_string(line_of(expand_at));
+      break;
+    case BUILTIN_COUNTER:
+      s = std::to_string(counter++);
+      break;
+    case BUILTIN_INCLUDE_LEVEL:
+      s = std::to_string(frames.size() - 1);
+      break;
+    case BUILTIN_DATE:
+    case BUILTIN_TIME: {
+      time_t now = time(nullptr);
+      strftime(buf, sizeof(buf), macros[m].builtin == BUILTIN_DATE ? "\"%b %e %Y\"" : "\"%T\"",
+               localtime(&now));
+      type = LEX_STRING;
+      s = buf;
+      break;
+    }
+  }
+
+  auto text = alloc_text(s.size());
+  memcpy(text, s.data(), s.size());
+  PPToken out;
+  out.tok = CToken(type, TextSpan(text, text + s.size()));
+  out.hide = t.hide;
+  return out;
+}
+
+//------------------------------------------------------------------------------
+// Directives
+
+bool CPreproc::directive(const CToken& t) {
+  TextSpan rest;
+  auto name = directive_name(t.text(), &rest);
+
+  // Null directives and line markers ("# 12 "foo.c"").
+  if (name.is_empty()) return true;
+
+  if (is(name, "include")) return do_include(rest, false);
+  if (is(name, "include_next")) return do_include(rest, true);
+  if (is(name, "import")) return do_include(rest, false);
+
+  if (is(name, "ifdef") || is(name, "ifndef")) {
+    std::vector<CToken> line;
+    lex_line(rest, line);
+    if (line.empty()) return fail("#%.*s with no macro name", int(name.len()), name.begin);
+    bool value = (find_macro(line[0]) != 0) == (is(name, "ifdef"));
+    conds.push_back(value);
+    return value || skip_group();
+  }
+
+  if (is(name, "if")) {
+    std::vector<CToken> line;
+    lex_line(rest, line);
+    bool value;
+    if (!do_if(line, value)) return false;
+    conds.push_back(value);
+    return value || skip_group();
+  }
+
+  // The end of a group that was taken - skip the rest of the chain.
+  if (is(name, "elif") || is(name, "else") || is(name, "elifdef") || is(name, "elifndef")) {
+    if (conds.size() <= frames.back().conds) {
+      return fail("#%.*s without #if", int(name.len()), name.begin);
+    }
+    conds.back() = true;
+    return skip_group();
+  }
+
+  if (is(name, "endif")) {
+    if (conds.size() <= frames.back().conds) return fail("#endif without #if");
+    conds.pop_back();
+    return true;
+  }
+
+  if (is(name, "define")) {
+    std::vector<CToken> line;
+    lex_line(rest, line);
+    return do_define(line);
+  }
+
+  if (is(name, "undef")) {
+    std::vector<CToken> line;
+    lex_line(rest, line);
+    if (line.empty()) return fail("#undef with no macro name");
+    set_macro(line[0], 0);
+    return true;
+  }
+
+  if (is(name, "pragma")) {
+    std::vector<CToken> line;
+    lex_line(rest, line);
+    if (line.size() == 1 && is(line[0].text(), "once")) frames.back().file->once = true;
+    return true;
+  }
+
+  if (is(name, "error")) {
+    return fail("#error%.*s", int(rest.len()), rest.begin);
+  }
+
+  if (is(name, "warning") || is(name, "line") || is(name, "ident") || is(name, "sccs") ||
+      is(name, "assert") || is(name, "unassert")) {
+    return true;
+  }
+
+  // Line markers
+  if (*name.begin >= '0' && *name.begin <= '9') return true;
+
+  return fail("invalid directive #%.*s", int(name.len()), name.begin);
+}
+
+bool CPreproc::do_include(TextSpan rest, bool next) {
+  auto c = rest.begin;
+  while (c < rest.end && (*c == ' ' || *c == '\t')) c++;
+
+  std::string name;
+  bool quoted = false;
+  if (c < rest.end && (*c == '"' || *c == '<')) {
+    auto close = (const char*)memchr(c + 1, *c == '"' ? '"' : '>', rest.end - (c + 1));
+    if (!close) return fail("bad #include");
+    quoted = *c == '"';
+    name.assign(c + 1, close);
+  } else {
+    // #include MACRO
+    std::vector<CToken> line;
+    lex_line(TextSpan(c, rest.end), line);
+    std::vector<PPToken> stack;
+    for (auto i = line.size(); i-- > 0;) stack.push_back({line[i], 0, 0});
+    std::vector<CToken> expanded;
+    PPToken t;
+    while (expand_next(stack, false, t)) expanded.push_back(t.tok);
+    if (expanded.size() == 1 && expanded[0].type == LEX_STRING && expanded[0].len >= 2) {
+      quoted = true;
+      name.assign(expanded[0].begin + 1, expanded[0].begin + expanded[0].len - 1);
+    } else if (expanded.size() >= 2 && expanded[0].is_punct(punct_id("<")) &&
+               expanded.back().is_punct(punct_id(">"))) {
+      for (size_t i = 1; i + 1 < expanded.size(); i++) {
+        name.append(expanded[i].begin, expanded[i].len);
+      }
+    } else {
+      return fail("bad #include");
+    }
+  }
+
+  int index;
+  File* file = find_include(name, quoted && !next, index, next ? frames.back().index : -1);
+  if (!file) return fail("can't find include file %s", name.c_str());
+
+  if (file->guard && file->guard < by_id.size() && by_id[file->guard]) {
+    guard_skips++;
+    return true;
+  }
+  if (file->once && file->included == generation) {
+    guard_skips++;
+    return true;
+  }
+  return push_file(file, index);
+}
+
+bool CPreproc::do_define(std::vector<CToken>& line) {
+  if (line.empty()) return fail("#define with no macro name");
+  const CToken& name = line[0];
+  if (name.type != LEX_IDENTIFIER && name.type != LEX_KEYWORD) return fail("bad macro name");
+
+  Macro macro;
+  macro.body = uint32_t(bodies.size());
+
+  // Parameters are only parameters if the paren touches the name.
+  std::vector<uint32_t> params;
+  size_t i = 1;
+  if (i < line.size() && line[i].is_punct(punct_id("(")) && line[i].begin == name.begin + name.len) {
+    macro.function_like = true;
+    for (i++; i < line.size(); i++) {
+      auto& p = line[i];
+      if (p.is_punct(punct_id(")")) && params.empty()) break;
+      if (p.is_punct(punct_id("..."))) {
+        macro.variadic = true;
+        params.push_back(id_va_args);
+        i++;
+      } else if (p.type == LEX_IDENTIFIER) {
+        params.push_back(p.id);
+        // GNU "args..."
+        if (i + 1 < line.size() && line[i + 1].is_punct(punct_id("..."))) {
+          macro.variadic = true;
+          i++;
+        }
+        i++;
+      } else {
+        return fail("bad macro parameter list");
+      }
+      if (i >= line.size()) return fail("bad macro parameter list");
+      if (line[i].is_punct(punct_id(")"))) break;
+      if (!line[i].is_punct(punct_id(",")) || macro.variadic) return fail("bad macro parameter list");
+    }
+    if (i >= line.size()) return fail("bad macro parameter list");
+    i++;
+  }
+
+  for (; i < line.size(); i++) {
+    int32_t p = -1;
+    if (line[i].type == LEX_IDENTIFIER) {
+      for (size_t j = 0; j < params.size(); j++) {
+        if (params[j] == line[i].id) p = int32_t(j);
+      }
+    }
+    bodies.push_back(line[i]);
+    body_params.push_back(p);
+  }
+
+  macro.len = uint32_t(bodies.size()) - macro.body;
+  macro.params = uint32_t(params.size());
+  macros.push_back(macro);
+  set_macro(name, uint32_t(macros.size() - 1));
+  return true;
+}
+
+// 'line' is the #if or #elif expression.
+bool CPreproc::do_if(std::vector<CToken>& line, bool& value) {
+  static const char* one = "1";
+  static const char* zero = "0";
+
+  // "defined X" and "__has_include(...)" have to go before macros are
+  // expanded.
+  std::vector<PPToken> items;
+  for (size_t i = 0; i < line.size(); i++) {
+    auto& t = line[i];
+    if (t.type == LEX_IDENTIFIER && t.id == id_defined) {
+      bool paren = i + 1 < line.size() && line[i + 1].is_punct(punct_id("("));
+      i += paren ? 2 : 1;
+      if (i >= line.size()) return fail("bad defined()");
+      bool defined = find_macro(line[i]) != 0;
+      if (paren && (++i >= line.size() || !line[i].is_punct(punct_id(")")))) return fail("bad defined()");
+      auto text = defined ? one : zero;
+      items.push_back({CToken(LEX_INT, TextSpan(text, text + 1)), 0, 0});
+    } else if (t.type == LEX_IDENTIFIER && (t.id == id_has_include || t.id == id_has_include_next)) {
+      bool next = t.id == id_has_include_next;
+      if (i + 3 >= line.size() || !line[i + 1].is_punct(punct_id("("))) return fail("bad __has_include");
+      std::string name;
+      bool quoted = line[i + 2].type == LEX_STRING;
+      size_t close = i + 3;
+      if (quoted) {
+        name.assign(line[i + 2].begin + 1, line[i + 2].begin + line[i + 2].len - 1);
+      } else {
+        while (close < line.size() && !line[close].is_punct(punct_id(">"))) close++;
+        if (close + 1 >= line.size()) return fail("bad __has_include");
+        name.assign(line[i + 2].begin + 1, line[close].begin);
+        close++;
+      }
+      if (!line[close].is_punct(punct_id(")"))) return fail("bad __has_include");
+      i = close;
+      int index;
+      bool found = find_include(name, quoted && !next, index, next ? frames.back().index : -1);
+      auto text = found ? one : zero;
+      items.push_back({CToken(LEX_INT, TextSpan(text, text + 1)), 0, 0});
+    } else {
+      items.push_back({t, 0, 0});
+    }
+  }
+
+  std::vector<PPToken> stack(items.rbegin(), items.rend());
+  std::vector<PPToken> expr;
+  PPToken t;
+  while (expand_next(stack, false, t)) expr.push_back(t);
+  if (!error.empty()) return false;
+
+  Eval eval = {*this, expr};
+  auto result = eval.expr();
+  if (!eval.ok || eval.i != expr.size()) return fail("bad #if expression");
+  value = result.i != 0;
+  return true;
+}
+
+// Called when the current group of the innermost #if isn't taken. Skips to
+// the #elif or #else whose group is, or past the #endif. Only directives are
+// looked at, and only their names unless we need to evaluate an #elif.
+bool CPreproc::skip_group() {
+  auto& f = frames.back();
+  auto& toks = f.file->tokens;
+  int depth = 0;
+
+  while (true) {
+    const CToken& t = toks[f.pos];
+    if (t.type == LEX_EOF) return fail("unterminated #if");
+    f.pos++;
+    if (t.type != LEX_PREPROC) continue;
+
+    TextSpan rest;
+    auto name = directive_name(t.text(), &rest);
+    if (starts_with(name, "if")) {
+      depth++;
+    } else if (is(name, "endif")) {
+      if (depth-- == 0) {
+        conds.pop_back();
+        return true;
+      }
+    } else if (depth == 0 && !conds.back()) {
+      if (is(name, "else")) {
+        conds.back() = true;
+        return true;
+      }
+
+      bool value = false;
+      if (is(name, "elif")) {
+        std::vector<CToken> line;
+        lex_line(rest, line);
+        if (!do_if(line, value)) return false;
+      } else if (is(name, "elifdef") || is(name, "elifndef")) {
+        std::vector<CToken> line;
+        lex_line(rest, line);
+        if (line.empty()) return fail("#%.*s with no macro name", int(name.len()), name.begin);
+        value = (find_macro(line[0]) != 0) == (is(name, "elifdef"));
+      }
+      if (value) {
+        conds.back() = true;
+        return true;
+      }
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+
+// Lexes part of a directive. "#" and "##" are punctuators here rather than the
+// start of another directive.
+void CPreproc::lex_line(TextSpan text, std::vector<CToken>& out) {
+  while (!text.is_empty()) {
+    if (*text.begin == '#') {
+      bool paste = text.len() > 1 && text.begin[1] == '#';
+      auto len = paste ? 2 : 1;
+      out.push_back(CToken(LEX_PUNCT, TextSpan(text.begin, text.begin + len),
+                           paste ? punct_id("##") : punct_id("#")));
+      text.begin += len;
+      continue;
+    }
+
+    auto t = next_lexeme(lexer.ctx, text);
+    if (t.type == LEX_EOF) break;
+    if (t.type == LEX_INVALID) t = CToken(LEX_INVALID, TextSpan(text.begin, text.begin + 1));
+    if (t.type == LEX_IDENTIFIER) t.id = interner->intern(t.text());
+    if (!t.is_gap()) out.push_back(t);
+    text.begin = t.text().end;
+  }
+}
+
+uint32_t CPreproc::find_macro(const CToken& t) const {
+  if (t.type == LEX_IDENTIFIER) return t.id < by_id.size() ? by_id[t.id] : 0;
+  if (t.type == LEX_KEYWORD) return by_keyword[t.id];
+  return 0;
+}
+
+void CPreproc::set_macro(const CToken& name, uint32_t m) {
+  if (name.type == LEX_KEYWORD) {
+    by_keyword[name.id] = m;
+  } else if (name.type == LEX_IDENTIFIER) {
+    if (name.id >= by_id.size()) by_id.resize(interner->size(), 0);
+    by_id[name.id] = m;
+  }
+}
+
+//------------------------------------------------------------------------------
+// Hide sets are linked lists in one array, sharing their tails.
+
+bool CPreproc::hidden(uint32_t hide, uint32_t m) const {
+  for (; hide; hide = hides[hide].next) {
+    if (hides[hide].macro == m) return true;
+  }
+  return false;
+}
+
+uint32_t CPreproc::hide_add(uint32_t hide, uint32_t m) {
+  if (hidden(hide, m)) return hide;
+  hides.push_back({m, hide});
+  return uint32_t(hides.size() - 1);
+}
+
+uint32_t CPreproc::hide_union(uint32_t a, uint32_t b) {
+  if (!a || a == b) return b;
+  for (; a; a = hides[a].next) b = hide_add(b, hides[a].macro);
+  return b;
+}
+
+uint32_t CPreproc::hide_intersect(uint32_t a, uint32_t b) {
+  if (a == b) return a;
+  uint32_t out = 0;
+  for (; a; a = hides[a].next) {
+    if (hidden(b, hides[a].macro)) out = hide_add(out, hides[a].macro);
+  }
+  return out;
+}
+
+//------------------------------------------------------------------------------
+
+char* CPreproc::alloc_text(size_t len) {
+  if (arena_used + len > arena_size) {
+    arena_size = std::max(len, size_t(65536));
+    arena.emplace_back(new char[arena_size]);
+    arena_used = 0;
+  }
+  auto text = arena.back().get() + arena_used;
+  arena_used += len;
+  return text;
+}
+
+size_t CPreproc::line_of(const char* c) {
+  auto& f = frames.back();
+  if (c < f.file->text.data() || c > f.file->text.data() + f.file->text.size()) return 0;
+  if (c < f.line_at) {
+    f.line_at = f.file->text.data();
+    f.line = 1;
+  }
+  f.line += std::count(f.line_at, c, '\n');
+  f.line_at = c;
+  return f.line;
+}
+
+bool CPreproc::fail(const char* format, ...) {
+  if (!error.empty()) return false;
+
+  if (!frames.empty()) {
+    auto& f = frames.back();
+    error = f.file->path + ":" + std::to_string(line_of(f.file->tokens[f.pos - 1].begin)) + ": ";
+  }
+
+  char buf[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  error += buf;
+  return false;
+}
+
+//------------------------------------------------------------------------------
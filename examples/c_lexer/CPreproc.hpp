@@ -0,0 +1,185 @@
+// SPDX-FileCopyrightText:  2023 Austin Appleby <aappleby@gmail.com>
+// SPDX-License-Identifier: MIT License
+
+#pragma once
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "CInterner.hpp"
+#include "CLexer.hpp"
+#include "CToken.hpp"
+#include "matcheroni/Matcheroni.hpp"
+
+//------------------------------------------------------------------------------
+// A C preprocessor that works on CLexer's tokens, so that files with
+// #includes and macros can be handed to the parser as the compiler would see
+// them.
+//
+// Every file is lexed once and its tokens are kept in a cache keyed by path
+// and checked against the file's size, timestamp and content hash, so the
+// headers shared by a set of translation units are only lexed the first
+// time. A header wrapped in an include guard or marked #pragma once is
+// skipped without looking at its tokens when it comes around again.
+//
+// Macros are expanded the way the standard describes - each token carries
+// the set of macros it came out of (its "hide set") and isn't expanded by any
+// of them again. Hide sets and macro bodies live in flat arrays indexed by
+// interned id, which are cleared between translation units.
+//
+// The output tokens point into the cached file text, or into an arena for
+// tokens made by # and ##, so they stay valid until the next preprocess().
+
+struct CPreproc {
+  CPreproc();
+  ~CPreproc();
+
+  // Directories searched by #include, in order. "quoted" includes look next
+  // to the including file first.
+  void add_include_path(const std::string& path);
+
+  // Like -D on the command line - 'name' can be "NAME" or "NAME(a,b)".
+  // Applies to every preprocess() after this.
+  void define(const std::string& name, const std::string& body = "1");
+
+  // Preprocesses the file at 'path' into 'tokens', from BOF to EOF. Returns
+  // false and sets 'error' if the file can't be read or preprocessed.
+  bool preprocess(const std::string& path);
+
+  //----------------------------------------
+
+  std::vector<CToken> tokens;
+  std::string error;
+
+  // Lines read for the last preprocess(), counting a header each time it's
+  // included, and the cache behavior since the CPreproc was made.
+  size_t lines = 0;
+  size_t files_lexed = 0;
+  size_t cache_hits = 0;
+  size_t guard_skips = 0;
+
+  // The output identifiers get their ids from here. Tokens from different
+  // preprocess() calls can go to the same CContext.
+  CInterner* interner = &own_interner;
+  CInterner own_interner;
+
+  //----------------------------------------
+
+  struct File {
+    std::string path;
+    std::string dir;
+    std::string text;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    uint64_t hash = 0;
+    size_t lines = 0;
+    std::vector<CToken> tokens;   // BOF to EOF, no trivia
+    uint32_t guard = 0;           // Id of the include guard macro, if any
+    bool once = false;            // Saw #pragma once
+    uint32_t checked = 0;         // Generation the file was last checked in
+    uint32_t included = 0;        // Generation the file was last included in
+  };
+
+  // A file being read, and the #if depth it started at.
+  struct Frame {
+    File* file;
+    size_t pos;
+    size_t conds;
+    int index;                    // Include path the file was found on, or -1
+    const char* line_at;          // Where line_of() last counted up to
+    size_t line;
+  };
+
+  struct Macro {
+    uint32_t body = 0;
+    uint32_t len = 0;
+    uint32_t params = 0;
+    bool function_like = false;
+    bool variadic = false;
+    uint8_t builtin = 0;
+  };
+
+  // A token on its way through macro expansion.
+  struct PPToken {
+    CToken tok = CToken(LEX_INVALID, matcheroni::TextSpan(nullptr, nullptr));
+    uint32_t hide = 0;            // Hide set
+    uint32_t flags = 0;
+  };
+
+  File* load(const std::string& path);
+  File* find_include(const std::string& name, bool quoted, int& index, int after);
+  bool  lex_file(File* file);
+
+  bool read(std::vector<PPToken>& stack, bool files, PPToken& t);
+  bool expand_next(std::vector<PPToken>& stack, bool files, PPToken& t);
+  bool collect_args(std::vector<PPToken>& stack, bool files, const Macro& macro,
+                    std::vector<std::vector<PPToken>>& args, PPToken& rparen);
+  void substitute(uint32_t m, std::vector<std::vector<PPToken>>& args,
+                  uint32_t hide, std::vector<PPToken>& stack);
+  bool paste(const PPToken& a, const PPToken& b, PPToken& out);
+  PPToken stringize(const std::vector<PPToken>& arg);
+  PPToken builtin(uint32_t m, const PPToken& t);
+
+  bool directive(const CToken& t);
+  bool do_include(matcheroni::TextSpan rest, bool next);
+  bool do_define(std::vector<CToken>& line);
+  bool do_if(std::vector<CToken>& line, bool& value);
+  bool skip_group();
+  bool push_file(File* file, int index);
+
+  void lex_line(matcheroni::TextSpan text, std::vector<CToken>& out);
+  uint32_t find_macro(const CToken& t) const;
+  void set_macro(const CToken& name, uint32_t m);
+
+  uint32_t hide_add(uint32_t hide, uint32_t m);
+  uint32_t hide_union(uint32_t a, uint32_t b);
+  uint32_t hide_intersect(uint32_t a, uint32_t b);
+  bool     hidden(uint32_t hide, uint32_t m) const;
+
+  char* alloc_text(size_t len);
+  bool fail(const char* format, ...);
+  size_t line_of(const char* c);
+
+  //----------------------------------------
+
+  std::vector<std::string> include_paths;
+  std::string predefined;
+
+  std::unordered_map<std::string, std::unique_ptr<File>> files;
+  std::unordered_map<std::string, std::pair<File*, int>> resolved;
+  std::vector<Frame> frames;
+  std::vector<uint8_t> conds;      // Whether each open #if has taken a group
+  uint32_t generation = 0;
+
+  std::vector<Macro> macros;       // Index 0 means "not a macro"
+  std::vector<CToken> bodies;      // Replacement lists, back to back
+  std::vector<int32_t> body_params; // Parameter index for each body token, or -1
+  std::vector<uint32_t> by_id;     // Interned id -> macro
+  std::vector<uint32_t> by_keyword; // keyword_id() -> macro
+
+  struct Hide {
+    uint32_t macro;
+    uint32_t next;
+  };
+  std::vector<Hide> hides;         // Index 0 is the empty set
+
+  std::vector<std::unique_ptr<char[]>> arena;
+  size_t arena_used = 0;
+  size_t arena_size = 0;
+
+  CLexer lexer;
+  uint32_t counter = 0;
+  const char* expand_at = nullptr; // Start of the last macro call in a file
+
+  // Interned ids of the names the preprocessor treats specially.
+  uint32_t id_defined = 0;
+  uint32_t id_va_args = 0;
+  uint32_t id_va_opt = 0;
+  uint32_t id_pragma = 0;
+  uint32_t id_has_include = 0;
+  uint32_t id_has_include_next = 0;
+};
+
+//------------------------------------------------------------------------------
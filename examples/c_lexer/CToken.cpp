@@ -9,10 +9,13 @@ using namespace matcheroni;
 
 //------------------------------------------------------------------------------
 
-CToken::CToken(LexemeType type, TextSpan text) {
+CToken::CToken(LexemeType type, TextSpan text, uint32_t id) {
+  // Not text.len(), which asserts the span is valid - a placeholder token
+  // made from a null span just gets length 0.
+  this->begin = text.begin;
+  this->len = uint32_t(text.end - text.begin);
   this->type = type;
-  this->text.begin = text.begin;
-  this->text.end = text.end;
+  this->id = id;
 }
 
 //----------------------------------------------------------------------------
@@ -97,7 +100,7 @@ void CToken::dump() const {
   if (type == LEX_BOF) dump = "<bof>";
   if (type == LEX_EOF) dump = "<eof>";
 
-  for (auto c = text.begin; c < text.end; c++) {
+  for (auto c = begin; c < begin + len; c++) {
     if      (*c == '\n') dump += "\\n";
     else if (*c == '\t') dump += "\\t";
     else if (*c == '\r') dump += "\\r";
@@ -3,6 +3,7 @@
 
 #pragma once
 #include <stdint.h>
+#include <string.h>
 
 #include "../c_parser/c_constants.hpp"
 #include "matcheroni/Matcheroni.hpp"
@@ -10,7 +11,7 @@
 
 //------------------------------------------------------------------------------
 
-enum LexemeType {
+enum LexemeType : uint8_t {
   LEX_INVALID = 0,
   LEX_SPACE,
   LEX_NEWLINE,
@@ -32,23 +33,58 @@ enum LexemeType {
 
 //------------------------------------------------------------------------------
 
+// Tokens are packed into 16 bytes - the lexer makes one for every lexeme in
+// the file and the parser's node spans point into arrays of them, so their
+// size is most of the memory a parse needs.
+
 struct CToken {
-  CToken(LexemeType type, matcheroni::TextSpan text);
+  CToken(LexemeType type, matcheroni::TextSpan text, uint32_t id = 0);
+
+  matcheroni::TextSpan text() const {
+    return matcheroni::TextSpan(begin, begin + len);
+  }
 
-  matcheroni::TextSpan as_text_span() const { return text; }
+  matcheroni::TextSpan as_text_span() const { return text(); }
 
   bool is_bof() const;
   bool is_eof() const;
   bool is_gap() const;
 
+  // Takes a keyword_id() or punct_id().
+  bool is_keyword(uint32_t keyword) const { return type == LEX_KEYWORD && id == keyword; }
+  bool is_punct(uint32_t punct) const { return type == LEX_PUNCT && id == punct; }
+
   const char* type_to_str() const;
   uint32_t type_to_color() const;
   void dump() const;
 
   //----------------------------------------
 
-  LexemeType type;
-  matcheroni::TextSpan text;
+  const char* begin;
+  uint32_t    len;
+  LexemeType  type : 8;
+  // Identifiers get their interned id (see CInterner), keywords and
+  // punctuators their keyword_id() or punct_id().
+  uint32_t    id : 24 = 0;
 };
 
+static_assert(sizeof(CToken) == 16);
+
+//------------------------------------------------------------------------------
+// Lets utils::hash_tree() and utils::SubtreeInterner compare trees of tokens
+// by their contents.
+
+inline uint64_t hash_atom(const CToken& t) {
+  uint64_t h = t.type;
+  for (auto c = t.text().begin; c < t.text().end; c++) {
+    h = (h * 123456789) ^ *c;
+  }
+  return h;
+}
+
+inline bool atom_eq(const CToken& a, const CToken& b) {
+  if (a.type != b.type || a.text().len() != b.text().len()) return false;
+  return memcmp(a.text().begin, b.text().begin, a.text().len()) == 0;
+}
+
 //------------------------------------------------------------------------------
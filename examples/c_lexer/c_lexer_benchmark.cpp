@@ -160,7 +160,7 @@ int main(int argc, char** argv) {
       continue;
     }
 
-    for (auto c : text) if (c == '\n') total_lines++;
+    total_lines += utils::LineIndex(utils::to_span(text)).line_count();
     source_files.push_back(f.path());
   }
 
@@ -170,6 +170,7 @@ int main(int argc, char** argv) {
   CLexer lexer;
   std::string text;
   size_t total_bytes = 0;
+  size_t total_tokens = 0;
   double lex_msec = 0;
   bool any_fail = false;
   int count = 0;
@@ -188,6 +189,7 @@ int main(int argc, char** argv) {
     lex_msec -= utils::timestamp_ms();
     bool lex_ok = lexer.lex(utils::to_span(text));
     lex_msec += utils::timestamp_ms();
+    total_tokens += lexer.tokens.size();
     if (!lex_ok) {
       failed_files.push_back(path);
       printf("Lexing failed for file %s:\n", path.c_str());
@@ -208,6 +210,7 @@ int main(int argc, char** argv) {
   printf("Total files %ld\n", source_files.size());
   printf("Total lines %ld\n", total_lines);
   printf("Total bytes %ld\n", total_bytes);
+  printf("Tokens      %ld, %ld bytes each\n", total_tokens, sizeof(CToken));
   printf("File rate   %.2f Kfiles/sec\n",  (source_files.size() / 1e3) / lex_sec);
   printf("Line rate   %.2f Mlines/sec\n",  (total_lines / 1e6) / lex_sec);
   printf("Byte rate   %.2f MBytes/sec\n",  (total_bytes / 1e6) / lex_sec);
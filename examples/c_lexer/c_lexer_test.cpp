@@ -5,6 +5,8 @@
 
 #include "CLexer.hpp"
 
+#include <assert.h>
+
 using namespace matcheroni;
 
 //------------------------------------------------------------------------------
@@ -49,10 +51,63 @@ int main(int argc, char** argv) {
   CLexer lexer;
   lexer.lex(utils::to_span(raw_text));
 
-  for (auto& l : lexer.tokens) {
-    l.dump();
-    printf("\n");
+  // Trivia and tokens back in file order should give us the text back, up to
+  // the NUL that ends it - EOF is an empty token.
+  std::string rebuilt;
+  for (size_t i = 0; i < lexer.tokens.size(); i++) {
+    auto trivia = lexer.trivia_before(i);
+    for (auto t = trivia.begin; t < trivia.end; t++) {
+      rebuilt.append(t->text().begin, t->text().end);
+    }
+    rebuilt.append(lexer.tokens[i].text().begin, lexer.tokens[i].text().end);
+  }
+  assert(rebuilt == some_text);
+
+  // Same again pulling one token at a time and dropping each one once we're
+  // done with it.
+  CLexer stream;
+  stream.start(utils::to_span(raw_text));
+  rebuilt.clear();
+  while (1) {
+    assert(stream.tokens.size() == 1);
+    auto trivia = stream.trivia_before(0);
+    for (auto t = trivia.begin; t < trivia.end; t++) {
+      rebuilt.append(t->text().begin, t->text().end);
+    }
+    rebuilt.append(stream.tokens[0].text().begin, stream.tokens[0].text().end);
+    if (stream.done()) break;
+
+    bool pulled = stream.pull();
+    assert(pulled);
+    stream.discard(1);
   }
+  assert(rebuilt == some_text);
+
+  // Relexing after an edit should give us the same lexemes as lexing the new
+  // text from scratch, including when the edit closes a comment that was
+  // opened on an earlier line.
+  auto same_lexemes = [](const CLexer& a, const CLexer& b) {
+    auto same = [](const std::vector<CToken>& x, const std::vector<CToken>& y) {
+      if (x.size() != y.size()) return false;
+      for (size_t i = 0; i < x.size(); i++) {
+        if (x[i].begin != y[i].begin || x[i].len != y[i].len) return false;
+        if (x[i].type != y[i].type || x[i].id != y[i].id) return false;
+      }
+      return true;
+    };
+    return same(a.tokens, b.tokens) && same(a.trivia, b.trivia) && a.trivia_end == b.trivia_end;
+  };
+
+  std::string old_text = "int a; /* b\nint c;\nint d;\n";
+  std::string new_text = "int a; /* b\nint c; */\nint d;\n";
+  parseroni::SpanEdit edit = {18, 18, 21};
+
+  CLexer old_lexer, new_lexer, full_lexer;
+  new_lexer.interner = full_lexer.interner = old_lexer.interner;
+  old_lexer.lex(utils::to_span(old_text));
+  new_lexer.relex(old_lexer, utils::to_span(old_text), utils::to_span(new_text), edit);
+  full_lexer.lex(utils::to_span(new_text));
+  assert(same_lexemes(new_lexer, full_lexer));
 
   return 0;
 }
@@ -4,14 +4,17 @@
 #include "CContext.hpp"
 
 #include "c_parse_nodes.hpp"
+#include "../c_lexer/CInterner.hpp"
+
+#include <algorithm>
+#include <thread>
 
 using namespace matcheroni;
+using namespace parseroni;
 
 //------------------------------------------------------------------------------
 
 CContext::CContext() {
-  type_scope = new CScope();
-  tokens.reserve(65536);
 }
 
 //------------------------------------------------------------------------------
@@ -19,100 +22,629 @@ CContext::CContext() {
 void CContext::reset() {
   NodeContext::reset();
 
-  tokens.clear();
-  while (type_scope->parent) pop_scope();
-  type_scope->clear();
+  tokens = TokenSpan();
+  preproc_end = -1;
+  types.clear();
+  for (auto& c : run_contexts) c->reset();
+  parse_complete = false;
 }
 
 //------------------------------------------------------------------------------
 
-bool CContext::parse(matcheroni::TextSpan text, TokenSpan lexemes) {
+bool CContext::parse(matcheroni::TextSpan text, TokenSpan tokens) {
   this->text_span = text;
-  this->lexemes = lexemes;
+  this->tokens = tokens;
+
+  // Skip over BOF, stop before EOF
+  TokenSpan body(tokens.begin + 1, tokens.end - 1);
+
+  // The translation unit is a list of items and stops matching at the first
+  // one that can't be allocated, so running out of bytes would otherwise look
+  // like a good parse of a shorter file.
+  auto tail = NodeTranslationUnit::match(*this, body);
+  bool ok = tail.is_valid() && !alloc.over_limit;
+  parse_complete = ok && tail.is_empty();
+  return ok;
+}
+
+//------------------------------------------------------------------------------
+// Parallel parsing
+//
+// A quick scan over the tokens finds where top-level declarations end and
+// guesses which file-scope types each one declares. We cut the file into runs
+// at declaration boundaries, and parse each run in its own context with the
+// types declared before it already bound.
+//
+// The scan doesn't really parse, so its guesses can be wrong. Afterwards we
+// walk the runs in order, comparing the types each run was parsed with to the
+// types the runs before it actually declared, and reparse any run that saw
+// the wrong ones. The parser only depends on which types are visible, so a
+// run that saw the right types and consumed all its tokens parsed exactly as
+// it would have in parse(). If a run doesn't parse on its own, the cut wasn't
+// a real declaration boundary and we parse the whole file serially.
+
+namespace {
+
+struct FileType {
+  TextSpan name;
+  uint32_t id;
+  CScope::Kind kind;
+};
+
+struct Run {
+  TokenSpan tokens;
+  size_t type_count; // Number of scanned types declared before the run
+};
+
+bool is_punct(const CToken& t, char c) {
+  return t.type == LEX_PUNCT && t.text().len() == 1 && t.text().begin[0] == c;
+}
+
+// "class" isn't a C keyword, so class tags aren't scanned.
+bool tag_kind(const CToken& t, CScope::Kind& kind) {
+  if (t.type != LEX_KEYWORD) return false;
+  switch (t.id) {
+    case keyword_id("struct"): kind = CScope::STRUCT; return true;
+    case keyword_id("union"):  kind = CScope::UNION;  return true;
+    case keyword_id("enum"):   kind = CScope::ENUM;   return true;
+  }
+  return false;
+}
+
+// Guesses where top-level items end from the brackets alone: at a semicolon
+// or preprocessor line outside any brackets, or at the closing brace of a
+// function body. Fed one token at a time, so the whole file doesn't have to
+// be lexed first.
+struct ItemScan {
+  int depth = 0;
+  bool in_function = false;
+  bool ended_function = false; // Whether the last item to end was a function
+
+  // A copy, as the lexer may have dropped or moved it.
+  CToken prev = CToken(LEX_BOF, TextSpan());
+
+  // True if 't' probably ends a top-level item. 'next' is the token after it,
+  // if that's been lexed yet.
+  bool ends_item(const CToken& t, const CToken* next) {
+    auto p = prev;
+    prev = t;
+
+    if (t.type == LEX_PREPROC) return end(depth == 0);
+    if (t.type != LEX_PUNCT || t.text().len() != 1) return false;
+
+    switch (t.text().begin[0]) {
+      case '{':
+        // A brace after a parameter list (or a K&R parameter declaration)
+        // opens a function body.
+        if (depth == 0 && (is_punct(p, ')') || is_punct(p, ';'))) in_function = true;
+        depth++;
+        return false;
+      case '(':
+      case '[':
+        depth++;
+        return false;
+      case ')':
+      case ']':
+        depth--;
+        return false;
+      case '}':
+        depth--;
+        return end(depth == 0 && in_function);
+      case ';':
+        // K&R parameter declarations end with a semicolon but are
+        // followed by the function body.
+        return end(depth == 0 && !(next && is_punct(*next, '{')));
+    }
+    return false;
+  }
+
+  bool end(bool ends) {
+    if (ends) {
+      ended_function = in_function;
+      in_function = false;
+    }
+    return ends;
+  }
+};
+
+struct FileScan {
+  std::vector<FileType> types;
+  std::vector<uint8_t>  is_typedef; // Indexed by id
+
+  void add(const CToken& t, CScope::Kind kind) {
+    types.push_back({t.text(), t.id, kind});
+    if (kind == CScope::TYPEDEF) {
+      if (t.id >= is_typedef.size()) is_typedef.resize(t.id + 1, 0);
+      is_typedef[t.id] = 1;
+    }
+  }
+
+  bool known_typedef(const CToken& t) {
+    if (t.id < is_typedef.size() && is_typedef[t.id]) return true;
+    return SST<builtin_type_base>::match(t.text().begin, t.text().end) ||
+           SST<builtin_type_prefix>::match(t.text().begin, t.text().end) ||
+           SST<builtin_type_suffix>::match(t.text().begin, t.text().end);
+  }
+
+  // Struct, union, enum and class tags are declared at file scope wherever
+  // they appear in a declaration, except inside parameter lists.
+  void scan_tags(const CToken* a, const CToken* b) {
+    int parens = 0;
+    CScope::Kind kind;
+    for (auto t = a; t < b; t++) {
+      if (is_punct(*t, '(')) parens++;
+      if (is_punct(*t, ')')) parens--;
+      if (parens == 0 && t + 1 < b && tag_kind(*t, kind) && t[1].type == LEX_IDENTIFIER) {
+        add(t[1], kind);
+      }
+    }
+  }
 
-  for (auto t = lexemes.begin; t < lexemes.end; t++) {
-    if (!t->is_gap()) {
-      tokens.push_back(*t);
+  // A typedef declares the identifier at the top level of each of its
+  // declarators - "typedef int (*f)(int)" doesn't declare a type.
+  void scan_typedef(const CToken* a, const CToken* b) {
+    int depth = 0;
+    bool found = false;
+    CScope::Kind kind;
+    for (auto t = a; t < b; t++) {
+      if (is_punct(*t, '(') || is_punct(*t, '[') || is_punct(*t, '{')) depth++;
+      if (is_punct(*t, ')') || is_punct(*t, ']') || is_punct(*t, '}')) depth--;
+      if (depth) continue;
+
+      if (is_punct(*t, ',')) {
+        found = false;
+      }
+      else if (tag_kind(*t, kind)) {
+        if (t + 1 < b && t[1].type == LEX_IDENTIFIER) t++;
+      }
+      else if (!found && t->type == LEX_IDENTIFIER && !known_typedef(*t)) {
+        add(*t, CScope::TYPEDEF);
+        found = true;
+      }
     }
   }
 
+  void scan_decl(const CToken* a, const CToken* b) {
+    scan_tags(a, b);
+
+    int depth = 0;
+    for (auto t = a; t < b; t++) {
+      if (is_punct(*t, '(') || is_punct(*t, '[') || is_punct(*t, '{')) depth++;
+      if (is_punct(*t, ')') || is_punct(*t, ']') || is_punct(*t, '}')) depth--;
+      if (depth == 0 && t->is_keyword(keyword_id("typedef"))) {
+        scan_typedef(a, b);
+        return;
+      }
+    }
+  }
+
+  // Splits 'body' into at most 'count' runs of about the same size.
+  std::vector<Run> split(TokenSpan body, int count) {
+    std::vector<Run> runs;
+    size_t total = body.end - body.begin;
+    auto run_begin = body.begin;
+    auto decl_begin = body.begin;
+    size_t run_types = 0;
+    ItemScan scan;
+
+    for (auto t = body.begin; t < body.end; t++) {
+      auto next = t + 1 < body.end ? t + 1 : nullptr;
+      if (!scan.ends_item(*t, next)) continue;
+
+      auto end = t + 1;
+      if (t->type == LEX_PREPROC) {
+        NodePreproc::visit_typedefs(t->text(), [&](const char* name) {
+          auto text = utils::to_span(name);
+          types.push_back({text, CInterner::builtins().find(text), CScope::TYPEDEF});
+        });
+      }
+      if (!scan.ended_function) scan_decl(decl_begin, end);
+      decl_begin = end;
+
+      size_t target = total * (runs.size() + 1) / count;
+      if (size_t(end - body.begin) >= target && end < body.end) {
+        runs.push_back({TokenSpan(run_begin, end), run_types});
+        run_begin = end;
+        run_types = types.size();
+      }
+    }
+
+    runs.push_back({TokenSpan(run_begin, body.end), run_types});
+    return runs;
+  }
+};
+
+// Parses 'run' in a fresh context that starts out with 'types' declared.
+// 'seeded' gets the number of bindings the types took up.
+bool parse_run(CContext& ctx, TextSpan text, TokenSpan run,
+               const FileType* types, size_t count, size_t& seeded) {
+  ctx.reset();
+  ctx.text_span = text;
+  for (size_t i = 0; i < count; i++) {
+    ctx.types.bind(ctx, types[i].name, types[i].id, types[i].kind);
+  }
+  seeded = ctx.types.bindings.size();
+
+  auto tail = NodeTranslationUnit::match(ctx, run);
+  return tail.is_valid() && tail.is_empty() && !ctx.alloc.over_limit;
+}
+
+// The set of types, ignoring order and repeats.
+std::vector<uint64_t> type_set(const FileType* types, size_t count) {
+  std::vector<uint64_t> result;
+  for (size_t i = 0; i < count; i++) {
+    result.push_back((uint64_t(types[i].id) << 8) | types[i].kind);
+  }
+  std::sort(result.begin(), result.end());
+  result.erase(std::unique(result.begin(), result.end()), result.end());
+  return result;
+}
+
+} // namespace
+
+bool CContext::parse_parallel(TextSpan text, TokenSpan tokens, int threads) {
+  this->text_span = text;
+  this->tokens = tokens;
+
   // Skip over BOF, stop before EOF
-  auto tok_a = tokens.data() + 1;
-  auto tok_b = tokens.data() + tokens.size() - 1;
-  TokenSpan body(tok_a, tok_b);
+  TokenSpan body(tokens.begin + 1, tokens.end - 1);
 
-  auto tail = NodeTranslationUnit::match(*this, body);
-  return tail.is_valid();
+  FileScan scan;
+  auto runs = scan.split(body, threads);
+
+  auto serial = [&]() {
+    reset();
+    return parse(text, tokens);
+  };
+  if (runs.size() < 2) return serial();
+
+  while (run_contexts.size() < runs.size()) {
+    run_contexts.push_back(std::make_unique<CContext>());
+  }
+  for (auto& c : run_contexts) {
+    c->outline = outline;
+    c->alloc.byte_limit = alloc.byte_limit;
+  }
+
+  std::vector<char> parsed(runs.size(), false);
+  std::vector<size_t> seeded(runs.size(), 0);
+  auto parse_one = [&](size_t i) {
+    parsed[i] = parse_run(*run_contexts[i], text, runs[i].tokens,
+                          scan.types.data(), runs[i].type_count, seeded[i]);
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < runs.size(); i++) workers.emplace_back(parse_one, i);
+  parse_one(0);
+  for (auto& w : workers) w.join();
+
+  // Check the runs in order against the types that were really declared
+  // before them, collecting the types each one declares.
+  std::vector<FileType> declared;
+  for (size_t i = 0; i < runs.size(); i++) {
+    auto& ctx = *run_contexts[i];
+
+    if (type_set(scan.types.data(), runs[i].type_count) !=
+        type_set(declared.data(), declared.size())) {
+      parsed[i] = parse_run(ctx, text, runs[i].tokens,
+                            declared.data(), declared.size(), seeded[i]);
+    }
+    if (!parsed[i]) return serial();
+
+    auto& bindings = ctx.types.bindings;
+    for (size_t j = seeded[i]; j < bindings.size(); j++) {
+      auto& b = bindings[j];
+      if (b.scope == 0) declared.push_back({b.name, b.id, CScope::Kind(b.kind)});
+    }
+  }
+
+  // The byte limit is for the whole tree, not each run. Past it, the serial
+  // parse fails the same way it would have without the runs.
+  size_t run_bytes = 0;
+  for (size_t i = 0; i < runs.size(); i++) run_bytes += run_contexts[i]->alloc.used_bytes;
+  if (run_bytes > alloc.byte_limit) return serial();
+
+  // Stitch the runs' trees together and declare their types here, so that
+  // the context looks like parse() built it.
+  for (auto& b : declared) types.bind(*this, b.name, b.id, b.kind);
+
+  for (size_t i = 0; i < runs.size(); i++) {
+    auto& ctx = *run_contexts[i];
+    if (!ctx.top_head) continue;
+    if (top_tail) {
+      top_tail->node_next = ctx.top_head;
+      ctx.top_head->node_prev = top_tail;
+    }
+    else {
+      top_head = ctx.top_head;
+    }
+    top_tail = ctx.top_tail;
+  }
+
+  parse_complete = true;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Streaming parsing
+//
+// The lexer runs just ahead of the parser. We pull tokens up to where the
+// next top-level item probably ends - ItemScan's guess, the same one that
+// parse_parallel() cuts runs at - and match one item against them. If the
+// match fails, the guess was too short, so we rewind, pull up to the next
+// likely end and try again. Once an item matches nothing can rewind past it,
+// so its nodes are handed to the caller and thrown away, and its tokens are
+// dropped from the lexer.
+
+namespace {
+
+// Pulls tokens until one of them probably ends an item, or the lexer is done.
+// The token after the last one hasn't been lexed yet, so a K&R parameter
+// declaration looks like the end of an item and the match just fails.
+void pull_item(CLexer& lexer, ItemScan& scan) {
+  while (!lexer.done()) {
+    lexer.pull();
+    if (!lexer.done() && scan.ends_item(lexer.tokens.back(), nullptr)) return;
+  }
 }
 
-/*
-bool CContext::parse(std::vector<CToken>& lexemes) {
+} // namespace
 
-  for (auto& t : lexemes) {
-    if (!t.is_gap()) {
-      tokens.push_back(t);
+bool CContext::parse_stream(TextSpan text, CLexer& lexer, const std::function<void(CNode*)>& visit) {
+  this->text_span = text;
+  parse_complete = false;
+
+  lexer.reset();
+  lexer.start(text);
+
+  ItemScan scan;
+  size_t begin = 1; // The next item's first token, after BOF
+  size_t bindings_at_compact = 0;
+
+  while (true) {
+    pull_item(lexer, scan);
+
+    while (true) {
+      auto& all = lexer.tokens;
+      tokens = TokenSpan(all.data(), all.data() + all.size());
+
+      // Stop before EOF, or the token that didn't lex
+      TokenSpan body(tokens.begin + begin, tokens.end - (lexer.done() ? 1 : 0));
+      if (body.is_empty()) break;
+
+      auto bookmark = checkpoint();
+      auto tail = NodeTranslationUnit::item::match(*this, body);
+      if (!tail.is_valid()) {
+        rewind(bookmark);
+        // One item that won't fit under the byte limit won't fit with more
+        // tokens either.
+        if (alloc.over_limit) {
+          tokens = TokenSpan();
+          return false;
+        }
+        if (lexer.done()) {
+          tokens = TokenSpan();
+          return lexer.tokens.back().type == LEX_EOF;
+        }
+        break;
+      }
+
+      for (auto node = top_head; node; node = node->node_next) visit(node);
+
+      // That's our low-water mark - drop the tree and everything before it,
+      // but keep the types it declared.
+      NodeContext::reset();
+      begin = tail.begin - tokens.begin;
+      lexer.discard(begin);
+      begin = 0;
+
+      // Closed scopes pile up in 'types' until we clean them out.
+      if (types.bindings.size() > 2 * bindings_at_compact + 4096) {
+        types.compact();
+        bindings_at_compact = types.bindings.size();
+      }
     }
+
+    if (lexer.done()) break;
+  }
+
+  tokens = TokenSpan();
+  parse_complete = true;
+  return lexer.tokens.back().type == LEX_EOF;
+}
+
+//------------------------------------------------------------------------------
+// A rematched declaration must not add file-scope types - later declarations
+// were parsed without them, so we'd have to reparse everything after it.
+
+template<typename pattern>
+static TokenSpan match_without_new_types(CContext& ctx, TokenSpan body) {
+  auto bookmark = ctx.checkpoint();
+  auto mark = ctx.types.mark();
+  auto tail = pattern::match(ctx, body);
+  if (ctx.types.mark() != mark) {
+    ctx.rewind(bookmark);
+    return body.fail();
+  }
+  return tail;
+}
+
+using restart_toplevel = NodeTranslationUnit::item;
+using restart_func_body = Capture<"func_body", NodeStatementCompound, CNode>;
+
+bool CContext::reparse(TextSpan new_text, TokenSpan new_tokens, const parseroni::SpanEdit& text_edit) {
+  if (!parse_complete) {
+    reset();
+    return parse(new_text, new_tokens);
   }
 
+  // Tokens before and after the edit are unchanged if they have the same
+  // type and the same position relative to the edit. Tokens that touch the
+  // edit can change length, which this also catches.
+  auto old_text = text_span;
+  auto same_token = [&](const CToken& a, const CToken& b, int64_t delta) {
+    return a.type == b.type &&
+           a.text().len() == b.text().len() &&
+           (a.text().begin - old_text.begin) + delta == (b.text().begin - new_text.begin);
+  };
+
+  int64_t old_count = tokens.len();
+  int64_t new_count = new_tokens.len();
+
+  int64_t prefix = 0;
+  while (prefix < old_count && prefix < new_count) {
+    auto& a = tokens.begin[prefix];
+    if (a.text().end - old_text.begin > text_edit.begin) break;
+    if (!same_token(a, new_tokens.begin[prefix], 0)) break;
+    prefix++;
+  }
+
+  int64_t suffix = 0;
+  while (suffix < old_count - prefix && suffix < new_count - prefix) {
+    auto& a = tokens.begin[old_count - 1 - suffix];
+    if (a.text().begin - old_text.begin < text_edit.old_end) break;
+    if (!same_token(a, new_tokens.begin[new_count - 1 - suffix], text_edit.delta())) break;
+    suffix++;
+  }
+
+  parseroni::SpanEdit token_edit = {prefix, old_count - suffix, new_count - suffix};
+
+  // Top-level declarations and the bodies of top-level functions are parsed
+  // with only file-scope types visible, so they can be restarted as long as
+  // we hide the types declared after them.
+  bool has_builtin_types = types.has_types_outside(old_text);
+
+  auto restart = [&](CNode* node) -> matcher_function<CContext, CToken> {
+    bool is_toplevel = node->node_parent == nullptr;
+    bool is_func_body = node->tag_is("func_body") && !node->node_parent->node_parent;
+    if (!is_toplevel && !is_func_body) return nullptr;
+    if (node->tag_is("preproc")) return nullptr;
+
+    auto node_text = node->as_text_span();
+    if (types.has_types_in(node_text)) return nullptr;
+
+    if (has_builtin_types && has_preproc_after(node)) return nullptr;
+
+    scope_horizon = node_text.begin;
+    if (is_toplevel) return match_without_new_types<restart_toplevel>;
+    return match_without_new_types<restart_func_body>;
+  };
+
   // Skip over BOF, stop before EOF
-  auto tok_a = tokens.data() + 1;
-  auto tok_b = tokens.data() + tokens.size() - 1;
-  TokenSpan body(tok_a, tok_b);
+  TokenSpan old_span(tokens.begin, tokens.end - 1);
+  TokenSpan new_span(new_tokens.begin, new_tokens.end - 1);
 
-  auto tail = NodeTranslationUnit::match(*this, body);
-  return tail.is_valid();
+  auto new_node = parseroni::reparse(*this, old_span, new_span, token_edit, restart);
+  scope_horizon = nullptr;
+
+  if (!new_node || alloc.over_limit) {
+    reset();
+    return parse(new_text, new_tokens);
+  }
+
+  types.rebase(old_text, new_text.begin, text_edit);
+  tokens = new_tokens;
+  preproc_end = -1;
+  text_span = new_text;
+  return true;
+}
+
+// Builtin typedefs come from #includes and have no position in the file, so
+// scope_horizon can't hide the ones from #includes after 'node'.
+
+bool CContext::has_preproc_after(CNode* node) {
+  if (preproc_end < 0) {
+    preproc_end = 0;
+    for (auto t = tokens.end - 1; t >= tokens.begin; t--) {
+      if (t->type == LEX_PREPROC) {
+        preproc_end = t + 1 - tokens.begin;
+        break;
+      }
+    }
+  }
+  return node->span.end - tokens.begin < preproc_end;
+}
+
+//------------------------------------------------------------------------------
+// Skipped nodes don't declare file-scope types, so the types visible at the
+// node are the ones declared before it.
+
+using expand_body = Capture<"func_body", NodeStatementCompound, CNode>;
+using expand_init = CaptureInitList<"initializer", NodeInitializerList>;
+
+CNode* CContext::expand(CNode* node) {
+  matcher_function<CContext, CToken> rule = nullptr;
+  if (node->tag_is("skipped_body")) rule = expand_body::match;
+  if (node->tag_is("skipped_init")) rule = expand_init::match<CContext, CToken>;
+  if (!rule) return nullptr;
+
+  if (has_preproc_after(node) && types.has_types_outside(text_span)) return nullptr;
+
+  // Rematch with the node list temporarily emptied, so a successful match
+  // leaves exactly one node on it.
+  auto old_head = top_head;
+  auto old_tail = top_tail;
+  top_head = nullptr;
+  top_tail = nullptr;
+
+  auto old_outline = outline;
+  outline = false;
+  scope_horizon = node->as_text_span().begin;
+
+  auto bookmark = checkpoint();
+  auto tail = rule(*this, TokenSpan(node->span.begin, tokens.end - 1));
+  auto new_node = top_head;
+  bool ok = tail.is_valid() && tail.begin == node->span.end && new_node && new_node == top_tail;
+  if (!ok && bookmark != checkpoint()) rewind(bookmark);
+
+  scope_horizon = nullptr;
+  outline = old_outline;
+  top_head = old_head;
+  top_tail = old_tail;
+
+  if (!ok) return nullptr;
+  replace(node, new_node);
+  return new_node;
 }
-*/
 
 //------------------------------------------------------------------------------
 
 TokenSpan CContext::match_class_type(TokenSpan body) {
-  return type_scope->has_class_type(*this, body) ? body.advance(1) : body.fail();
+  return types.has_type(*this, body, CScope::CLASS) ? body.advance(1) : body.fail();
 }
 
 TokenSpan CContext::match_struct_type(TokenSpan body) {
-  return type_scope->has_struct_type(*this, body) ? body.advance(1) : body.fail();
+  return types.has_type(*this, body, CScope::STRUCT) ? body.advance(1) : body.fail();
 }
 
 TokenSpan CContext::match_union_type(TokenSpan body) {
-  return type_scope->has_union_type(*this, body) ? body.advance(1) : body.fail();
+  return types.has_type(*this, body, CScope::UNION) ? body.advance(1) : body.fail();
 }
 
 TokenSpan CContext::match_enum_type(TokenSpan body) {
-  return type_scope->has_enum_type(*this, body) ? body.advance(1) : body.fail();
+  return types.has_type(*this, body, CScope::ENUM) ? body.advance(1) : body.fail();
 }
 
 TokenSpan CContext::match_typedef_type(TokenSpan body) {
-  return type_scope->has_typedef_type(*this, body) ? body.advance(1) : body.fail();
+  return types.has_type(*this, body, CScope::TYPEDEF) ? body.advance(1) : body.fail();
 }
 
-void CContext::add_class_type  (const CToken* a) { type_scope->add_class_type(*this, a); }
-void CContext::add_struct_type (const CToken* a) { type_scope->add_struct_type(*this, a); }
-void CContext::add_union_type  (const CToken* a) { type_scope->add_union_type(*this, a); }
-void CContext::add_enum_type   (const CToken* a) { type_scope->add_enum_type(*this, a); }
-void CContext::add_typedef_type(const CToken* a) { type_scope->add_typedef_type(*this, a); }
+void CContext::add_class_type  (const CToken* a) { types.add_type(*this, a, CScope::CLASS); }
+void CContext::add_struct_type (const CToken* a) { types.add_type(*this, a, CScope::STRUCT); }
+void CContext::add_union_type  (const CToken* a) { types.add_type(*this, a, CScope::UNION); }
+void CContext::add_enum_type   (const CToken* a) { types.add_type(*this, a, CScope::ENUM); }
+void CContext::add_typedef_type(const CToken* a) { types.add_type(*this, a, CScope::TYPEDEF); }
 
 //----------------------------------------------------------------------------
 
-void CContext::push_scope() {
-  CScope* new_scope = new CScope();
-  new_scope->parent = type_scope;
-  type_scope = new_scope;
-}
-
-void CContext::pop_scope() {
-  CScope* old_scope = type_scope->parent;
-  if (old_scope) {
-    delete type_scope;
-    type_scope = old_scope;
-  }
-}
+void CContext::push_scope() { types.push(*this); }
+void CContext::pop_scope()  { types.pop(*this); }
 
 //----------------------------------------------------------------------------
 
 TokenSpan CContext::match_builtin_type_base(TokenSpan body) {
   if (!body.is_valid() || body.is_empty()) return body.fail();
-  if (SST<builtin_type_base>::match(body.begin->text.begin, body.begin->text.end)) {
+  if (SST<builtin_type_base>::match(body.begin->text().begin, body.begin->text().end)) {
     return body.advance(1);
   }
   else {
@@ -122,7 +654,7 @@ TokenSpan CContext::match_builtin_type_base(TokenSpan body) {
 
 TokenSpan CContext::match_builtin_type_prefix(TokenSpan body) {
   if (!body.is_valid() || body.is_empty()) return body.fail();
-  if (SST<builtin_type_prefix>::match(body.begin->text.begin, body.begin->text.end)) {
+  if (SST<builtin_type_prefix>::match(body.begin->text().begin, body.begin->text().end)) {
     return body.advance(1);
   }
   else {
@@ -132,7 +664,7 @@ TokenSpan CContext::match_builtin_type_prefix(TokenSpan body) {
 
 TokenSpan CContext::match_builtin_type_suffix(TokenSpan body) {
   if (!body.is_valid() || body.is_empty()) return body.fail();
-  if (SST<builtin_type_suffix>::match(body.begin->text.begin, body.begin->text.end)) {
+  if (SST<builtin_type_suffix>::match(body.begin->text().begin, body.begin->text().end)) {
     return body.advance(1);
   }
   else {
@@ -8,6 +8,8 @@
 #include "matcheroni/Utilities.hpp"
 
 #include <array>
+#include <functional>
+#include <memory>
 #include <stdio.h>
 #include <string>
 #include <vector>
@@ -46,17 +48,45 @@ class CContext : public parseroni::NodeContext<CNode> {
   }
 
   static int atom_cmp(const CToken& a, const char& b) {
-    if (auto d = a.text.len() - 1) return d;
-    return a.text.begin[0] - b;
+    if (auto d = a.text().len() - 1) return d;
+    return a.text().begin[0] - b;
   }
 
   static int atom_cmp(const CToken& a, const matcheroni::TextSpan& b) {
-    return strcmp_span(a.text, b);
+    return strcmp_span(a.text(), b);
   }
 
   void reset();
-  //bool parse(std::vector<CToken>& lexemes);
-  bool parse(matcheroni::TextSpan text, TokenSpan lexemes);
+  // 'tokens' are the lexer's tokens without trivia, from BOF to EOF. They're
+  // used in place, so they have to outlive the tree. Returns false if the
+  // tree would take more than alloc.byte_limit bytes.
+  bool parse(matcheroni::TextSpan text, TokenSpan tokens);
+
+  // Builds the same tree as parse(), but splits the file into runs of
+  // top-level declarations and parses them on up to 'threads' threads. Falls
+  // back to parse() if a run can't be parsed on its own.
+  bool parse_parallel(matcheroni::TextSpan text, TokenSpan tokens, int threads);
+
+  // Parses 'text' while 'lexer' lexes it, one top-level item at a time. Each
+  // item's nodes go to 'visit' and are then thrown away, along with the
+  // item's tokens, so memory depends on the size of the largest item rather
+  // than the size of the file. Types declared by earlier items stay visible.
+  // Returns false if the text doesn't lex, or if one item's tree would take
+  // more than alloc.byte_limit bytes.
+  bool parse_stream(matcheroni::TextSpan text, CLexer& lexer,
+                    const std::function<void(CNode*)>& visit);
+
+  // Brings the tree from the last parse() up to date after an edit to its
+  // text, given the new text and its tokens. Only the top-level declaration
+  // or function body containing the edit is reparsed when possible. The old
+  // tokens have to stay valid until this returns.
+  bool reparse(matcheroni::TextSpan new_text, TokenSpan new_tokens,
+               const parseroni::SpanEdit& text_edit);
+
+  // Parses a "skipped_body" or "skipped_init" node from an outline parse and
+  // puts the result in its place. Returns the new node, or nullptr if the
+  // node can't be expanded.
+  CNode* expand(CNode* node);
 
   TokenSpan match_builtin_type_base  (TokenSpan body);
   TokenSpan match_builtin_type_prefix(TokenSpan body);
@@ -80,6 +110,8 @@ class CContext : public parseroni::NodeContext<CNode> {
   void append_node(CNode* node);
   void enclose_nodes(CNode* start, CNode* node);
 
+  bool has_preproc_after(CNode* node);
+
   void debug_dump(std::string& out) {
     for (auto node = top_head; node; node = node->node_next) {
       node->debug_dump(out);
@@ -89,10 +121,28 @@ class CContext : public parseroni::NodeContext<CNode> {
   //----------------------------------------
 
   matcheroni::TextSpan text_span;
-  TokenSpan  lexemes;
+  TokenSpan tokens;
+
+  // One past the last preprocessor directive in 'tokens', found on first use.
+  int64_t preproc_end = -1;
+  CScope types;
+
+  // parse_parallel() parses each run in its own context, and the tree's nodes
+  // stay in those contexts' arenas.
+  std::vector<std::unique_ptr<CContext>> run_contexts;
+
+  // In outline mode, the bodies of functions and the initializer lists of
+  // declarations at file scope aren't parsed - each is captured as a single
+  // "skipped_body" or "skipped_init" node, which expand() can fill in later.
+  // Types declared inside them aren't seen.
+  bool outline = false;
+
+  // True if the last parse consumed all the tokens.
+  bool parse_complete = false;
 
-  std::vector<CToken> tokens;
-  CScope* type_scope;
+  // File-scope types declared at or after this point are ignored while
+  // reparsing.
+  const char* scope_horizon = nullptr;
 };
 
 //------------------------------------------------------------------------------
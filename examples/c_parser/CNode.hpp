@@ -19,7 +19,7 @@ struct CNode : public parseroni::NodeBase<CNode, CToken> {
   using SpanType = matcheroni::Span<CToken>;
 
   matcheroni::TextSpan as_text_span() const {
-    return matcheroni::TextSpan(span.begin->text.begin, (span.end - 1)->text.end);
+    return matcheroni::TextSpan(span.begin->text().begin, (span.end - 1)->text().end);
   }
 
   void debug_dump(std::string& out) {
@@ -33,7 +33,7 @@ struct CNode : public parseroni::NodeBase<CNode, CToken> {
     }
     else {
       out += '`';
-      out += std::string(span.begin->text.begin, (span.end - 1)->text.end);
+      out += std::string(span.begin->text().begin, (span.end - 1)->text().end);
       out += '`';
     }
     out += "]";
@@ -5,70 +5,192 @@
 
 #include "c_constants.hpp"
 #include "CContext.hpp"
+#include "../c_lexer/CInterner.hpp"
 #include "../c_lexer/CToken.hpp"
 
-#include <string_view>
-
 using matcheroni::TextSpan;
 
-using std::string_view;
+//------------------------------------------------------------------------------
+
+CScope::CScope() {
+  scopes.push_back({0, 0});
+}
 
+// Only ids that have bindings can have non-zero heads or kinds, so we don't
+// have to clear the whole table.
 void CScope::clear() {
-  class_types.clear();
-  struct_types.clear();
-  union_types.clear();
-  enum_types.clear();
-  typedef_types.clear();
+  for (const auto& b : bindings) {
+    heads[b.id] = 0;
+    kinds[b.id] = 0;
+  }
+  bindings.clear();
+  scopes.resize(1);
+  scopes[0] = {0, 0};
+  current = 0;
+  root_count = 0;
 }
 
-bool CScope::has_type(CContext& ctx, TokenSpan body, token_list& types) {
+//----------------------------------------
+
+bool CScope::has_type(CContext& ctx, TokenSpan body, Kind kind) const {
   if(ctx.atom_cmp(*body.begin, LEX_IDENTIFIER)) {
     return false;
   }
 
-  TextSpan span(body.begin->text.begin, body.begin->text.end);
+  uint32_t id = body.begin->id;
+  if (id >= kinds.size() || !(kinds[id] & (1 << kind))) return false;
 
-  for (const auto& c : types) {
-    if (strcmp_span(span, c) == 0) return true;
+  for (auto i = heads[id]; i; i = bindings[i - 1].prev) {
+    const auto& b = bindings[i - 1];
+    if (b.kind != kind) continue;
+
+    // While reparsing part of a file, types declared at file scope after the
+    // reparse point don't exist yet.
+    if (b.scope == 0 && ctx.scope_horizon &&
+        b.name.begin >= ctx.scope_horizon && b.name.begin < ctx.text_span.end) continue;
+    return true;
   }
 
   return false;
 }
 
-void CScope::add_type(CContext& ctx, const CToken* a, token_list& types) {
+void CScope::add_type(CContext& ctx, const CToken* a, Kind kind) {
   matcheroni_assert(ctx.atom_cmp(*a, LEX_IDENTIFIER) == 0);
+  bind(ctx, a->text(), a->id, kind);
+}
+
+void CScope::add_builtin_typedef(CContext& ctx, const char* t) {
+  auto name = matcheroni::utils::to_span(t);
+  bind(ctx, name, CInterner::builtins().find(name), TYPEDEF);
+}
+
+//----------------------------------------
+
+void CScope::bind(CContext& ctx, TextSpan name, uint32_t id, Kind kind) {
+  matcheroni_assert(id);
 
-  TextSpan span(a->text.begin, a->text.end);
+  if (id >= heads.size()) {
+    heads.resize(id + 1, 0);
+    kinds.resize(id + 1, 0);
+  }
 
-  for (const auto& c : types) {
-    if (strcmp_span(span, c) == 0) return;
+  // The current scope's bindings are always at the front of the chain.
+  for (auto i = heads[id]; i; i = bindings[i - 1].prev) {
+    const auto& b = bindings[i - 1];
+    if (b.scope != current) break;
+    if (b.kind == kind) return;
   }
 
-  types.push_back(span);
+  uint32_t index = uint32_t(bindings.size()) + 1;
+  bindings.push_back({name, id, kind, current, heads[id], scopes[current].last});
+  heads[id] = index;
+  scopes[current].last = index;
+  kinds[id] |= 1 << kind;
+  if (current == 0) root_count++;
+
+  ctx.log_undo(undo_bind, this);
+}
+
+// Undo entries run in exact reverse order, so the binding being undone is
+// always the last one and at the front of its chain.
+void CScope::undo_bind(void* scope, void*) {
+  auto s = (CScope*)scope;
+  const auto& b = s->bindings.back();
+  s->heads[b.id] = b.prev;
+  s->scopes[b.scope].last = b.prev_in_scope;
+  if (b.scope == 0) s->root_count--;
+  s->bindings.pop_back();
 }
 
 //----------------------------------------
 
-void CScope::add_typedef_type(const char* t) {
-  TextSpan span = matcheroni::utils::to_span(t);
+void CScope::push(CContext& ctx) {
+  scopes.push_back({current, 0});
+  current = uint32_t(scopes.size()) - 1;
+  ctx.log_undo(undo_push, this);
+}
+
+void CScope::undo_push(void* scope, void*) {
+  auto s = (CScope*)scope;
+  s->current = s->scopes.back().parent;
+  s->scopes.pop_back();
+}
 
-  for (const auto& c : typedef_types) {
-    if (strcmp_span(span, c) == 0) return;
+// The innermost scope's bindings are newer than everything else on the
+// chains, so popping it only has to move each chain head back.
+void CScope::pop(CContext& ctx) {
+  if (current == 0) return;
+
+  for (auto i = scopes[current].last; i; i = bindings[i - 1].prev_in_scope) {
+    heads[bindings[i - 1].id] = bindings[i - 1].prev;
   }
 
-  typedef_types.push_back(span);
+  ctx.log_undo(undo_pop, this, (void*)uintptr_t(current));
+  current = scopes[current].parent;
+}
+
+void CScope::undo_pop(void* scope, void* index) {
+  auto s = (CScope*)scope;
+  s->current = uint32_t(uintptr_t(index));
+
+  // Walking newest to oldest, so only move a head forward.
+  for (auto i = s->scopes[s->current].last; i; i = s->bindings[i - 1].prev_in_scope) {
+    auto& head = s->heads[s->bindings[i - 1].id];
+    if (head < i) head = i;
+  }
+}
+
+// With every other scope closed, each chain holds only file-scope bindings
+// and its head is the newest one.
+void CScope::compact() {
+  matcheroni_assert(current == 0);
+
+  std::vector<uint32_t> remap(bindings.size() + 1, 0);
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < bindings.size(); i++) {
+    heads[bindings[i].id] = 0;
+    if (bindings[i].scope == 0) remap[i + 1] = ++count;
+  }
+
+  count = 0;
+  for (uint32_t i = 0; i < bindings.size(); i++) {
+    auto b = bindings[i];
+    if (b.scope != 0) continue;
+    b.prev = remap[b.prev];
+    b.prev_in_scope = remap[b.prev_in_scope];
+    bindings[count++] = b;
+    heads[b.id] = count;
+  }
+  bindings.resize(count);
+
+  scopes.resize(1);
+  scopes[0].last = remap[scopes[0].last];
 }
 
 //----------------------------------------
 
-bool CScope::has_class_type  (CContext& ctx, TokenSpan body) { if (has_type(ctx, body, class_types  )) return true; if (parent) return parent->has_class_type  (ctx, body); else return false; }
-bool CScope::has_struct_type (CContext& ctx, TokenSpan body) { if (has_type(ctx, body, struct_types )) return true; if (parent) return parent->has_struct_type (ctx, body); else return false; }
-bool CScope::has_union_type  (CContext& ctx, TokenSpan body) { if (has_type(ctx, body, union_types  )) return true; if (parent) return parent->has_union_type  (ctx, body); else return false; }
-bool CScope::has_enum_type   (CContext& ctx, TokenSpan body) { if (has_type(ctx, body, enum_types   )) return true; if (parent) return parent->has_enum_type   (ctx, body); else return false; }
-bool CScope::has_typedef_type(CContext& ctx, TokenSpan body) { if (has_type(ctx, body, typedef_types)) return true; if (parent) return parent->has_typedef_type(ctx, body); else return false; }
-
-void CScope::add_class_type  (CContext& ctx, const CToken* a) { return add_type(ctx, a, class_types  ); }
-void CScope::add_struct_type (CContext& ctx, const CToken* a) { return add_type(ctx, a, struct_types ); }
-void CScope::add_union_type  (CContext& ctx, const CToken* a) { return add_type(ctx, a, union_types  ); }
-void CScope::add_enum_type   (CContext& ctx, const CToken* a) { return add_type(ctx, a, enum_types   ); }
-void CScope::add_typedef_type(CContext& ctx, const CToken* a) { return add_type(ctx, a, typedef_types); }
+bool CScope::has_types_in(TextSpan span) const {
+  for (const auto& b : bindings) {
+    if (b.scope == 0 && b.name.begin >= span.begin && b.name.begin < span.end) return true;
+  }
+  return false;
+}
+
+bool CScope::has_types_outside(TextSpan text) const {
+  for (const auto& b : bindings) {
+    if (b.scope == 0 && (b.name.begin < text.begin || b.name.begin >= text.end)) return true;
+  }
+  return false;
+}
+
+void CScope::rebase(TextSpan text, const char* new_base, const parseroni::SpanEdit& edit) {
+  for (auto& b : bindings) {
+    auto& c = b.name;
+    if (c.begin < text.begin || c.begin >= text.end) continue;
+    int64_t offset = c.begin - text.begin;
+    if (offset >= edit.old_end) offset += edit.delta();
+    c = TextSpan(new_base + offset, new_base + offset + (c.end - c.begin));
+  }
+}
+
+//------------------------------------------------------------------------------
@@ -2,45 +2,96 @@
 // SPDX-License-Identifier: MIT License
 
 #pragma once
+#include <stdint.h>
 #include <vector>
 #include <string>
 #include "matcheroni/Matcheroni.hpp"
+#include "matcheroni/Parseroni.hpp"
 
 struct CToken;
 struct CContext;
 typedef matcheroni::Span<CToken> TokenSpan;
 
 //------------------------------------------------------------------------------
+// The type names visible at the current point in the parse, across all open
+// scopes.
+//
+// Every type declaration is a Binding in one array, chained to the previous
+// binding for the same identifier. Identifiers are looked up by their interned
+// id (see CInterner), which indexes straight into the chain heads, so a lookup
+// doesn't depend on how many types are declared. Closing a scope unlinks its
+// bindings from the chains; they stay in the array so that rewinding can link
+// them back in.
+//
+// Every change is logged in the context's undo log, so rewinding the context
+// also takes back types and scopes from a failed match.
 
 struct CScope {
+  enum Kind {
+    CLASS,
+    STRUCT,
+    UNION,
+    ENUM,
+    TYPEDEF,
+  };
 
-  //using token_list = std::vector<const CToken*>;
-  using token_list = std::vector<matcheroni::TextSpan>;
+  struct Binding {
+    matcheroni::TextSpan name;
+    uint32_t id;
+    uint32_t kind;
+    uint32_t scope;
+    uint32_t prev;          // Previous binding for this id, plus one
+    uint32_t prev_in_scope; // Previous binding in this scope, plus one
+  };
 
+  struct Scope {
+    uint32_t parent;
+    uint32_t last; // Last binding in this scope, plus one
+  };
+
+  CScope();
   void clear();
-  bool has_type(CContext& ctx, TokenSpan body, token_list& types);
-  void add_type(CContext& ctx, const CToken* a, token_list& types);
-
-  bool has_class_type  (CContext& ctx, TokenSpan body);
-  bool has_struct_type (CContext& ctx, TokenSpan body);
-  bool has_union_type  (CContext& ctx, TokenSpan body);
-  bool has_enum_type   (CContext& ctx, TokenSpan body);
-  bool has_typedef_type(CContext& ctx, TokenSpan body);
-
-  void add_class_type  (CContext& ctx, const CToken* a);
-  void add_struct_type (CContext& ctx, const CToken* a);
-  void add_union_type  (CContext& ctx, const CToken* a);
-  void add_enum_type   (CContext& ctx, const CToken* a);
-  void add_typedef_type(CContext& ctx, const CToken* a);
-
-  void add_typedef_type(const char* t);
-
-  CScope* parent;
-  token_list class_types;
-  token_list struct_types;
-  token_list union_types;
-  token_list enum_types;
-  token_list typedef_types;
+
+  bool has_type(CContext& ctx, TokenSpan body, Kind kind) const;
+  void add_type(CContext& ctx, const CToken* a, Kind kind);
+  void add_builtin_typedef(CContext& ctx, const char* t);
+
+  void push(CContext& ctx);
+  void pop(CContext& ctx);
+
+  // Throws away closed scopes and their bindings, renumbering the rest. Only
+  // valid at file scope with nothing left to rewind.
+  void compact();
+
+  // Support for incremental reparsing - counting the file-scope types,
+  // checking whether any were declared inside 'span' or came from outside
+  // 'text' (builtin typedefs), and moving the ones in 'text' to a new buffer
+  // after an edit.
+  using Mark = size_t;
+  Mark mark() const { return root_count; }
+  bool has_types_in(matcheroni::TextSpan span) const;
+  bool has_types_outside(matcheroni::TextSpan text) const;
+  void rebase(matcheroni::TextSpan text, const char* new_base, const parseroni::SpanEdit& edit);
+
+  //----------------------------------------
+
+  void bind(CContext& ctx, matcheroni::TextSpan name, uint32_t id, Kind kind);
+  static void undo_bind(void* scope, void*);
+  static void undo_push(void* scope, void*);
+  static void undo_pop(void* scope, void* index);
+
+  std::vector<Binding>  bindings;
+  std::vector<Scope>    scopes;
+  uint32_t              current = 0;
+  size_t                root_count = 0;
+
+  // Chain heads, indexed by id.
+  std::vector<uint32_t> heads;
+
+  // One bit per Kind for every id that has ever had a binding of that kind
+  // since clear(). Most identifiers aren't types, and this rejects them
+  // without touching the chains.
+  std::vector<uint8_t>  kinds;
 };
 
 //------------------------------------------------------------------------------
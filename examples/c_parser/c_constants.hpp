@@ -3,6 +3,7 @@
 
 #pragma once
 #include <array>
+#include <stdint.h>
 
 //------------------------------------------------------------------------------
 // MUST BE SORTED CASE-SENSITIVE
@@ -61,7 +62,7 @@ constexpr std::array c_keywords = {
 //"__builtin_shufflevector",
 "__builtin_tgmath",
 "__builtin_types_compatible_p",
-//"__builtin_va_arg", behaves as a function
+"__builtin_va_arg",
 "__complex",
 "__complex__",
 "__const",
@@ -258,13 +259,89 @@ constexpr std::array c_keywords = {
 "virtual",
 "void",
 "volatile",
-"wchar_t",
+//"wchar_t", a typedef in C
 "while",
 };
 
 //------------------------------------------------------------------------------
 // MUST BE SORTED CASE-SENSITIVE
 
+// The lexer matches these longest-first, so "<<=" is one token. "::" isn't
+// here - in C it's two colons, as in asm("" ::: "memory").
+
+constexpr std::array c_punctuators = {
+  "!",
+  "!=",
+  "#",
+  "##",
+  "%",
+  "%=",
+  "&",
+  "&&",
+  "&=",
+  "(",
+  ")",
+  "*",
+  "*=",
+  "+",
+  "++",
+  "+=",
+  ",",
+  "-",
+  "--",
+  "-=",
+  "->",
+  "->*",
+  ".",
+  ".*",
+  "...",
+  "/",
+  "/=",
+  ":",
+  ";",
+  "<",
+  "<<",
+  "<<=",
+  "<=",
+  "<=>",
+  "=",
+  "==",
+  ">",
+  ">=",
+  ">>",
+  ">>=",
+  "?",
+  "[",
+  "]",
+  "^",
+  "^=",
+  "{",
+  "|",
+  "|=",
+  "||",
+  "}",
+  "~",
+};
+
+//------------------------------------------------------------------------------
+// Keywords and punctuators are identified by their index in the tables above,
+// plus one so that 0 means "not a keyword/punctuator". The lexer puts these in
+// CToken::id, and the parser compares them instead of text.
+
+template <const auto& table>
+consteval uint32_t table_id(const char* text) {
+  for (size_t i = 0; i < table.size(); i++) {
+    if (__builtin_strcmp(table[i], text) == 0) return uint32_t(i + 1);
+  }
+  return 0;
+}
+
+consteval uint32_t keyword_id(const char* text) { return table_id<c_keywords>(text); }
+consteval uint32_t punct_id(const char* text)   { return table_id<c_punctuators>(text); }
+
+//------------------------------------------------------------------------------
+// MUST BE SORTED CASE-SENSITIVE
+
 constexpr std::array builtin_type_base = {
   //"FILE", // used in fprintf.c torture test
   "_Bool",
@@ -272,6 +349,13 @@ constexpr std::array builtin_type_base = {
   "_Decimal128",
   "_Decimal32",
   "_Decimal64",
+  "_Float128",
+  "_Float128x",
+  "_Float16",
+  "_Float32",
+  "_Float32x",
+  "_Float64",
+  "_Float64x",
   "__INT16_TYPE__",
   "__INT32_TYPE__",
   "__INT64_TYPE__",
@@ -436,11 +520,71 @@ constexpr std::array binary_operators = {
   "||",
 };
 
+//------------------------------------------------------------------------------
+// Tokens other than identifiers and literals that can start an expression.
+// MUST BE SORTED CASE-SENSITIVE
+
+constexpr std::array expression_prefixes = {
+  "!",
+  "&",
+  "&&",
+  "(",
+  "*",
+  "+",
+  "++",
+  "-",
+  "--",
+  "__alignof__",
+  "__builtin_offsetof",
+  "__extension__",
+  "__imag",
+  "__imag__",
+  "__real",
+  "__real__",
+  "offsetof",
+  "sizeof",
+  "{",
+  "~",
+};
+
+//------------------------------------------------------------------------------
+// Tokens other than qualifiers that can start a NodeModifier.
+// MUST BE SORTED CASE-SENSITIVE
+
+constexpr std::array modifier_prefixes = {
+  "_Alignas",
+  "__attribute",
+  "__attribute__",
+  "__declspec",
+};
+
+//------------------------------------------------------------------------------
+// Tokens other than identifiers, modifiers and builtin types that can start a
+// declaration or a function definition.
+// MUST BE SORTED CASE-SENSITIVE
+
+constexpr std::array declaration_prefixes = {
+  "(",
+  "*",
+  ":",
+  "_Atomic",
+  "__typeof",
+  "__typeof__",
+  "class",
+  "enum",
+  "struct",
+  "typeof",
+  "union",
+};
+
+//------------------------------------------------------------------------------
+
 constexpr std::array stddef_typedefs = {
   "size_t",
   "ptrdiff_t",
   "nullptr_t",
   "max_align_t",
+  "wchar_t",
   "byte"
 };
 
@@ -492,6 +636,7 @@ constexpr int prefix_precedence(const char* op) {
   if (__builtin_strcmp(op, "~")   == 0) return 3;
   if (__builtin_strcmp(op, "*")   == 0) return 3;
   if (__builtin_strcmp(op, "&")   == 0) return 3;
+  if (__builtin_strcmp(op, "&&")  == 0) return 3;
 
   // 2 type(a) type{a}
   // 3 (type)a sizeof a sizeof(a) co_await a
@@ -511,6 +656,7 @@ constexpr int prefix_assoc(const char* op) {
   if (__builtin_strcmp(op, "~")   == 0) return -2;
   if (__builtin_strcmp(op, "*")   == 0) return -2;
   if (__builtin_strcmp(op, "&")   == 0) return -2;
+  if (__builtin_strcmp(op, "&&")  == 0) return -2;
 
   // 2 type(a) type{a}
   // 3 (type)a sizeof a sizeof(a) co_await a
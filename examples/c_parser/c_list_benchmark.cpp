@@ -0,0 +1,145 @@
+// SPDX-FileCopyrightText:  2023 Austin Appleby <aappleby@gmail.com>
+// SPDX-License-Identifier: MIT License
+
+// Measures parsing long C initializer lists, which are captured with an item
+// array, and indexed access into them compared to walking the child list.
+// Uses a generated source file unless one is given on the command line.
+
+#include "matcheroni/Utilities.hpp"
+
+#include "../c_lexer/CLexer.hpp"
+#include "CContext.hpp"
+#include "CNode.hpp"
+
+#include <algorithm>
+
+using namespace matcheroni;
+using namespace parseroni;
+
+const int reps = 20;
+const int probes = 16;
+
+//------------------------------------------------------------------------------
+
+std::string make_source(int count) {
+  std::string source;
+  char buf[256];
+
+  source += "static const int table[] = {\n";
+  for (int i = 0; i < count; i++) {
+    snprintf(buf, sizeof(buf), "  %d,\n", (i * 7919) % 65536);
+    source += buf;
+  }
+  source += "};\n\n";
+
+  source += "struct point { int x; int y; };\n";
+  source += "static struct point points[] = {\n";
+  for (int i = 0; i < count / 4; i++) {
+    snprintf(buf, sizeof(buf), "  { .x = %d, .y = %d },\n", i, -i);
+    source += buf;
+  }
+  source += "};\n";
+
+  return source;
+}
+
+void find_lists(CNode* node, std::vector<CNode*>& out) {
+  for (auto c = node; c; c = c->node_next) {
+    if (c->has_items()) out.push_back(c);
+    find_lists(c->child_head, out);
+  }
+}
+
+CNode* walk_to(CNode* node, size_t index) {
+  auto c = node->child_head;
+  for (; c && index; index--) c = c->node_next;
+  return c;
+}
+
+double median(std::vector<double>& times) {
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+  printf("Matcheroni C initializer list benchmark\n");
+
+  std::string source = argc > 1 ? utils::read(argv[1]) : make_source(100000);
+  TextSpan text = utils::to_span(source);
+
+  CLexer lexer;
+  lexer.lex(text);
+  CContext ctx;
+
+  std::vector<double> parse_times;
+  for (int rep = 0; rep < reps; rep++) {
+    double time = -utils::timestamp_ms();
+    ctx.reset();
+    ctx.parse(text, utils::to_span(lexer.tokens));
+    time += utils::timestamp_ms();
+    parse_times.push_back(time);
+  }
+
+  if (!ctx.parse_complete) {
+    printf("Could not parse all of the source\n");
+    return -1;
+  }
+
+  std::vector<CNode*> lists;
+  find_lists(ctx.top_head, lists);
+
+  size_t item_total = 0;
+  size_t item_max = 0;
+  for (auto l : lists) {
+    item_total += l->item_count();
+    item_max = std::max(item_max, l->item_count());
+  }
+
+  //----------------------------------------
+  // Look up a spread of indices in every list, both ways.
+
+  uint64_t sum_items = 0;
+  double items_time = -utils::timestamp_ms();
+  for (auto l : lists) {
+    auto count = l->item_count();
+    for (int i = 0; i < probes; i++) {
+      sum_items += uint64_t(l->item(count * i / probes));
+    }
+  }
+  items_time += utils::timestamp_ms();
+
+  uint64_t sum_walk = 0;
+  double walk_time = -utils::timestamp_ms();
+  for (auto l : lists) {
+    auto count = l->item_count();
+    for (int i = 0; i < probes; i++) {
+      sum_walk += uint64_t(walk_to(l, count * i / probes));
+    }
+  }
+  walk_time += utils::timestamp_ms();
+
+  if (sum_items != sum_walk) {
+    printf("Item array doesn't match the child list!\n");
+    return -1;
+  }
+
+  //----------------------------------------
+
+  double lookups = double(lists.size()) * probes;
+
+  printf("\n");
+  printf("Byte total         %d\n", text.len());
+  printf("Tree nodes         %ld\n", ctx.node_count());
+  printf("Lists              %ld\n", lists.size());
+  printf("List items         %ld (longest %ld)\n", item_total, item_max);
+  printf("Parse time         %f msec\n", median(parse_times));
+  printf("Indexed lookup     %f nsec\n", items_time * 1e6 / lookups);
+  printf("Child list lookup  %f nsec\n", walk_time * 1e6 / lookups);
+  printf("\n");
+
+  return 0;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,157 @@
+// SPDX-FileCopyrightText:  2023 Austin Appleby <aappleby@gmail.com>
+// SPDX-License-Identifier: MIT License
+
+// Measures an outline parse, which skips function bodies and initializer
+// lists, against a full parse. Then expands every skipped node and checks
+// that the result matches the full parse. Uses a generated source file
+// unless one is given on the command line.
+
+#include "matcheroni/Utilities.hpp"
+
+#include "../c_lexer/CLexer.hpp"
+#include "CContext.hpp"
+#include "CNode.hpp"
+
+#include <algorithm>
+
+using namespace matcheroni;
+using namespace parseroni;
+
+const int reps = 10;
+
+//------------------------------------------------------------------------------
+
+std::string make_source(int count) {
+  std::string source;
+  char buf[1024];
+
+  for (int i = 0; i < count; i++) {
+    snprintf(buf, sizeof(buf),
+      "typedef struct point_%d { int x; int y; } point_%d;\n"
+      "static const point_%d origin_%d = { .x = %d, .y = %d };\n"
+      "static const char* names_%d[] = { \"{\", \"}\", \"name_%d\", 0 };\n"
+      "\n"
+      "int distance_%d(const point_%d* a, const point_%d* b) {\n"
+      "  point_%d d = { a->x - b->x, a->y - b->y };\n"
+      "  int result = 0;\n"
+      "  for (int i = 0; i < 4; i++) {\n"
+      "    if (d.x < 0) d.x = -d.x; else if (d.y < 0) { d.y = -d.y; }\n"
+      "    result += (d.x * d.x + d.y * d.y) >> i;\n"
+      "    switch (i) { case 0: result ^= '{'; break; default: result += '}'; }\n"
+      "  }\n"
+      "  return result + names_%d[i & 3][0] + origin_%d.x;\n"
+      "}\n\n",
+      i, i,
+      i, i, i, -i,
+      i, i,
+      i, i, i,
+      i,
+      i, i);
+    source += buf;
+  }
+
+  return source;
+}
+
+void find_skipped(CNode* node, std::vector<CNode*>& out) {
+  for (auto c = node; c; c = c->node_next) {
+    if (c->tag_is("skipped_body") || c->tag_is("skipped_init")) out.push_back(c);
+    find_skipped(c->child_head, out);
+  }
+}
+
+// The trees are built on different token arrays, so compare the text they
+// cover.
+bool same_tree(CNode* a, CNode* b) {
+  for (; a && b; a = a->node_next, b = b->node_next) {
+    if (a->span.len() != b->span.len()) return false;
+    if (a->span.len() && a->span.begin->text().begin != b->span.begin->text().begin) return false;
+    if (!a->match_tag != !b->match_tag) return false;
+    if (a->match_tag && strcmp(a->match_tag, b->match_tag)) return false;
+    if (!same_tree(a->child_head, b->child_head)) return false;
+  }
+  return !a && !b;
+}
+
+double median(std::vector<double>& times) {
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+template<typename F>
+double time_parse(CContext& ctx, F parse) {
+  std::vector<double> times;
+  for (int rep = 0; rep < reps; rep++) {
+    double time = -utils::timestamp_ms();
+    ctx.reset();
+    parse();
+    time += utils::timestamp_ms();
+    times.push_back(time);
+  }
+  return median(times);
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+  printf("Matcheroni C outline parse benchmark\n");
+
+  std::string source = argc > 1 ? utils::read(argv[1]) : make_source(20000);
+  TextSpan text = utils::to_span(source);
+
+  CLexer lexer;
+  lexer.lex(text);
+  TokenSpan lexemes = utils::to_span(lexer.tokens);
+
+  CContext full;
+  double full_time = time_parse(full, [&]() { full.parse(text, lexemes); });
+
+  CContext outline;
+  outline.outline = true;
+  double outline_time = time_parse(outline, [&]() { outline.parse(text, lexemes); });
+
+  if (!full.parse_complete || !outline.parse_complete) {
+    printf("Could not parse all of the source\n");
+    return -1;
+  }
+
+  size_t full_nodes = full.node_count();
+  size_t outline_nodes = outline.node_count();
+
+  // Expanding everything allocates as much as a full parse, so it's timed
+  // over fresh outline parses too.
+  std::vector<CNode*> skipped;
+  std::vector<double> expand_times;
+  size_t expand_fail = 0;
+  for (int rep = 0; rep < reps; rep++) {
+    outline.reset();
+    outline.parse(text, lexemes);
+    skipped.clear();
+    find_skipped(outline.top_head, skipped);
+
+    double time = -utils::timestamp_ms();
+    expand_fail = 0;
+    for (auto node : skipped) {
+      if (!outline.expand(node)) expand_fail++;
+    }
+    time += utils::timestamp_ms();
+    expand_times.push_back(time);
+  }
+  double expand_time = median(expand_times);
+
+  bool same = same_tree(full.top_head, outline.top_head);
+
+  printf("\n");
+  printf("Byte total         %d\n", text.len());
+  printf("Full parse         %f msec, %ld nodes\n", full_time, full_nodes);
+  printf("Outline parse      %f msec, %ld nodes (%.2fx faster)\n",
+         outline_time, outline_nodes, full_time / outline_time);
+  printf("Skipped nodes      %ld\n", skipped.size());
+  printf("Expand all         %f msec, %ld failed\n", expand_time, expand_fail);
+  printf("Expanded tree      %s\n", same ? "matches full parse" : "MISMATCH");
+  printf("\n");
+
+  return same && !expand_fail ? 0 : -1;
+}
+
+//------------------------------------------------------------------------------
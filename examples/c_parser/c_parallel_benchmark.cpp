@@ -0,0 +1,141 @@
+// SPDX-FileCopyrightText:  2023 Austin Appleby <aappleby@gmail.com>
+// SPDX-License-Identifier: MIT License
+
+// Measures parsing one large translation unit serially and with
+// CContext::parse_parallel(), and checks that both build the same tree.
+// Uses a generated amalgamation unless a source file is given on the command
+// line.
+
+#include "matcheroni/Utilities.hpp"
+
+#include "../c_lexer/CLexer.hpp"
+#include "CContext.hpp"
+#include "CNode.hpp"
+
+#include <algorithm>
+#include <thread>
+
+using namespace matcheroni;
+using namespace parseroni;
+
+const int reps = 10;
+
+//------------------------------------------------------------------------------
+// Each block's function uses the previous block's typedef, so the parse of
+// every block depends on the types declared before it.
+
+std::string make_source(int count) {
+  std::string source = "#include <stdint.h>\n\n";
+  char buf[1024];
+
+  for (int i = 0; i < count; i++) {
+    int p = i ? i - 1 : 0;
+    snprintf(buf, sizeof(buf),
+      "typedef struct node_%d { int32_t value; struct node_%d* next; } node_%d_t;\n"
+      "enum color_%d { RED_%d, GREEN_%d = 3, BLUE_%d };\n"
+      "static const int table_%d[] = { %d, %d, %d, %d, %d, %d, %d, %d };\n"
+      "\n"
+      "node_%d_t* link_%d(node_%d_t* prev, int x) {\n"
+      "  node_%d_t* n = (node_%d_t*)prev;\n"
+      "  for (int i = 0; i < x; i++) {\n"
+      "    if (i %% 3 == 0) n->value += table_%d[i & 7];\n"
+      "    else x = x * 2 + (int)sizeof(node_%d_t);\n"
+      "  }\n"
+      "  switch (x) { case RED_%d: return n; default: break; }\n"
+      "  return n->next ? (node_%d_t*)n->next : n;\n"
+      "}\n\n",
+      i, i, i,
+      i, i, i, i,
+      i, i, i + 1, i * 3, i * 7, i ^ 5, i % 11, i + 13, i * 17,
+      i, i, p,
+      i, i,
+      i,
+      p,
+      i,
+      i);
+    source += buf;
+  }
+
+  return source;
+}
+
+// The trees are built on different token arrays, so compare the text they
+// cover.
+bool same_tree(CNode* a, CNode* b) {
+  for (; a && b; a = a->node_next, b = b->node_next) {
+    if (a->span.len() != b->span.len()) return false;
+    if (a->span.len() && a->span.begin->text().begin != b->span.begin->text().begin) return false;
+    if (!a->match_tag != !b->match_tag) return false;
+    if (a->match_tag && strcmp(a->match_tag, b->match_tag)) return false;
+    if (!same_tree(a->child_head, b->child_head)) return false;
+  }
+  return !a && !b;
+}
+
+double median(std::vector<double>& times) {
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+  printf("Matcheroni C parallel parse benchmark\n");
+
+  std::string source = argc > 1 ? utils::read(argv[1]) : make_source(20000);
+  TextSpan text = utils::to_span(source);
+
+  CLexer lexer;
+  lexer.lex(text);
+  TokenSpan lexemes = utils::to_span(lexer.tokens);
+
+  CContext serial;
+  std::vector<double> serial_times;
+  for (int rep = 0; rep < reps; rep++) {
+    double time = -utils::timestamp_ms();
+    serial.reset();
+    serial.parse(text, lexemes);
+    time += utils::timestamp_ms();
+    serial_times.push_back(time);
+  }
+
+  if (!serial.parse_complete) {
+    printf("Could not parse all of the source\n");
+    return -1;
+  }
+
+  double serial_time = median(serial_times);
+
+  printf("\n");
+  printf("Byte total         %d\n", text.len());
+  printf("Tree nodes         %ld\n", serial.node_count());
+  printf("Hardware threads   %d\n", std::thread::hardware_concurrency());
+  printf("Serial parse       %f msec\n", serial_time);
+
+  int result = 0;
+  for (int threads : {2, 4, 8}) {
+    CContext parallel;
+    std::vector<double> times;
+    for (int rep = 0; rep < reps; rep++) {
+      double time = -utils::timestamp_ms();
+      parallel.reset();
+      parallel.parse_parallel(text, lexemes, threads);
+      time += utils::timestamp_ms();
+      times.push_back(time);
+    }
+
+    bool same = parallel.parse_complete &&
+                same_tree(serial.top_head, parallel.top_head) &&
+                serial.types.mark() == parallel.types.mark();
+
+    double time = median(times);
+    printf("%d threads          %f msec, %.2fx%s\n", threads, time, serial_time / time,
+           same ? "" : " - TREE MISMATCH");
+    if (!same) result = -1;
+  }
+  printf("\n");
+
+  return result;
+}
+
+//------------------------------------------------------------------------------
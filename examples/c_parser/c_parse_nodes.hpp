@@ -109,51 +109,130 @@ template <typename P>
 using opt_comma_separated = Opt<comma_separated<P>>;
 
 //------------------------------------------------------------------------------
-// Matches string literals as if they were atoms. Does ___NOT___ match the
-// trailing null.
-// You'll need to define atom_cmp(CContext& ctx, atom& a, StringParam<N>& b) to use
-// this.
+// Captures the same thing as Capture<tag, list, CNode> for an initializer list
+// pattern, plus an array of the list's children - initializer lists can be
+// very long. 'list' may not be a complete type yet where this is used.
+
+template <StringParam tag, typename list>
+struct CaptureInitList {
+  template <typename context, typename atom>
+  static Span<atom> match(context& ctx, Span<atom> body) {
+    using pattern = CaptureList<tag, Atom<'{'>, typename list::item, Atom<','>, Atom<'}'>, CNode, true>;
+    return pattern::match(ctx, body);
+  }
+};
+
+//------------------------------------------------------------------------------
+// Matches a {...} block by counting braces, without parsing what's inside it.
+// Braces in strings and character constants are inside their tokens, so they
+// don't count.
+
+struct SkipBraces {
+  static TokenSpan match(CContext& ctx, TokenSpan body) {
+    if (!body.is_valid() || body.is_empty()) return body.fail();
+    if (ctx.atom_cmp(*body.begin, '{')) return body.fail();
+
+    int depth = 0;
+    for (auto t = body.begin; t < body.end; t++) {
+      if (t->type != LEX_PUNCT) continue;
+      if (ctx.atom_cmp(*t, '{') == 0) depth++;
+      if (ctx.atom_cmp(*t, '}') == 0 && --depth == 0) return TokenSpan(t + 1, body.end);
+    }
+    return body.fail();
+  }
+};
+
+// In outline mode, 'P' is skipped at file scope and captured as a single
+// 'tag' node instead. CContext::expand() parses it later.
+
+template <StringParam tag, typename P>
+struct Outline {
+  static TokenSpan match(CContext& ctx, TokenSpan body) {
+    if (ctx.outline && ctx.types.current == 0) {
+      return Capture<tag, SkipBraces, CNode>::match(ctx, body);
+    }
+    return P::match(ctx, body);
+  }
+};
+
+//------------------------------------------------------------------------------
+// Same as Oneof<alts...>, except that only the alternatives whose bit is set
+// in 'mask' are tried. If the others couldn't have matched anyway, the result
+// is the same as Oneof's.
+
+template <typename P, typename... rest>
+struct OneofMasked {
+  static TokenSpan match(CContext& ctx, TokenSpan body, uint32_t mask) {
+    if (!mask) return body.fail();
+
+    auto tail1 = body.fail();
+    if (mask & 1) {
+      auto bookmark = ctx.checkpoint();
+      tail1 = P::match(ctx, body);
+      if (tail1.is_valid()) return tail1;
+      if (bookmark != ctx.checkpoint()) ctx.rewind(bookmark);
+    }
+
+    auto tail2 = OneofMasked<rest...>::match(ctx, body, mask >> 1);
+    if (tail2.is_valid()) return tail2;
+    return tail1.end > tail2.end ? tail1 : tail2;
+  }
+};
+
+template <typename P>
+struct OneofMasked<P> {
+  static TokenSpan match(CContext& ctx, TokenSpan body, uint32_t mask) {
+    return (mask & 1) ? P::match(ctx, body) : body.fail();
+  }
+};
+
+//------------------------------------------------------------------------------
+// Matches string literals as if they were atoms. Keywords and punctuators are
+// matched by the id the lexer gave them, anything else by its text.
 
 template <StringParam lit>
 struct Keyword : public CNode, PatternWrapper<Keyword<lit>> {
-  static_assert(SST<c_keywords>::contains(lit.str_val));
+  static constexpr uint32_t id = keyword_id(lit.str_val);
+  static_assert(id);
 
   static TokenSpan match(CContext& ctx, TokenSpan body) {
     if (!body.is_valid() || body.is_empty()) return body.fail();
-    if (ctx.atom_cmp(*body.begin, LEX_KEYWORD) != 0) return body.fail();
-    if (ctx.atom_cmp(*body.begin, lit.span()) != 0) return body.fail();
+    if (!body.begin->is_keyword(id)) return body.fail();
     return body.advance(1);
   }
 };
 
 template <StringParam lit>
 struct Literal2 : public CNode, PatternWrapper<Literal2<lit>> {
+  static constexpr uint32_t keyword = keyword_id(lit.str_val);
+  static constexpr uint32_t punct = punct_id(lit.str_val);
+
   static TokenSpan match(CContext& ctx, TokenSpan body) {
     if (!body.is_valid() || body.is_empty()) return body.fail();
-    if (ctx.atom_cmp(*body.begin, lit.span()) != 0) return body.fail();
+    if constexpr (keyword) {
+      if (!body.begin->is_keyword(keyword)) return body.fail();
+    }
+    else if constexpr (punct) {
+      if (!body.begin->is_punct(punct)) return body.fail();
+    }
+    else {
+      if (ctx.atom_cmp(*body.begin, lit.span()) != 0) return body.fail();
+    }
     return body.advance(1);
   }
 };
 
 //------------------------------------------------------------------------------
+// The lexer already joined multi-character punctuators into one token.
 
 template <StringParam lit>
 inline TokenSpan match_punct(CContext& ctx, TokenSpan body) {
-  if (!body.is_valid() || body.is_empty()) return body.fail();
-
-  size_t lit_len = lit.str_len;
-  const char* lit_val = lit.str_val;
-
-  if (body.len() < lit.str_len) return body.fail();
+  static constexpr uint32_t id = punct_id(lit.str_val);
+  static_assert(id);
 
-  for (auto i = 0; i < lit.str_len; i++) {
-    const CToken& tok_a = body.begin[0];
-    if (ctx.atom_cmp(tok_a, LEX_PUNCT) != 0) return body.fail();
-    if (ctx.atom_cmp(tok_a.text.begin[0], lit.str_val[i]) != 0) return body.fail();
-    body = body.advance(1);
-  }
-
-  return body;
+  if (!body.is_valid() || body.is_empty()) return body.fail();
+  if (!body.begin->is_punct(id)) return body.fail();
+  return body.advance(1);
 }
 
 //------------------------------------------------------------------------------
@@ -221,29 +300,31 @@ struct NodeIdentifier : public CNode {};
 struct NodePreproc : public CNode {
   using pattern = Atom<LEX_PREPROC>;
 
-  static TokenSpan match(CContext& ctx, TokenSpan body) {
-    auto tail = pattern::match(ctx, body);
-    if (tail.is_valid()) {
-      std::string s(body.begin->text.begin, (tail.begin - 1)->text.end);
+  // Calls f() with each builtin typedef that the directive pulls in.
+  template<typename F>
+  static void visit_typedefs(TextSpan directive, F f) {
+    std::string s(directive.begin, directive.end);
 
-      if (s.find("stdio") != std::string::npos) {
-        for (auto t : stdio_typedefs) {
-          ctx.type_scope->add_typedef_type(t);
-        }
-      }
+    if (s.find("stdio") != std::string::npos) {
+      for (auto t : stdio_typedefs) f(t);
+    }
 
-      if (s.find("stdint") != std::string::npos) {
-        for (auto t : stdint_typedefs) {
-          ctx.type_scope->add_typedef_type(t);
-        }
-      }
+    if (s.find("stdint") != std::string::npos) {
+      for (auto t : stdint_typedefs) f(t);
+    }
 
-      if (s.find("stddef") != std::string::npos) {
-        for (auto t : stddef_typedefs) {
-          ctx.type_scope->add_typedef_type(t);
-        }
-      }
+    if (s.find("stddef") != std::string::npos) {
+      for (auto t : stddef_typedefs) f(t);
+    }
+  }
 
+  static TokenSpan match(CContext& ctx, TokenSpan body) {
+    auto tail = pattern::match(ctx, body);
+    if (tail.is_valid()) {
+      TextSpan directive(body.begin->text().begin, (tail.begin - 1)->text().end);
+      visit_typedefs(directive, [&](const char* t) {
+        ctx.types.add_builtin_typedef(ctx, t);
+      });
     }
     return tail;
   }
@@ -304,7 +385,7 @@ struct NodeSuffixOp : public CNode, PatternWrapper<NodeSuffixOp<lit>> {
 struct NodeQualifier : public CNode, PatternWrapper<NodeQualifier> {
   static TokenSpan match(CContext& ctx, TokenSpan body) {
     matcheroni_assert(body.is_valid());
-    TextSpan span = body.begin->text;
+    TextSpan span = body.begin->text();
     if (SST<qualifiers>::match(span.begin, span.end)) {
       return body.advance(1);
     }
@@ -501,6 +582,19 @@ struct NodeExpressionOffsetof : public CNode, PatternWrapper<NodeExpressionOffse
   >;
 };
 
+// Takes a type as its second argument, so it can't parse as a call.
+struct NodeExpressionVaArg : public CNode, PatternWrapper<NodeExpressionVaArg> {
+  using pattern =
+  Seq<
+    Keyword<"__builtin_va_arg">,
+    Atom<'('>,
+    Capture<"expression", NodeExpression, CNode>,
+    Atom<','>,
+    Capture<"name", NodeTypeName, CNode>,
+    Atom<')'>
+  >;
+};
+
 //----------------------------------------
 
 template <StringParam lit>
@@ -529,7 +623,8 @@ Oneof<
   Capture<"prebang",   NodePrefixOp<"!">::pattern,  NodePrefixOp<"!">>,
   Capture<"pretilde",  NodePrefixOp<"~">::pattern,  NodePrefixOp<"~">>,
   Capture<"prestar",   NodePrefixOp<"*">::pattern,  NodePrefixOp<"*">>,
-  Capture<"preamp",    NodePrefixOp<"&">::pattern,  NodePrefixOp<"&">>
+  Capture<"preamp",    NodePrefixOp<"&">::pattern,  NodePrefixOp<"&">>,
+  Capture<"prelabel",  NodePrefixOp<"&&">::pattern, NodePrefixOp<"&&">> // GCC label address
 >;
 // clang-format on
 
@@ -541,9 +636,10 @@ Oneof<
   Capture<"sizeof",       NodeExpressionSizeof,      CNode>,
   Capture<"alignof",      NodeExpressionAlignof,     CNode>,
   Capture<"offsetof",     NodeExpressionOffsetof,    CNode>,
+  Capture<"va_arg",       NodeExpressionVaArg,       CNode>,
   Capture<"gcc_compound", NodeExpressionGccCompound, CNode>,
   Capture<"paren",        NodeExpressionParen,       CNode>,
-  Capture<"init",         NodeInitializerList,       CNode>,
+  CaptureInitList<"init", NodeInitializerList>,
   Capture<"braces",       NodeExpressionBraces,      CNode>,
   Capture<"identifier",   lit_identifier,            CNode>,
   Capture<"constant",     exp_constant,              NodeConstant>
@@ -555,7 +651,7 @@ Oneof<
 // clang-format off
 using ExpressionSuffixOp =
 Oneof<
-  Capture<"initializer", NodeSuffixInitializerList, CNode>,  // must be before NodeSuffixBraces
+  CaptureInitList<"initializer", NodeSuffixInitializerList>, // must be before NodeSuffixBraces
   Capture<"braces",      suffix_braces,             NodeSuffixBraces>,
   Capture<"paren",       NodeSuffixParen,           CNode>,
   Capture<"subscript",   NodeSuffixSubscript,       CNode>,
@@ -608,39 +704,45 @@ struct NodeExpression : public CNode, PatternWrapper<NodeExpression> {
     }
 
     // clang-format off
-    switch (body.begin->text.begin[0]) {
-      case '+':
-        return Oneof<NodeBinaryOp<"+=">, NodeBinaryOp<"+">>::match(ctx, body);
-      case '-':
-        return Oneof<NodeBinaryOp<"->*">, NodeBinaryOp<"->">, NodeBinaryOp<"-=">, NodeBinaryOp<"-">>::match(ctx, body);
-      case '*':
-        return Oneof<NodeBinaryOp<"*=">, NodeBinaryOp<"*">>::match(ctx, body);
-      case '/':
-        return Oneof<NodeBinaryOp<"/=">, NodeBinaryOp<"/">>::match(ctx, body);
-      case '=':
-        return Oneof<NodeBinaryOp<"==">, NodeBinaryOp<"=">>::match(ctx, body);
-      case '<':
-        return Oneof<NodeBinaryOp<"<<=">, NodeBinaryOp<"<=>">, NodeBinaryOp<"<=">, NodeBinaryOp<"<<">, NodeBinaryOp<"<">>::match(ctx, body);
-      case '>':
-        return Oneof<NodeBinaryOp<">>=">, NodeBinaryOp<">=">, NodeBinaryOp<">>">, NodeBinaryOp<">">>::match(ctx, body);
-      case '!':
-        return NodeBinaryOp<"!=">::match(ctx, body);
-      case '&':
-        return Oneof<NodeBinaryOp<"&&">, NodeBinaryOp<"&=">, NodeBinaryOp<"&">>::match(ctx, body);
-      case '|':
-        return Oneof<NodeBinaryOp<"||">, NodeBinaryOp<"|=">, NodeBinaryOp<"|">>::match(ctx, body);
-      case '^':
-        return Oneof<NodeBinaryOp<"^=">, NodeBinaryOp<"^">>::match(ctx, body);
-      case '%':
-        return Oneof<NodeBinaryOp<"%=">, NodeBinaryOp<"%">>::match(ctx, body);
-      case '.':
-        return Oneof<NodeBinaryOp<".*">, NodeBinaryOp<".">>::match(ctx, body);
-      case '?':
-        return NodeTernaryOp::match(ctx, body);
-
-        // FIXME this is only for C++, and
-        // case ':': return NodeBinaryOp<"::">::match(ctx, body);
-        // default:  return nullptr;
+    switch (body.begin->id) {
+      case punct_id("+="):  return NodeBinaryOp<"+=">::match(ctx, body);
+      case punct_id("+"):   return NodeBinaryOp<"+">::match(ctx, body);
+      case punct_id("->*"): return NodeBinaryOp<"->*">::match(ctx, body);
+      case punct_id("->"):  return NodeBinaryOp<"->">::match(ctx, body);
+      case punct_id("-="):  return NodeBinaryOp<"-=">::match(ctx, body);
+      case punct_id("-"):   return NodeBinaryOp<"-">::match(ctx, body);
+      case punct_id("*="):  return NodeBinaryOp<"*=">::match(ctx, body);
+      case punct_id("*"):   return NodeBinaryOp<"*">::match(ctx, body);
+      case punct_id("/="):  return NodeBinaryOp<"/=">::match(ctx, body);
+      case punct_id("/"):   return NodeBinaryOp<"/">::match(ctx, body);
+      case punct_id("=="):  return NodeBinaryOp<"==">::match(ctx, body);
+      case punct_id("="):   return NodeBinaryOp<"=">::match(ctx, body);
+      case punct_id("<<="): return NodeBinaryOp<"<<=">::match(ctx, body);
+      case punct_id("<=>"): return NodeBinaryOp<"<=>">::match(ctx, body);
+      case punct_id("<="):  return NodeBinaryOp<"<=">::match(ctx, body);
+      case punct_id("<<"):  return NodeBinaryOp<"<<">::match(ctx, body);
+      case punct_id("<"):   return NodeBinaryOp<"<">::match(ctx, body);
+      case punct_id(">>="): return NodeBinaryOp<">>=">::match(ctx, body);
+      case punct_id(">="):  return NodeBinaryOp<">=">::match(ctx, body);
+      case punct_id(">>"):  return NodeBinaryOp<">>">::match(ctx, body);
+      case punct_id(">"):   return NodeBinaryOp<">">::match(ctx, body);
+      case punct_id("!="):  return NodeBinaryOp<"!=">::match(ctx, body);
+      case punct_id("&&"):  return NodeBinaryOp<"&&">::match(ctx, body);
+      case punct_id("&="):  return NodeBinaryOp<"&=">::match(ctx, body);
+      case punct_id("&"):   return NodeBinaryOp<"&">::match(ctx, body);
+      case punct_id("||"):  return NodeBinaryOp<"||">::match(ctx, body);
+      case punct_id("|="):  return NodeBinaryOp<"|=">::match(ctx, body);
+      case punct_id("|"):   return NodeBinaryOp<"|">::match(ctx, body);
+      case punct_id("^="):  return NodeBinaryOp<"^=">::match(ctx, body);
+      case punct_id("^"):   return NodeBinaryOp<"^">::match(ctx, body);
+      case punct_id("%="):  return NodeBinaryOp<"%=">::match(ctx, body);
+      case punct_id("%"):   return NodeBinaryOp<"%">::match(ctx, body);
+      case punct_id(".*"):  return NodeBinaryOp<".*">::match(ctx, body);
+      case punct_id("."):   return NodeBinaryOp<".">::match(ctx, body);
+      case punct_id("?"):   return NodeTernaryOp::match(ctx, body);
+
+        // FIXME this is only for C++, and the lexer doesn't make "::" tokens
+        // case punct_id("::"): return NodeBinaryOp<"::">::match(ctx, body);
     }
     // clang-format on
 
@@ -1131,7 +1233,10 @@ struct NodeDeclaratorList : public CNode,
         Opt<
           Seq<
             Atom<'='>,
-            Capture<"initializer", NodeInitializer, CNode>
+            Oneof<
+              Outline<"skipped_init", CaptureInitList<"initializer", NodeInitializerList>>,
+              Capture<"initializer", NodeExpression, CNode>
+            >
           >
         >
       >,
@@ -1171,7 +1276,7 @@ Seq<
   Opt<Capture<"asm_suffix",       NodeAsmSuffix,                   CNode>>,
   Opt<Capture<"const",            NodeKeyword<"const">,            CNode>>,
   Any<Capture<"old_declaration",  Seq<NodeDeclaration, Atom<';'>>, CNode>>, // This is old-style declarations after param list
-  One<Capture<"func_body",        NodeStatementCompound,           CNode>>
+  One<Outline<"skipped_body",      Capture<"func_body", NodeStatementCompound, CNode>>>
 >;
 
 struct NodeFunctionDefinition : public CNode {};
@@ -1433,14 +1538,13 @@ struct NodeDesignation : public CNode, public PatternWrapper<NodeDesignation> {
 };
 
 struct NodeInitializerList : public CNode, public PatternWrapper<NodeInitializerList> {
-  using pattern = DelimitedList<
-      Atom<'{'>,
-      Seq<Opt<Seq<NodeDesignation, Atom<'='>>,
-              Seq<lit_identifier, Atom<':'>>  // This isn't in the C grammar but
-                                              // compndlit-1.c uses it?
-              >,
-          NodeInitializer>,
-      Atom<','>, Atom<'}'>>;
+  using item = Seq<Opt<Seq<NodeDesignation, Atom<'='>>,
+                       Seq<lit_identifier, Atom<':'>>  // This isn't in the C grammar but
+                                                       // compndlit-1.c uses it?
+                       >,
+                   NodeInitializer>;
+
+  using pattern = DelimitedList<Atom<'{'>, item, Atom<','>, Atom<'}'>>;
 };
 
 struct NodeSuffixInitializerList : public CNode, public PatternWrapper<NodeSuffixInitializerList> {
@@ -1450,20 +1554,17 @@ struct NodeSuffixInitializerList : public CNode, public PatternWrapper<NodeSuffi
   }
 
   // clang-format off
-  using pattern =
-  DelimitedList<
-    Atom<'{'>,
-    Seq<
-      Opt<
-        Seq<NodeDesignation, Atom<'='>>,
-        Seq<lit_identifier, Atom<':'>>  // This isn't in the C grammar but compndlit-1.c uses it?
-      >,
-      Capture<"initializer", NodeInitializer, CNode>
+  using item =
+  Seq<
+    Opt<
+      Seq<NodeDesignation, Atom<'='>>,
+      Seq<lit_identifier, Atom<':'>>  // This isn't in the C grammar but compndlit-1.c uses it?
     >,
-    Atom<','>,
-    Atom<'}'>
+    Capture<"initializer", NodeInitializer, CNode>
   >;
   // clang-format on
+
+  using pattern = DelimitedList<Atom<'{'>, item, Atom<','>, Atom<'}'>>;
 };
 
 struct NodeInitializer : public CNode, public PatternWrapper<NodeInitializer> {
@@ -1798,9 +1899,11 @@ Seq<
 struct NodeTypedef : public CNode {
 
   static void extract_declarator(CContext& ctx, CNode* decl) {
-    if (auto name = decl->child("name")) {
-      if (auto id = name->child("identifier")) {
+    // The name can be inside parens, as in "typedef int (*fn)(void);".
+    for (auto d = decl->child("name"); d; d = d->child("declarator")) {
+      if (auto id = d->child("identifier")) {
         ctx.add_typedef_type(id->span.begin);
+        return;
       }
     }
   }
@@ -1867,10 +1970,83 @@ struct NodeStatementGoto : public CNode {};
 
 //------------------------------------------------------------------------------
 
-struct NodeStatement : public PatternWrapper<NodeStatement> {
+//------------------------------------------------------------------------------
+// First-token tests for the alternatives in NodeStatement and
+// NodeTranslationUnit. Each one only says whether a pattern _could_ start with
+// a token. They check the token's text wherever the patterns do (Literal2<>,
+// Atom<char>, NodeQualifier, the builtin types) and its keyword or punctuator
+// id everywhere else, so they never rule out anything the pattern itself would
+// accept.
+
+// The keywords and punctuators in 'table' as flags indexed by id. Every entry
+// in the table has to be one or the other.
+template <const auto& table>
+struct TokenSet {
+  struct Flags {
+    bool keywords[c_keywords.size() + 1] = {};
+    bool puncts[c_punctuators.size() + 1] = {};
+  };
+
+  static consteval Flags make() {
+    Flags flags;
+    for (auto text : table) {
+      if (auto id = table_id<c_keywords>(text)) flags.keywords[id] = true;
+      else if (auto id = table_id<c_punctuators>(text)) flags.puncts[id] = true;
+      else throw "not a keyword or punctuator";
+    }
+    return flags;
+  }
+
+  static constexpr Flags flags = make();
+
+  static bool contains(const CToken& t) {
+    if (t.type == LEX_KEYWORD) return flags.keywords[t.id];
+    if (t.type == LEX_PUNCT) return flags.puncts[t.id];
+    return false;
+  }
+};
+
+inline bool starts_modifier(const CToken& t) {
+  return SST<qualifiers>::match(t.text().begin, t.text().end) ||
+         TokenSet<modifier_prefixes>::contains(t);
+}
+
+inline bool starts_declaration(const CToken& t) {
+  if (t.type == LEX_IDENTIFIER) return true;
+  auto a = t.text().begin;
+  auto b = t.text().end;
+  return starts_modifier(t) ||
+         SST<declaration_prefixes>::match(a, b) ||
+         SST<builtin_type_prefix>::match(a, b) ||
+         SST<builtin_type_base>::match(a, b);
+}
+
+// Identifiers in expressions can't be type names.
+inline bool starts_expression(CContext& ctx, TokenSpan body) {
+  auto& t = *body.begin;
+  switch (t.type) {
+    case LEX_IDENTIFIER:
+      return !ctx.match_typedef_type(body).is_valid();
+    case LEX_INT:
+    case LEX_FLOAT:
+    case LEX_CHAR:
+    case LEX_STRING:
+      return true;
+    default:
+      return TokenSet<expression_prefixes>::contains(t);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Statements are tried in the same order as always, but most of the
+// alternatives are ruled out by the first token before we try to match any of
+// them - a statement starting with "return" or a typedef name has only one or
+// two candidates instead of twenty.
+
+struct NodeStatement {
   // clang-format off
-  using pattern =
-  Oneof<
+  using alternatives =
+  OneofMasked<
     // All of these have keywords or something first
     Capture<"class",    Seq<NodeClass,   Atom<';'>>, CNode>,
     Capture<"struct",   Seq<NodeStruct,  Atom<';'>>, CNode>,
@@ -1903,15 +2079,75 @@ struct NodeStatement : public PatternWrapper<NodeStatement> {
     Atom<';'>
   >;
   // clang-format on
+
+  enum {
+    CLASS = 1 << 0, STRUCT = 1 << 1, UNION = 1 << 2, ENUM = 1 << 3,
+    TYPEDEF = 1 << 4, FOR = 1 << 5, IF = 1 << 6, RETURN = 1 << 7,
+    SWITCH = 1 << 8, DOWHILE = 1 << 9, WHILE = 1 << 10, GOTO = 1 << 11,
+    ASM = 1 << 12, COMPOUND = 1 << 13, BREAK = 1 << 14, CONTINUE = 1 << 15,
+    LABEL = 1 << 16, FUNCTION = 1 << 17, EXPRESSION = 1 << 18,
+    DECLARATION = 1 << 19, SEMICOLON = 1 << 20,
+  };
+
+  static uint32_t keyword_candidates(const CToken& t) {
+    // clang-format off
+    switch (t.id) {
+      case keyword_id("struct"):        return STRUCT;
+      case keyword_id("union"):         return UNION;
+      case keyword_id("enum"):          return ENUM;
+      case keyword_id("typedef"):       return TYPEDEF;
+      case keyword_id("__extension__"): return TYPEDEF;
+      case keyword_id("for"):           return FOR;
+      case keyword_id("if"):            return IF;
+      case keyword_id("return"):        return RETURN;
+      case keyword_id("switch"):        return SWITCH;
+      case keyword_id("do"):            return DOWHILE;
+      case keyword_id("while"):         return WHILE;
+      case keyword_id("goto"):          return GOTO;
+      case keyword_id("asm"):           return ASM;
+      case keyword_id("__asm"):         return ASM;
+      case keyword_id("__asm__"):       return ASM;
+      case keyword_id("break"):         return BREAK;
+      case keyword_id("continue"):      return CONTINUE;
+    }
+    // clang-format on
+    return 0;
+  }
+
+  static uint32_t candidates(CContext& ctx, TokenSpan body) {
+    auto& t = *body.begin;
+    uint32_t mask = 0;
+
+    if (t.type == LEX_KEYWORD) mask |= keyword_candidates(t);
+    if (starts_modifier(t)) mask |= CLASS | STRUCT | UNION | ENUM;
+    if (strcmp_span(t.text(), "class") == 0) mask |= CLASS;
+    if (t.is_punct(punct_id("{"))) mask |= COMPOUND;
+    if (t.is_punct(punct_id(";"))) mask |= SEMICOLON;
+
+    if (t.type == LEX_IDENTIFIER && body.len() > 1 && body.begin[1].is_punct(punct_id(":"))) {
+      mask |= LABEL;
+    }
+
+    if (starts_declaration(t)) mask |= FUNCTION | DECLARATION;
+    if (starts_expression(ctx, body)) mask |= EXPRESSION;
+    return mask;
+  }
+
+  static TokenSpan match(CContext& ctx, TokenSpan body) {
+    matcheroni_assert(body.is_valid());
+    if (body.is_empty()) return body.fail();
+    return alternatives::match(ctx, body, candidates(ctx, body));
+  }
 };
 
 //------------------------------------------------------------------------------
 
 struct NodeTranslationUnit : public CNode, public PatternWrapper<NodeTranslationUnit> {
-  // clang-format off
-  using pattern =
-  Any<
-    Oneof<
+  // Top-level items get the same first-token treatment as NodeStatement.
+  struct item {
+    // clang-format off
+    using alternatives =
+    OneofMasked<
       Capture<"class",        Seq<NodeClass,  Atom<';'>>, CNode>,
       Capture<"struct",       Seq<NodeStruct, Atom<';'>>, CNode>,
       Capture<"union",        Seq<NodeUnion,  Atom<';'>>, CNode>,
@@ -1923,9 +2159,63 @@ struct NodeTranslationUnit : public CNode, public PatternWrapper<NodeTranslation
       Capture<"declaration",  Seq<NodeDeclaration, Atom<';'>>, CNode>,
       Capture<"namespace",    NodeNamespace, CNode>,
       Atom<';'>
-    >
-  >;
-  // clang-format on
+    >;
+    // clang-format on
+
+    enum {
+      CLASS = 1 << 0, STRUCT = 1 << 1, UNION = 1 << 2, ENUM = 1 << 3,
+      TYPEDEF = 1 << 4, PREPROC = 1 << 5, TEMPLATE = 1 << 6,
+      FUNCTION = 1 << 7, DECLARATION = 1 << 8, NAMESPACE = 1 << 9,
+      SEMICOLON = 1 << 10,
+    };
+
+    static uint32_t candidates(const CToken& t) {
+      uint32_t mask = 0;
+
+      if (t.type == LEX_PREPROC) return PREPROC;
+      if (starts_modifier(t)) mask |= CLASS | STRUCT | UNION | ENUM;
+      if (starts_declaration(t)) mask |= FUNCTION | DECLARATION;
+
+      // "class", "template" and "namespace" aren't C keywords, so those are
+      // still compared by text.
+      // clang-format off
+      if (t.type == LEX_KEYWORD) {
+        switch (t.id) {
+          case keyword_id("struct"):        mask |= STRUCT;  break;
+          case keyword_id("union"):         mask |= UNION;   break;
+          case keyword_id("enum"):          mask |= ENUM;    break;
+          case keyword_id("typedef"):       mask |= TYPEDEF; break;
+          case keyword_id("__extension__"): mask |= TYPEDEF; break;
+        }
+      }
+      else if (t.is_punct(punct_id(";")))               mask |= SEMICOLON;
+      else if (strcmp_span(t.text(), "class")     == 0) mask |= CLASS;
+      else if (strcmp_span(t.text(), "template")  == 0) mask |= TEMPLATE;
+      else if (strcmp_span(t.text(), "namespace") == 0) mask |= NAMESPACE;
+      // clang-format on
+
+      return mask;
+    }
+
+    static TokenSpan match(CContext& ctx, TokenSpan body) {
+      matcheroni_assert(body.is_valid());
+      if (body.is_empty()) return body.fail();
+      return alternatives::match(ctx, body, candidates(*body.begin));
+    }
+  };
+
+  // Nothing rewinds past a top-level item once it has matched, so the undo
+  // entries for the types it declared can go instead of piling up until the
+  // context is reset.
+  struct committed_item {
+    static TokenSpan match(CContext& ctx, TokenSpan body) {
+      auto tail = item::match(ctx, body);
+      if (tail.is_valid()) ctx.drop_undo();
+      return tail;
+    }
+  };
+
+  using pattern = Any<committed_item>;
 };
 
 //------------------------------------------------------------------------------
@@ -1,6 +1,7 @@
 // SPDX-FileCopyrightText:  2023 Austin Appleby <aappleby@gmail.com>
 // SPDX-License-Identifier: MIT License
 
+#include <algorithm>
 #include <filesystem>
 
 #include "matcheroni/Utilities.hpp"
@@ -10,6 +11,7 @@
 #include "CNode.hpp"
 
 using namespace matcheroni;
+using namespace parseroni;
 
 bool verbose = false;
 
@@ -105,6 +107,10 @@ int test_parser(int argc, char** argv) {
   int file_skip = 0;
   int file_bytes = 0;
   int file_lines = 0;
+  size_t arena_bytes = 0;
+
+  TagStats tag_stats;
+  context.tag_stats = &tag_stats;
 
 #if 0
   paths = {
@@ -132,9 +138,15 @@ int test_parser(int argc, char** argv) {
   }
 #endif
 
+  // Every rate below divides by the totals.
+  if (paths.empty()) {
+    printf("No source files in %s\n", base_path);
+    return -1;
+  }
 
   std::string text;
   text.reserve(65536);
+  utils::LineIndex lines;
 
   for (const auto& path : paths) {
     {
@@ -151,7 +163,8 @@ int test_parser(int argc, char** argv) {
 
       text.clear();
       utils::read(path.c_str(), text);
-      for (auto c : text) if (c == '\n') file_lines++;
+      lines.build(utils::to_span(text));
+      file_lines += lines.line_count();
       file_bytes += text.size();
 
       io_time += utils::timestamp_ms();
@@ -184,12 +197,15 @@ int test_parser(int argc, char** argv) {
     parse_time -= utils::timestamp_ms();
     bool parse_ok = context.parse(text_span, tok_span);
     parse_time += utils::timestamp_ms();
+    arena_bytes += context.alloc.current_size();
 
     if (!parse_ok) {
       file_fail++;
       printf("\n");
       printf("fail!\n");
-      printf("Parsing failed: %s\n", path.c_str());
+      // The last top-level node that matched ends close to the error.
+      auto near = context.top_tail ? context.top_tail->span.end : tok_span.begin + 1;
+      utils::print_location(path.c_str(), lines, near->begin, "Parsing failed");
       exit(1);
     }
 
@@ -233,7 +249,24 @@ int test_parser(int argc, char** argv) {
   printf("Parsing time   %f msec\n", parse_time);
   printf("Cleanup time   %f msec\n", cleanup_time);
   printf("\n");
-  //printf("Node pool      %d bytes\n", LifoAlloc::inst().max_size);
+  printf("Arena peak     %ld bytes\n", context.alloc.peak_size());
+  printf("Arena slabs    %d\n", context.alloc.slab_count);
+  printf("Arena/input    %f bytes per byte\n", double(arena_bytes) / double(file_bytes));
+  printf("Peak RSS       %ld bytes\n", utils::peak_rss());
+  printf("\n");
+
+  // Rules that throw away the most nodes are the first place to look when
+  // parsing is slow.
+  std::vector<TagStats::Entry> entries;
+  for (auto& e : tag_stats.entries) if (e.tag) entries.push_back(e);
+  std::sort(entries.begin(), entries.end(),
+            [](auto& a, auto& b) { return a.rewound > b.rewound; });
+  printf("Most rewound node tags:\n");
+  for (size_t i = 0; i < entries.size() && i < 10; i++) {
+    printf("  %-24s created %10ld rewound %10ld\n", entries[i].tag,
+           entries[i].created, entries[i].rewound);
+  }
+  printf("\n");
   printf("File pass      %d\n", file_pass);
   printf("File fail      %d\n", file_fail);
   printf("File skip      %d\n", file_skip);
@@ -257,6 +290,6 @@ int test_parser(int argc, char** argv) {
 
 //------------------------------------------------------------------------------
 
-int main(int argc, char** argv) { test_parser(argc, argv); }
+int main(int argc, char** argv) { return test_parser(argc, argv); }
 
 //------------------------------------------------------------------------------
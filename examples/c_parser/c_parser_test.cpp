@@ -36,16 +36,8 @@ void parse_and_dump(matcher_function<CContext, CToken> parse, std::string source
 
   //auto parse_ok = context.parse(text_span, tok_span);
 
-  std::vector<CToken> tokens;
-
-  for (auto t : lexer.tokens) {
-    if (!t.is_gap()) tokens.push_back(t);
-  }
-
   // Skip over BOF, stop before EOF
-  auto tok_a = tokens.data() + 1;
-  auto tok_b = tokens.data() + tokens.size() - 1;
-  TokenSpan body(tok_a, tok_b);
+  TokenSpan body(tok_span.begin + 1, tok_span.end - 1);
 
   auto tail = parse(context, body);
 
@@ -60,11 +52,74 @@ void parse_and_dump(matcher_function<CContext, CToken> parse, std::string source
   }
 }
 
+//------------------------------------------------------------------------------
+// A translation unit is a list of items, so a parse that runs out of bytes
+// partway through still matches a prefix of the file. All three ways of
+// parsing should report that as a failure.
+
+void test_accounting() {
+  std::string source = "typedef int myint;\nint f(myint x) {\n";
+  for (int i = 0; i < 100; i++) source += "  x = x * 3 + (x >> 2);\n";
+  source += "  return x;\n}\nint y;\n";
+
+  CLexer lexer;
+  CContext context;
+  auto text_span = utils::to_span(source);
+  assert(lexer.lex(text_span));
+  TokenSpan tok_span = utils::to_span(lexer.tokens);
+
+  assert(context.parse(text_span, tok_span) && context.parse_complete);
+  assert(!context.alloc.over_limit);
+  size_t full_size = context.alloc.used_bytes;
+
+  // The function body is most of the tree, so half the bytes won't hold it
+  // even when the items are parsed one at a time.
+  context.reset();
+  context.alloc.byte_limit = full_size / 2;
+  assert(!context.parse(text_span, tok_span));
+  assert(context.alloc.over_limit && !context.parse_complete);
+
+  context.reset();
+  assert(!context.parse_parallel(text_span, tok_span, 2));
+  assert(!context.parse_complete);
+
+  context.reset();
+  CLexer stream_lexer;
+  assert(!context.parse_stream(text_span, stream_lexer, [](CNode*) {}));
+  assert(!context.parse_complete);
+
+  context.reset();
+  context.alloc.byte_limit = full_size;
+  assert(context.parse(text_span, tok_span) && context.parse_complete);
+  assert(!context.alloc.over_limit);
+}
+
+//------------------------------------------------------------------------------
+// Nothing can rewind past a matched top-level item, so its undo entries are
+// dropped while the types it declared stay bound.
+
+void test_undo_log() {
+  std::string source = "typedef int myint;\nstruct s { myint x; };\nmyint f(struct s* p) { return p->x; }\n";
+
+  CLexer lexer;
+  CContext context;
+  auto text_span = utils::to_span(source);
+  assert(lexer.lex(text_span));
+  TokenSpan tok_span = utils::to_span(lexer.tokens);
+
+  assert(context.parse(text_span, tok_span) && context.parse_complete);
+  assert(context.undo_log.empty());
+  assert(context.types.bindings.size() >= 2);
+}
+
 //------------------------------------------------------------------------------
 
 int main(int argc, char** argv) {
   printf("c_parser_test\n");
 
+  test_accounting();
+  test_undo_log();
+
   std::string source;
   std::string result;
 
@@ -0,0 +1,158 @@
+// SPDX-FileCopyrightText:  2023 Austin Appleby <aappleby@gmail.com>
+// SPDX-License-Identifier: MIT License
+
+// Preprocesses every .c file under the given paths with the system headers,
+// first with an empty file cache and then again with the headers already
+// lexed, and then parses the preprocessed tokens.
+//
+// usage: c_preproc_benchmark [-Ipath] [-Dname[=value]] path...
+
+#include "matcheroni/Utilities.hpp"
+
+#include "../c_lexer/CPreproc.hpp"
+#include "CContext.hpp"
+#include "CNode.hpp"
+
+#include <algorithm>
+#include <filesystem>
+
+using namespace matcheroni;
+using namespace parseroni;
+
+const char* system_paths[] = {
+  "/usr/lib/gcc/x86_64-linux-gnu/12/include",
+  "/usr/local/include",
+  "/usr/include/x86_64-linux-gnu",
+  "/usr/include",
+};
+
+struct Pass {
+  double time = 0;
+  size_t lines = 0;
+  size_t tokens = 0;
+  size_t lexed = 0;
+  size_t hits = 0;
+  int ok = 0;
+};
+
+Pass run(CPreproc& pp, const std::vector<std::string>& paths, bool report) {
+  Pass pass;
+  pass.lexed = pp.files_lexed;
+  pass.hits = pp.cache_hits;
+  for (const auto& path : paths) {
+    double time = -utils::timestamp_ms();
+    bool ok = pp.preprocess(path);
+    time += utils::timestamp_ms();
+
+    pass.time += time;
+    pass.lines += pp.lines;
+    pass.tokens += pp.tokens.size();
+    if (ok) {
+      pass.ok++;
+    } else if (report) {
+      printf("  %s\n", pp.error.c_str());
+    }
+  }
+  pass.lexed = pp.files_lexed - pass.lexed;
+  pass.hits = pp.cache_hits - pass.hits;
+  return pass;
+}
+
+void print_pass(const char* name, const Pass& pass) {
+  printf("%s %10f msec, %.0f lines/sec, %ld files lexed, %ld cache hits\n", name, pass.time,
+         1000.0 * double(pass.lines) / pass.time, pass.lexed, pass.hits);
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+  printf("Matcheroni C preprocessor benchmark\n");
+
+  std::vector<std::string> includes;
+  std::vector<std::pair<std::string, std::string>> defines;
+  std::vector<std::string> paths;
+
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    std::string opt = argv[arg] + 2;
+    if (argv[arg][1] == 'I') {
+      includes.push_back(opt);
+    } else if (argv[arg][1] == 'D') {
+      auto eq = opt.find('=');
+      if (eq == std::string::npos) defines.push_back({opt, "1"});
+      else defines.push_back({opt.substr(0, eq), opt.substr(eq + 1)});
+    }
+  }
+  std::vector<std::string> bases(argv + arg, argv + argc);
+  if (bases.empty()) bases.push_back("tests");
+  for (const auto& base : bases) {
+    if (std::filesystem::is_regular_file(base)) {
+      paths.push_back(base);
+      continue;
+    }
+    using rdit = std::filesystem::recursive_directory_iterator;
+    for (const auto& f : rdit(base)) {
+      if (f.is_regular_file() && f.path().native().ends_with(".c")) paths.push_back(f.path().native());
+    }
+  }
+  std::sort(paths.begin(), paths.end());
+  if (paths.empty()) {
+    printf("No .c files to preprocess\n");
+    return -1;
+  }
+
+  CPreproc pp;
+  for (auto& i : includes) pp.add_include_path(i);
+  for (auto i : system_paths) pp.add_include_path(i);
+
+  // The system headers pick GCC's builtin types over their own typedefs when
+  // they think they're being read by a new enough GCC.
+  pp.define("__GNUC__", "12");
+  pp.define("__GNUC_MINOR__", "2");
+  pp.define("__GNUC_PATCHLEVEL__", "0");
+  for (auto& d : defines) pp.define(d.first, d.second);
+
+  // Cold - every header gets lexed the first time a file includes it.
+  printf("Preprocessing %ld files\n", paths.size());
+  Pass cold = run(pp, paths, true);
+  printf("\n");
+  print_pass("Cold cache  ", cold);
+
+  // Warm - the same headers again, straight from the cache.
+  Pass warm = run(pp, paths, false);
+  print_pass("Warm cache  ", warm);
+
+  size_t source_lines = 0;
+  for (const auto& path : paths) {
+    auto text = utils::read(path);
+    source_lines += utils::LineIndex(utils::to_span(text)).line_count();
+  }
+  printf("Guard skips  %ld\n", pp.guard_skips);
+  printf("Lines        %ld in the .c files, %ld with headers\n", source_lines, warm.lines);
+  printf("Tokens out   %ld\n", warm.tokens);
+  printf("\n");
+
+  // Parse what came out.
+  CContext context;
+  int parse_ok = 0;
+  double parse_time = 0;
+  for (const auto& path : paths) {
+    if (!pp.preprocess(path)) continue;
+    context.reset();
+    auto text = TextSpan(pp.tokens.front().begin, pp.tokens.back().begin);
+    parse_time -= utils::timestamp_ms();
+    bool ok = context.parse(text, utils::to_span(pp.tokens));
+    parse_time += utils::timestamp_ms();
+    if (ok && context.parse_complete) parse_ok++;
+    else printf("  Parse failed: %s\n", path.c_str());
+  }
+
+  printf("\n");
+  printf("Preprocessed %d / %ld files\n", cold.ok, paths.size());
+  printf("Parsed       %d / %d files, %f msec\n", parse_ok, cold.ok, parse_time);
+  printf("\n");
+
+  return cold.ok == int(paths.size()) && parse_ok == cold.ok ? 0 : -1;
+}
+
+//------------------------------------------------------------------------------
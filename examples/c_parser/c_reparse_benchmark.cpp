@@ -0,0 +1,223 @@
+// SPDX-FileCopyrightText:  2023 Austin Appleby <aappleby@gmail.com>
+// SPDX-License-Identifier: MIT License
+
+// Measures how long it takes to bring a C parse tree and its tokens up to date
+// after a single character edit in the middle of a large file, compared to a
+// full relex and reparse. Uses a generated source file unless one is given on
+// the command line.
+
+#include "matcheroni/Utilities.hpp"
+
+#include "../c_lexer/CLexer.hpp"
+#include "CContext.hpp"
+#include "CNode.hpp"
+
+#include <algorithm>
+#include <ctype.h>
+
+using namespace matcheroni;
+using namespace parseroni;
+
+const int reps = 50;
+
+//------------------------------------------------------------------------------
+
+std::string make_source(int count) {
+  std::string source = "#include <stdio.h>\n\n";
+  char buf[1024];
+  for (int i = 0; i < count; i++) {
+    snprintf(buf, sizeof(buf),
+      "typedef struct node_%d {\n"
+      "  int value;\n"
+      "  struct node_%d* next;\n"
+      "} node_%d_t;\n"
+      "\n"
+      "static int count_%d(node_%d_t* list, int limit) {\n"
+      "  int total = 0;\n"
+      "  for (node_%d_t* n = list; n; n = n->next) {\n"
+      "    if (n->value > limit) {\n"
+      "      total += n->value * 2;\n"
+      "    } else {\n"
+      "      total -= limit;\n"
+      "    }\n"
+      "  }\n"
+      "  return total;\n"
+      "}\n"
+      "\n",
+      i, i, i, i, i, i);
+    source += buf;
+  }
+  return source;
+}
+
+double median(std::vector<double>& times) {
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+void check_same(CContext& ctx, const CLexer& relexed, TextSpan text) {
+  CLexer lexer;
+  CContext ref;
+  lexer.interner = relexed.interner;
+  lexer.lex(text);
+
+  auto same_lexemes = [](const std::vector<CToken>& a, const std::vector<CToken>& b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](auto& x, auto& y) {
+      return x.begin == y.begin && x.len == y.len && x.type == y.type && x.id == y.id;
+    });
+  };
+  if (!same_lexemes(lexer.tokens, relexed.tokens) || !same_lexemes(lexer.trivia, relexed.trivia) ||
+      lexer.trivia_end != relexed.trivia_end) {
+    printf("Incremental tokens do not match full lex!\n");
+    exit(-1);
+  }
+
+  // Renaming a type's use leaves text that doesn't parse all the way, and the
+  // incremental parse has to stop in the same place.
+  ref.parse(text, utils::to_span(lexer.tokens));
+  if (ctx.parse_complete != ref.parse_complete ||
+      utils::hash_context(ctx) != utils::hash_context(ref)) {
+    printf("Incremental tree does not match full parse!\n");
+    exit(-1);
+  }
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+  printf("Matcheroni C incremental reparse benchmark\n");
+
+  std::string buf_a = argc > 1 ? utils::read(argv[1]) : make_source(2000);
+  TextSpan text = utils::to_span(buf_a);
+
+  CLexer lexer;
+  CContext ctx;
+
+  //----------------------------------------
+  // Full lex and parse, for reference
+
+  std::vector<double> lex_times;
+  std::vector<double> full_times;
+  for (int rep = 0; rep < reps; rep++) {
+    double time = -utils::timestamp_ms();
+    lexer.reset();
+    lexer.lex(text);
+    time += utils::timestamp_ms();
+    lex_times.push_back(time);
+
+    time = -utils::timestamp_ms();
+    ctx.reset();
+    ctx.parse(text, utils::to_span(lexer.tokens));
+    time += utils::timestamp_ms();
+    full_times.push_back(time);
+  }
+
+  if (!ctx.parse_complete) {
+    printf("Could not parse all of the source\n");
+    return -1;
+  }
+
+  // Edit the middle of identifiers inside function bodies in the middle of
+  // the file.
+  std::vector<int64_t> targets;
+  for (auto& t : lexer.tokens) {
+    auto offset = t.text().begin - text.begin;
+    if (t.type != LEX_IDENTIFIER || t.text().len() < 3) continue;
+    if (offset < text.len() * 2 / 5 || offset > text.len() * 3 / 5) continue;
+    targets.push_back(offset + t.text().len() / 2);
+  }
+  if (targets.empty()) {
+    printf("No identifiers to edit\n");
+    return -1;
+  }
+
+  std::vector<int64_t> offsets;
+  for (int i = 0; i < reps; i++) offsets.push_back(targets[(i * 7919) % targets.size()]);
+
+  //----------------------------------------
+  // Overwrite one character in place, then put it back.
+
+  // Identifier ids in the new tokens have to match the ones the tree and the
+  // type scopes were built from. The tree points into the old tokens until
+  // the reparse is done, so we take turns lexing into two lexers.
+  CLexer other_lexer;
+  other_lexer.interner = lexer.interner;
+  CLexer* old_lexer = &lexer;
+  CLexer* new_lexer = &other_lexer;
+
+  std::vector<double> relex_times;
+  auto relex = [&](TextSpan old_text, TextSpan new_text, const SpanEdit& edit) {
+    double time = -utils::timestamp_ms();
+    new_lexer->relex(*old_lexer, old_text, new_text, edit);
+    time += utils::timestamp_ms();
+    relex_times.push_back(time);
+    std::swap(old_lexer, new_lexer);
+    return utils::to_span(old_lexer->tokens);
+  };
+
+  std::vector<double> replace_times;
+  for (auto offset : offsets) {
+    char old_c = buf_a[offset];
+    SpanEdit edit = {offset, offset + 1, offset + 1};
+
+    buf_a[offset] = old_c == 'x' ? 'y' : 'x';
+    auto tokens = relex(text, text, edit);
+    double time = -utils::timestamp_ms();
+    ctx.reparse(text, tokens, edit);
+    time += utils::timestamp_ms();
+    replace_times.push_back(time);
+    check_same(ctx, *old_lexer, text);
+
+    buf_a[offset] = old_c;
+    ctx.reparse(text, relex(text, text, edit), edit);
+  }
+  check_same(ctx, *old_lexer, text);
+
+  //----------------------------------------
+  // Insert one character, which shifts everything after it.
+
+  std::vector<double> insert_times;
+  std::string buf_b;
+  for (auto offset : offsets) {
+    buf_b = buf_a;
+    buf_b.insert(buf_b.begin() + offset, 'x');
+    TextSpan new_text = utils::to_span(buf_b);
+    SpanEdit edit = {offset, offset, offset + 1};
+
+    auto tokens = relex(text, new_text, edit);
+    double time = -utils::timestamp_ms();
+    ctx.reparse(new_text, tokens, edit);
+    time += utils::timestamp_ms();
+    insert_times.push_back(time);
+    check_same(ctx, *old_lexer, new_text);
+
+    // And take it back out again.
+    SpanEdit undo = {offset, offset + 1, offset};
+    ctx.reparse(text, relex(new_text, text, undo), undo);
+  }
+  check_same(ctx, *old_lexer, text);
+
+  //----------------------------------------
+
+  double lex_time     = median(lex_times);
+  double relex_time   = median(relex_times);
+  double full_time    = median(full_times);
+  double replace_time = median(replace_times);
+  double insert_time  = median(insert_times);
+
+  printf("\n");
+  printf("Byte total      %d\n", text.len());
+  printf("Tree nodes      %ld\n", ctx.node_count());
+  printf("Edits           %d\n", reps);
+  printf("Full lex        %f msec\n", lex_time);
+  printf("Incremental lex %f msec (%.1fx faster)\n", relex_time, lex_time / relex_time);
+  printf("Full parse      %f msec\n", full_time);
+  printf("Replace reparse %f msec (%.1fx faster)\n", replace_time, full_time / replace_time);
+  printf("Insert reparse  %f msec (%.1fx faster)\n", insert_time, full_time / insert_time);
+  printf("All incremental tokens and trees matched a full relex and reparse\n");
+  printf("\n");
+
+  return 0;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,155 @@
+// SPDX-FileCopyrightText:  2023 Austin Appleby <aappleby@gmail.com>
+// SPDX-License-Identifier: MIT License
+
+// Measures CContext::parse_stream() against lexing and parsing a whole file
+// up front - how long until the first top-level item is ready, how long the
+// whole thing takes and how many tokens are kept at once - and checks that
+// both build the same tree. Uses a generated source file unless one is given
+// on the command line.
+
+#include "matcheroni/Utilities.hpp"
+
+#include "../c_lexer/CLexer.hpp"
+#include "CContext.hpp"
+#include "CNode.hpp"
+
+#include <algorithm>
+
+using namespace matcheroni;
+using namespace parseroni;
+
+const int reps = 10;
+
+//------------------------------------------------------------------------------
+// Each block's function uses the previous block's typedef, so the parse of
+// every block depends on the types declared before it.
+
+std::string make_source(int count) {
+  std::string source = "#include <stdint.h>\n\n";
+  char buf[1024];
+
+  for (int i = 0; i < count; i++) {
+    int p = i ? i - 1 : 0;
+    snprintf(buf, sizeof(buf),
+      "typedef struct node_%d { int32_t value; struct node_%d* next; } node_%d_t;\n"
+      "static const int table_%d[] = { %d, %d, %d, %d };\n"
+      "\n"
+      "node_%d_t* link_%d(node_%d_t* prev, int x) {\n"
+      "  node_%d_t* n = (node_%d_t*)prev;\n"
+      "  for (int i = 0; i < x; i++) {\n"
+      "    if (i %% 3 == 0) n->value += table_%d[i & 3];\n"
+      "    else { typedef int local_t; x = x * 2 + (local_t)sizeof(node_%d_t); }\n"
+      "  }\n"
+      "  return n->next ? (node_%d_t*)n->next : n;\n"
+      "}\n\n",
+      i, i, i,
+      i, i, i * 3, i ^ 5, i % 11,
+      i, i, p,
+      i, i,
+      i,
+      p,
+      i);
+    source += buf;
+  }
+
+  return source;
+}
+
+// The trees are built on different token arrays, so compare the text they
+// cover.
+bool same_node(CNode* a, CNode* b);
+
+bool same_tree(CNode* a, CNode* b) {
+  for (; a && b; a = a->node_next, b = b->node_next) {
+    if (!same_node(a, b)) return false;
+  }
+  return !a && !b;
+}
+
+bool same_node(CNode* a, CNode* b) {
+  if (a->span.len() != b->span.len()) return false;
+  if (a->span.len() && a->span.begin->text().begin != b->span.begin->text().begin) return false;
+  if (!a->match_tag != !b->match_tag) return false;
+  if (a->match_tag && strcmp(a->match_tag, b->match_tag)) return false;
+  return same_tree(a->child_head, b->child_head);
+}
+
+double median(std::vector<double>& times) {
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+  printf("Matcheroni C streaming parse benchmark\n");
+
+  std::string source = argc > 1 ? utils::read(argv[1]) : make_source(20000);
+  TextSpan text = utils::to_span(source);
+
+  // Whole file - the first item is ready once everything has been parsed.
+  CLexer lexer;
+  CContext full;
+  std::vector<double> full_times;
+  for (int rep = 0; rep < reps; rep++) {
+    double time = -utils::timestamp_ms();
+    lexer.reset();
+    full.reset();
+    lexer.lex(text);
+    full.parse(text, utils::to_span(lexer.tokens));
+    time += utils::timestamp_ms();
+    full_times.push_back(time);
+  }
+
+  if (!full.parse_complete) {
+    printf("Could not parse all of the source\n");
+    return -1;
+  }
+
+  // Streaming
+  CLexer stream_lexer;
+  CContext stream;
+  std::vector<double> stream_times;
+  std::vector<double> first_times;
+  size_t items = 0;
+  size_t peak_tokens = 0;
+
+  for (int rep = 0; rep < reps; rep++) {
+    items = 0;
+    peak_tokens = 0;
+
+    double start = utils::timestamp_ms();
+    stream.reset();
+    stream.parse_stream(text, stream_lexer, [&](CNode*) {
+      if (items++ == 0) first_times.push_back(utils::timestamp_ms() - start);
+      peak_tokens = std::max(peak_tokens, stream_lexer.tokens.size());
+    });
+    stream_times.push_back(utils::timestamp_ms() - start);
+    if (!items) first_times.push_back(stream_times.back());
+  }
+
+  // And once more, checking each item against the whole-file tree as it
+  // arrives.
+  CNode* expected = full.top_head;
+  bool same = true;
+  stream.reset();
+  stream.parse_stream(text, stream_lexer, [&](CNode* node) {
+    if (!expected || !same_node(node, expected)) same = false;
+    if (expected) expected = expected->node_next;
+  });
+  if (expected || !stream.parse_complete) same = false;
+
+  printf("\n");
+  printf("Byte total         %d\n", text.len());
+  printf("Top-level items    %ld\n", items);
+  printf("Whole file         %f msec, first item at %f msec, %ld tokens\n",
+         median(full_times), median(full_times), lexer.tokens.size());
+  printf("Streaming          %f msec, first item at %f msec, %ld tokens at most\n",
+         median(stream_times), median(first_times), peak_tokens);
+  printf("Streamed tree      %s\n", same ? "matches whole file" : "MISMATCH");
+  printf("\n");
+
+  return same ? 0 : -1;
+}
+
+//------------------------------------------------------------------------------
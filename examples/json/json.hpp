@@ -2,28 +2,249 @@
 #include "matcheroni/Matcheroni.hpp"
 #include "matcheroni/Parseroni.hpp"
 
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
 struct JsonMatchContext : public matcheroni::TextMatchContext {
 };
 
 matcheroni::TextSpan match_json(JsonMatchContext& ctx, matcheroni::TextSpan body);
 
+// Matches one value with no whitespace around it.
+matcheroni::TextSpan match_json_value(JsonMatchContext& ctx, matcheroni::TextSpan body);
+
 // JsonNodes are basically the same as TextNodes
 struct JsonNode : public parseroni::NodeBase<JsonNode, char> {
-  virtual ~JsonNode() {}
   matcheroni::TextSpan as_text_span() const { return span; }
 };
 
-struct JsonNumber  : public JsonNode {};
-struct JsonString  : public JsonNode {};
+// Numbers are decoded the first time they're asked for and the result is kept
+// in the node, or while parsing if the context has 'eager_numbers' set.
+struct JsonNumber : public JsonNode {
+  double as_double() const {
+    if (!decoded) decode();
+    return value_double;
+  }
+
+  int64_t as_int64() const {
+    if (!decoded) decode();
+    return value_int;
+  }
+
+  void decode() const;
+
+  mutable double  value_double = 0;
+  mutable int64_t value_int = 0;
+  mutable bool    decoded = false;
+};
+
+struct JsonParseContext;
+
+struct JsonString : public JsonNode {
+  // The text between the quotes with its escapes decoded. Without escapes
+  // that's the source text itself, otherwise the decoded copy goes in the
+  // context's arena until the next reset. Fails for strings that don't fit
+  // in one arena slab.
+  matcheroni::TextSpan text(JsonParseContext& ctx) const;
+
+  // Compares the decoded text with 'text', and hashes it the same way as
+  // hash_json_text(), decoding escapes on the fly instead of into the arena.
+  bool equals(matcheroni::TextSpan text) const;
+  uint32_t hash() const;
+};
 struct JsonArray   : public JsonNode {};
 struct JsonKeyVal  : public JsonNode {};
-struct JsonObject  : public JsonNode {};
+
+struct JsonObject : public JsonNode {
+  // Returns the value of the first member named 'key', or nullptr. Keys are
+  // compared with their escapes decoded. Objects with more than a handful of
+  // members build an open-addressed table of key hashes in the context's arena
+  // on their first lookup, so later ones don't have to walk the members.
+  JsonNode* get(JsonParseContext& ctx, matcheroni::TextSpan key);
+
+  struct Slot {
+    uint32_t hash;
+    JsonNode* member;  // nullptr if the slot is empty
+  };
+
+  Slot* index = nullptr;   // Power-of-two size, open addressed
+  uint32_t index_mask = 0;
+};
 struct JsonKeyword : public JsonNode {};
 
-// Our nodes don't have anything to construct or destruct, so we turn
-// constructors and destructors off during parsing.
+// Our nodes don't have anything to destruct, so the context runs in bump mode
+// and rewinds/resets never have to visit them. Don't add a virtual destructor.
+static_assert(std::is_trivially_destructible_v<JsonNode>);
+
 struct JsonParseContext : public parseroni::NodeContext<JsonNode, true, true> {
   static int atom_cmp(char a, int b) { return (unsigned char)a - b; }
+
+  // Decode every number as it's captured instead of on first use.
+  bool eager_numbers = false;
 };
 
+// Scans the JSON string whose opening quote is at 'a'. Returns the byte after
+// the closing quote, or nullptr if the string isn't closed before 'b' or has a
+// control character, a bad escape or malformed UTF-8 in it.
+const char* scan_json_string(const char* a, const char* b);
+
+// Finds the end of the string whose opening quote is at 'a' without checking
+// its contents - only for text that's been checked already, or that the caller
+// is skipping over. Returns nullptr if the string isn't closed before 'b'.
+const char* find_json_string_end(const char* a, const char* b);
+
+// Writes the contents of the quoted string 'text' to 'out' with the escapes
+// decoded and returns the decoded length, which is never more than the
+// length of 'text'. 'text' must have been accepted by scan_json_string().
+size_t unescape_json_string(matcheroni::TextSpan text, char* out);
+
+// Whether the quoted string 'quoted' decodes to 'text', without copying it
+// anywhere. 'quoted' must have been accepted by scan_json_string().
+bool json_string_equals(matcheroni::TextSpan quoted, matcheroni::TextSpan text);
+
+// FNV-1a hash of some decoded text.
+uint32_t hash_json_text(matcheroni::TextSpan text);
+
+// Converts the text of a JSON number to the nearest double, the same as strtod,
+// and to an int64_t - exactly if it's an integer that fits, otherwise by
+// truncating the double and clamping it to the int64_t range.
+void decode_json_number(matcheroni::TextSpan text, double& d, int64_t& i);
+
 matcheroni::TextSpan parse_json(JsonParseContext& ctx, matcheroni::TextSpan body);
+
+// Evaluates the JSON Pointer (RFC 6901) 'pointer' against the value 'root' and
+// returns the value it refers to, or nullptr if there isn't one. Object
+// members are looked up with JsonObject::get() and array elements by index.
+JsonNode* json_pointer(JsonParseContext& ctx, JsonNode* root, matcheroni::TextSpan pointer);
+
+// Updates the tree from a successful parse_json(old_text) to match new_text,
+// reusing every value outside the edited one. Falls back to a full parse if
+// the edit doesn't fall inside a value that can be rematched on its own.
+// Objects containing the edit drop their member index and rebuild it on their
+// next lookup. Returns the same tail parse_json(new_text) would.
+matcheroni::TextSpan reparse_json(JsonParseContext& ctx,
+                                  matcheroni::TextSpan old_text,
+                                  matcheroni::TextSpan new_text,
+                                  const parseroni::SpanEdit& edit);
+
+//------------------------------------------------------------------------------
+// Writes a parsed tree back out as JSON, optionally with some of its values
+// replaced or removed. Values with no edits under them are written straight
+// from their source text - as-is, with the whitespace stripped, or re-indented
+// - so only the containers around an edit are walked node by node. Edits live
+// in side tables keyed by node, so the tree itself is never touched.
+//
+// Output goes to 'out', or to 'fd' if it's set. File output is gathered into
+// batches of iovecs for writev(), and long runs of unchanged source text are
+// handed to the kernel without being copied.
+
+struct JsonWriter {
+  enum Style {
+    VERBATIM,  // Source text as it was, edits included
+    MINIFY,    // No whitespace outside strings
+    PRETTY,    // One value per line, indented by 'indent' spaces per level
+  };
+
+  // 'json' must be a valid JSON value and must outlive the writes.
+  void replace(const JsonNode* node, matcheroni::TextSpan json);
+
+  // Drops an array element or an object member - a member's value works too.
+  void remove(const JsonNode* node);
+
+  void clear_edits();
+
+  // Appends 'root' and its edits to the output. Returns false if writing to
+  // 'fd' failed.
+  bool write(const JsonNode* root);
+
+  // Writes out anything still batched for 'fd'.
+  bool flush();
+
+  Style style = VERBATIM;
+  int indent = 2;
+  int fd = -1;
+
+  std::string out;           // The output, or the batch waiting for 'fd'
+  size_t bytes_written = 0;  // To 'fd'
+  bool failed = false;
+
+  //----------------------------------------
+
+  struct Chunk {
+    const char* source;  // nullptr if the bytes are in 'out'
+    size_t offset;
+    size_t len;
+  };
+
+  void emit_value(const JsonNode* node);
+  void emit_container(const JsonNode* node);
+  void emit_text(matcheroni::TextSpan text);
+  void emit_minified(matcheroni::TextSpan text);
+  void emit_pretty(matcheroni::TextSpan text);
+  void emit_source(const char* a, const char* b);
+  void newline();
+  void cut();
+  void maybe_flush();
+
+  std::unordered_map<const JsonNode*, matcheroni::TextSpan> replaced;
+  std::unordered_set<const JsonNode*> removed;
+  std::unordered_set<const JsonNode*> dirty;  // Has an edit somewhere under it
+
+  std::vector<Chunk> chunks;
+  size_t out_flushed = 0;    // Bytes of 'out' already in a chunk
+
+  // Pretty printing state, carried across pieces of source text.
+  int level = 0;
+  enum { NONE, OPENED, SEPARATED } pending = NONE;
+};
+
+//------------------------------------------------------------------------------
+// A position in a JSON document that hasn't been parsed, for reading a few
+// values out of a big document without building its tree. Moving to a member
+// or an element skips everything in front of it by counting brackets and
+// jumping over strings, without checking any of it. Only the values that are
+// asked for are checked - with the match grammar - and decoded or parsed.
+//
+// Cursors are plain values. A failed step gives a cursor that isn't valid, and
+// every step from one of those fails too, so lookups can be chained and
+// checked once at the end.
+
+struct JsonCursor {
+  JsonCursor() {}
+
+  // The value at the start of 'text', after any whitespace.
+  explicit JsonCursor(matcheroni::TextSpan text);
+
+  bool is_valid() const { return body.is_valid(); }
+
+  // The first character of the value - '{', '[', '"', 't', 'f', 'n', '-' or a
+  // digit - or 0 if the cursor isn't valid.
+  char kind() const { return is_valid() ? body.begin[0] : 0; }
+
+  // The value of the first member of this object named 'key'.
+  JsonCursor field(matcheroni::TextSpan key) const;
+
+  // Element 'index' of this array.
+  JsonCursor at(size_t index) const;
+
+  // The first element of this array, and the element after this one.
+  JsonCursor first() const;
+  JsonCursor next() const;
+
+  // The text of the value, once it's been checked. Fails if it isn't valid.
+  matcheroni::TextSpan span() const;
+
+  // Decode the value. Strings are returned in place if they have no escapes,
+  // otherwise they're decoded into 'scratch'. Return false if the value isn't
+  // valid or isn't of the asked-for type.
+  bool as_double(double& d) const;
+  bool as_int64(int64_t& i) const;
+  bool as_string(matcheroni::TextSpan& text, std::string& scratch) const;
+
+  // Parses just this value into 'ctx' and returns its node.
+  JsonNode* parse(JsonParseContext& ctx) const;
+
+  matcheroni::TextSpan body;  // From the value to the end of the document
+};
@@ -18,12 +18,10 @@ using namespace matcheroni;
 
 #if 0
 // Debug config
-constexpr bool verbose   = true;
 constexpr bool dump_tree = true;
 const int reps = 1;
 #else
 // Benchmark config
-constexpr bool verbose   = false;
 constexpr bool dump_tree = false;
 const int reps = 100;
 #endif
@@ -31,6 +29,35 @@ const int reps = 100;
 #define MATCH
 #define PARSE
 
+//------------------------------------------------------------------------------
+// Calls as_double() on every number in the tree. Numbers are the only values
+// that start with '-' or a digit.
+
+double decode_numbers(JsonNode* node) {
+  double sum = 0;
+  for (auto n = node; n; n = n->node_next) {
+    auto c = n->span.begin[0];
+    if (c == '-' || (c >= '0' && c <= '9')) sum += ((JsonNumber*)n)->as_double();
+    sum += decode_numbers(n->child_head);
+  }
+  return sum;
+}
+
+// Decodes every string in the tree, keys included. Members start with a quote
+// too, so skip those.
+
+size_t decode_strings(JsonParseContext& ctx, JsonNode* node) {
+  size_t len = 0;
+  for (auto n = node; n; n = n->node_next) {
+    if (n->span.begin[0] == '"' && !n->tag_is("member")) {
+      auto text = ((JsonString*)n)->text(ctx);
+      len += text.end - text.begin;
+    }
+    len += decode_strings(ctx, n->child_head);
+  }
+  return len;
+}
+
 //------------------------------------------------------------------------------
 
 int main(int argc, char** argv) {
@@ -47,6 +74,12 @@ int main(int argc, char** argv) {
   double all_line_accum = 0;
   double all_match_time = 0;
   double all_parse_time = 0;
+  double all_reset_time = 0;
+  double all_lazy_time = 0;
+  double all_eager_time = 0;
+  double all_string_time = 0;
+  double all_minify_time = 0;
+  double all_pretty_time = 0;
 
   JsonMatchContext ctx1;
   JsonParseContext ctx2;
@@ -56,6 +89,12 @@ int main(int argc, char** argv) {
     double line_accum = 0;
     double match_time = 0;
     double parse_time = 0;
+    double reset_time = 0;
+    double lazy_time = 0;
+    double eager_time = 0;
+    double string_time = 0;
+    double minify_time = 0;
+    double pretty_time = 0;
 
     printf("----------------------------------------\n");
     printf("Parsing %s\n", path);
@@ -68,9 +107,9 @@ int main(int argc, char** argv) {
     }
 
     byte_accum += buf.size();
-    for (size_t i = 0; i < buf.size(); i++) if (buf[i] == '\n') line_accum++;
-
     TextSpan text = utils::to_span(buf);
+    utils::LineIndex lines(text);
+    line_accum += lines.line_count();
 
     //----------------------------------------
 
@@ -90,11 +129,9 @@ int main(int argc, char** argv) {
     match_time += match_times[reps/2];
 
 #ifdef MATCH
-    if (match_end.begin < text.end) {
-      printf("Match failed!\n");
-      printf("Failure near `");
-      printf("%50.50s", match_end.begin);
-      printf("`\n");
+    if (!match_end.is_valid() || match_end.begin < text.end) {
+      auto near = match_end.is_valid() ? match_end.begin : text.begin;
+      utils::print_location(path, lines, near, "Match failed!");
       exit(-1);
     }
 #endif
@@ -103,10 +140,15 @@ int main(int argc, char** argv) {
 
     TextSpan parse_end = text;
     std::vector<double> parse_times;
+    std::vector<double> reset_times;
     parse_times.reserve(reps);
+    reset_times.reserve(reps);
     for (int rep = 0; rep < reps; rep++) {
       double time = -utils::timestamp_ms();
+      double reset = time;
       ctx2.reset();
+      reset += utils::timestamp_ms();
+      reset_times.push_back(reset);
 #ifdef PARSE
       parse_end = parse_json(ctx2, text);
 #endif
@@ -115,17 +157,88 @@ int main(int argc, char** argv) {
     }
     std::sort(parse_times.begin(), parse_times.end());
     parse_time += parse_times[reps/2];
+    std::sort(reset_times.begin(), reset_times.end());
+    reset_time += reset_times[reps/2];
 
 #ifdef PARSE
-    if (parse_end.begin < text.end) {
-      printf("Parse failed!\n");
-      printf("Failure near `");
-      printf("%50.50s\n", ctx2._highwater);
-      printf("`\n");
+    if (!parse_end.is_valid() || parse_end.begin < text.end) {
+      // A failed parse leaves behind the values it did match, so the last one
+      // ends close to the error.
+      auto near = text.begin;
+      if (parse_end.is_valid()) near = parse_end.begin;
+      else if (ctx2.top_tail) near = ctx2.top_tail->span.end;
+      utils::print_location(path, lines, near, "Parse failed!");
       exit(-1);
     }
 #endif
 
+    //----------------------------------------
+    // Numbers decoded on first use after the parse, and during the parse.
+
+#ifdef PARSE
+    std::vector<double> lazy_times;
+    std::vector<double> eager_times;
+    std::vector<double> string_times;
+    for (int rep = 0; rep < reps; rep++) {
+      ctx2.reset();
+      parse_json(ctx2, text);
+      double time = -utils::timestamp_ms();
+      decode_numbers(ctx2.top_head);
+      time += utils::timestamp_ms();
+      lazy_times.push_back(time);
+
+      time = -utils::timestamp_ms();
+      decode_strings(ctx2, ctx2.top_head);
+      time += utils::timestamp_ms();
+      string_times.push_back(time);
+    }
+    ctx2.eager_numbers = true;
+    for (int rep = 0; rep < reps; rep++) {
+      ctx2.reset();
+      double time = -utils::timestamp_ms();
+      parse_json(ctx2, text);
+      time += utils::timestamp_ms();
+      eager_times.push_back(time);
+    }
+    ctx2.eager_numbers = false;
+    std::sort(lazy_times.begin(), lazy_times.end());
+    lazy_time += lazy_times[reps/2];
+    std::sort(eager_times.begin(), eager_times.end());
+    eager_time += eager_times[reps/2];
+    std::sort(string_times.begin(), string_times.end());
+    string_time += string_times[reps/2];
+#endif
+
+    //----------------------------------------
+    // Writing the tree back out with the whitespace stripped and re-indented.
+
+#ifdef PARSE
+    ctx2.reset();
+    parse_json(ctx2, text);
+    JsonWriter writer;
+    std::vector<double> minify_times;
+    std::vector<double> pretty_times;
+    for (int rep = 0; rep < reps; rep++) {
+      writer.style = JsonWriter::MINIFY;
+      writer.out.clear();
+      double time = -utils::timestamp_ms();
+      writer.write(ctx2.top_head);
+      time += utils::timestamp_ms();
+      minify_times.push_back(time);
+
+      writer.style = JsonWriter::PRETTY;
+      writer.out.clear();
+      time = -utils::timestamp_ms();
+      writer.write(ctx2.top_head);
+      time += utils::timestamp_ms();
+      pretty_times.push_back(time);
+    }
+    std::sort(minify_times.begin(), minify_times.end());
+    minify_time += minify_times[reps/2];
+    std::sort(pretty_times.begin(), pretty_times.end());
+    pretty_time += pretty_times[reps/2];
+#endif
+
     //----------------------------------------
 
     if (dump_tree) {
@@ -133,27 +246,76 @@ int main(int argc, char** argv) {
       utils::print_summary(ctx2, text, parse_end, 40);
     }
 
-    if (verbose) {
-      //printf("Slab current      %d\n",  LifoAlloc::inst().current_size);
-      //printf("Slab max          %d\n",  LifoAlloc::inst().max_size);
-      //printf("Sizeof(node) == %ld\n", sizeof(JsonNode));
-    }
+    //----------------------------------------
+    // Intern the tree to see how much of it is repeated structure. Nothing
+    // is shared, so the deduped size is what the tree would take if it were.
+
+    utils::SubtreeInterner<JsonNode> interner;
+    double intern_time = -utils::timestamp_ms();
+    interner.intern(ctx2);
+    intern_time += utils::timestamp_ms();
+
+    double unique_nodes = interner.unique_count();
+    double total_nodes = interner.node_total;
+
+    // Numbers are bigger than the other nodes, and arrays carry their item
+    // array in the same allocation.
+    auto node_bytes = [](JsonNode* n) -> size_t {
+      if (n->has_items()) {
+        return (n->flags >> JsonNode::list_offset_shift) + sizeof(size_t) + n->item_count() * sizeof(JsonNode*);
+      }
+      if (n->tag_is("member")) return sizeof(JsonKeyVal);
+      switch (n->span.begin[0]) {
+        case '"': return sizeof(JsonString);
+        case '{': return sizeof(JsonObject);
+        case '[': return sizeof(JsonArray);
+        case 't': case 'f': case 'n': return sizeof(JsonKeyword);
+        default: return sizeof(JsonNumber);
+      }
+    };
+    double deduped_bytes = interner.unique_bytes(node_bytes);
+
+    //----------------------------------------
+
+    // Arena bytes include the size trailers if the context isn't in bump mode.
+    double node_count = ctx2.node_count();
+    double arena_bytes = ctx2.alloc.current_size();
 
     printf("\n");
     printf("Tree nodes %ld\n", ctx2.node_count());
+    printf("Arena bytes %f\n", arena_bytes);
+    printf("Bytes per node %f\n", arena_bytes / node_count);
+    printf("Arena bytes per input byte %f\n", arena_bytes / byte_accum);
+    printf("Unique subtrees %f\n", unique_nodes);
+    printf("Dedup ratio %f\n", total_nodes / unique_nodes);
+    printf("Tree bytes if deduped (estimate) %f\n", deduped_bytes);
+    printf("Intern table bytes %ld\n", interner.table_bytes());
+    printf("Intern time %f\n", intern_time);
     printf("Byte total %f\n", byte_accum);
     printf("Line total %f\n", line_accum);
     printf("Match time %f\n", match_time);
     printf("Parse time %f\n", parse_time);
+    printf("Reset time %f\n", reset_time);
+    printf("Lazy decode time %f, %+.1f%% over parse\n", lazy_time, 100.0 * lazy_time / parse_time);
+    printf("Eager parse time %f, %+.1f%% over parse\n", eager_time, 100.0 * (eager_time - parse_time) / parse_time);
+    printf("String decode time %f, %+.1f%% over parse\n", string_time, 100.0 * string_time / parse_time);
     printf("Match byte rate  %f megabytes per second\n", (byte_accum / 1e6) / (match_time / 1e3));
     printf("Match line rate  %f megalines per second\n", (line_accum / 1e6) / (match_time / 1e3));
     printf("Parse byte rate  %f megabytes per second\n", (byte_accum / 1e6) / (parse_time / 1e3));
     printf("Parse line rate  %f megalines per second\n", (line_accum / 1e6) / (parse_time / 1e3));
+    printf("Minify byte rate %f megabytes per second\n", (byte_accum / 1e6) / (minify_time / 1e3));
+    printf("Pretty byte rate %f megabytes per second\n", (byte_accum / 1e6) / (pretty_time / 1e3));
 
     all_byte_accum += byte_accum;
     all_line_accum += line_accum;
     all_match_time += match_time;
     all_parse_time += parse_time;
+    all_reset_time += reset_time;
+    all_lazy_time += lazy_time;
+    all_eager_time += eager_time;
+    all_string_time += string_time;
+    all_minify_time += minify_time;
+    all_pretty_time += pretty_time;
   }
 
   printf("----------------------------------------\n");
@@ -163,10 +325,18 @@ int main(int argc, char** argv) {
   printf("Line total %f\n", all_line_accum);
   printf("Match time %f\n", all_match_time);
   printf("Parse time %f\n", all_parse_time);
+  printf("Reset time %f\n", all_reset_time);
+  printf("Lazy decode time %f, %+.1f%% over parse\n", all_lazy_time, 100.0 * all_lazy_time / all_parse_time);
+  printf("Eager parse time %f, %+.1f%% over parse\n", all_eager_time, 100.0 * (all_eager_time - all_parse_time) / all_parse_time);
+  printf("String decode time %f, %+.1f%% over parse\n", all_string_time, 100.0 * all_string_time / all_parse_time);
   printf("Match byte rate  %f megabytes per second\n", (all_byte_accum / 1e6) / (all_match_time / 1e3));
   printf("Match line rate  %f megalines per second\n", (all_line_accum / 1e6) / (all_match_time / 1e3));
   printf("Parse byte rate  %f megabytes per second\n", (all_byte_accum / 1e6) / (all_parse_time / 1e3));
   printf("Parse line rate  %f megalines per second\n", (all_line_accum / 1e6) / (all_parse_time / 1e3));
+  printf("Minify byte rate %f megabytes per second\n", (all_byte_accum / 1e6) / (all_minify_time / 1e3));
+  printf("Pretty byte rate %f megabytes per second\n", (all_byte_accum / 1e6) / (all_pretty_time / 1e3));
+  printf("Peak arena bytes %ld\n", ctx2.alloc.peak_size());
+  printf("Peak RSS bytes   %ld\n", utils::peak_rss());
   printf("\n");
 
   return 0;
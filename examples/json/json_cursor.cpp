@@ -0,0 +1,263 @@
+// SPDX-FileCopyrightText:  2023 Austin Appleby <aappleby@gmail.com>
+// SPDX-License-Identifier: MIT License
+
+#include "json.hpp"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace matcheroni;
+
+namespace {
+
+inline bool is_ws(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+inline const char* skip_ws(const char* a, const char* b) {
+  while (a < b && is_ws(*a)) a++;
+  return a;
+}
+
+//------------------------------------------------------------------------------
+// Containers are skipped 64 bytes at a time. Each block becomes bitmasks of its
+// quotes, backslashes and brackets; the quotes that aren't escaped mark where
+// strings start and end, and a prefix XOR over them covers every byte inside
+// a string. The brackets left over change the depth, and the bits only have
+// to be walked one at a time in a block where the depth could reach zero.
+
+struct Masks {
+  uint64_t quote, backslash, open, close;
+};
+
+Masks block_masks(const char* p) {
+  Masks m;
+#if defined(__SSE2__)
+  auto quote = _mm_set1_epi8('"');
+  auto backslash = _mm_set1_epi8('\\');
+  // '[' and ']' differ from '{' and '}' only in bit 5.
+  auto fold = _mm_set1_epi8(0x20);
+  auto open = _mm_set1_epi8('{');
+  auto close = _mm_set1_epi8('}');
+  m = {0, 0, 0, 0};
+  for (int i = 0; i < 4; i++) {
+    auto x = _mm_loadu_si128((const __m128i*)(p + 16 * i));
+    auto y = _mm_or_si128(x, fold);
+    m.quote     |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(x, quote))))     << (16 * i);
+    m.backslash |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(x, backslash)))) << (16 * i);
+    m.open      |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(y, open))))      << (16 * i);
+    m.close     |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(y, close))))     << (16 * i);
+  }
+#else
+  m = {0, 0, 0, 0};
+  for (int i = 0; i < 64; i++) {
+    uint64_t bit = uint64_t(1) << i;
+    if (p[i] == '"') m.quote |= bit;
+    if (p[i] == '\\') m.backslash |= bit;
+    if ((p[i] | 0x20) == '{') m.open |= bit;
+    if ((p[i] | 0x20) == '}') m.close |= bit;
+  }
+#endif
+  return m;
+}
+
+// The bytes escaped by a backslash - the ones after each odd-length run of
+// backslashes. 'carry' says whether the first byte of the next block is.
+uint64_t escaped_bits(uint64_t backslash, uint64_t& carry) {
+  const uint64_t even_bits = 0x5555555555555555ull;
+  backslash &= ~carry;
+  uint64_t follows_escape = (backslash << 1) | carry;
+  uint64_t odd_starts = backslash & ~even_bits & ~follows_escape;
+  uint64_t sequences_on_even;
+  carry = __builtin_add_overflow(odd_starts, backslash, &sequences_on_even);
+  uint64_t invert = sequences_on_even << 1;
+  return (even_bits ^ invert) & follows_escape;
+}
+
+uint64_t prefix_xor(uint64_t x) {
+  x ^= x << 1;
+  x ^= x << 2;
+  x ^= x << 4;
+  x ^= x << 8;
+  x ^= x << 16;
+  x ^= x << 32;
+  return x;
+}
+
+const char* skip_container(const char* a, const char* b) {
+  uint64_t escape_carry = 0;
+  uint64_t string_carry = 0;
+  int depth = 0;
+  char tail[64];
+
+  for (; a < b; a += 64) {
+    auto p = a;
+    if (b - a < 64) {
+      memset(tail, ' ', sizeof(tail));
+      memcpy(tail, a, b - a);
+      p = tail;
+    }
+
+    auto m = block_masks(p);
+    auto quote = m.quote & ~escaped_bits(m.backslash, escape_carry);
+    auto in_string = prefix_xor(quote) ^ string_carry;
+    string_carry = uint64_t(int64_t(in_string) >> 63);
+
+    auto open = m.open & ~in_string;
+    auto close = m.close & ~in_string;
+    int closes = __builtin_popcountll(close);
+    if (depth > closes) {
+      depth += __builtin_popcountll(open) - closes;
+      continue;
+    }
+
+    for (auto bits = open | close; bits; bits &= bits - 1) {
+      auto i = __builtin_ctzll(bits);
+      depth += (open >> i) & 1 ? 1 : -1;
+      if (depth == 0) return a + i + 1;
+    }
+  }
+  return nullptr;
+}
+
+//------------------------------------------------------------------------------
+
+// The end of the value at 'a', found without looking at anything but quotes,
+// backslashes and brackets. Returns nullptr if the value runs off the end.
+const char* skip_value(const char* a, const char* b) {
+  if (a == b) return nullptr;
+
+  auto c = *a;
+  if (c == '"') return find_json_string_end(a, b);
+
+  if (c == '{' || c == '[') return skip_container(a, b);
+
+  // Numbers and keywords run to the next separator.
+  auto start = a;
+  while (a < b && !is_ws(*a) && *a != ',' && *a != ']' && *a != '}' && *a != ':') a++;
+  return a == start ? nullptr : a;
+}
+
+// Compares the quoted key at 'raw' with 'key', decoding the key's escapes
+// first if it has any.
+bool same_key(TextSpan raw, TextSpan key) {
+  auto inner = TextSpan(raw.begin + 1, raw.end - 1);
+  if (!memchr(inner.begin, '\\', inner.len())) {
+    return inner.len() == key.len() && memcmp(inner.begin, key.begin, key.len()) == 0;
+  }
+  if (inner.len() < key.len()) return false;
+  if (scan_json_string(raw.begin, raw.end) != raw.end) return false;
+  return json_string_equals(raw, key);
+}
+
+}; // namespace
+
+//------------------------------------------------------------------------------
+
+JsonCursor::JsonCursor(TextSpan text) {
+  auto a = skip_ws(text.begin, text.end);
+  if (a < text.end) body = TextSpan(a, text.end);
+}
+
+JsonCursor JsonCursor::field(TextSpan key) const {
+  if (kind() != '{') return JsonCursor();
+  auto b = body.end;
+  auto a = skip_ws(body.begin + 1, b);
+
+  while (a < b && *a == '"') {
+    auto key_end = find_json_string_end(a, b);
+    if (!key_end) break;
+    bool match = same_key(TextSpan(a, key_end), key);
+
+    a = skip_ws(key_end, b);
+    if (a == b || *a != ':') break;
+    a = skip_ws(a + 1, b);
+    if (match) return JsonCursor(TextSpan(a, b));
+
+    a = skip_value(a, b);
+    if (!a) break;
+    a = skip_ws(a, b);
+    if (a == b || *a != ',') break;
+    a = skip_ws(a + 1, b);
+  }
+  return JsonCursor();
+}
+
+JsonCursor JsonCursor::at(size_t index) const {
+  auto c = first();
+  for (; c.is_valid() && index; index--) c = c.next();
+  return c;
+}
+
+JsonCursor JsonCursor::first() const {
+  if (kind() != '[') return JsonCursor();
+  auto a = skip_ws(body.begin + 1, body.end);
+  if (a == body.end || *a == ']') return JsonCursor();
+  return JsonCursor(TextSpan(a, body.end));
+}
+
+JsonCursor JsonCursor::next() const {
+  if (!is_valid()) return JsonCursor();
+  auto a = skip_value(body.begin, body.end);
+  if (!a) return JsonCursor();
+  a = skip_ws(a, body.end);
+  if (a == body.end || *a != ',') return JsonCursor();
+  return JsonCursor(TextSpan(a + 1, body.end));
+}
+
+//------------------------------------------------------------------------------
+
+TextSpan JsonCursor::span() const {
+  if (!is_valid()) return body;
+  JsonMatchContext ctx;
+  auto tail = match_json_value(ctx, body);
+  return tail.is_valid() ? TextSpan(body.begin, tail.begin) : tail;
+}
+
+bool JsonCursor::as_double(double& d) const {
+  auto c = kind();
+  if (c != '-' && (c < '0' || c > '9')) return false;
+  auto text = span();
+  if (!text.is_valid()) return false;
+  int64_t i;
+  decode_json_number(text, d, i);
+  return true;
+}
+
+bool JsonCursor::as_int64(int64_t& i) const {
+  auto c = kind();
+  if (c != '-' && (c < '0' || c > '9')) return false;
+  auto text = span();
+  if (!text.is_valid()) return false;
+  double d;
+  decode_json_number(text, d, i);
+  return true;
+}
+
+bool JsonCursor::as_string(TextSpan& text, std::string& scratch) const {
+  if (kind() != '"') return false;
+  auto end = scan_json_string(body.begin, body.end);
+  if (!end) return false;
+
+  auto raw = TextSpan(body.begin, end);
+  if (!memchr(raw.begin, '\\', raw.len())) {
+    text = TextSpan(raw.begin + 1, raw.end - 1);
+    return true;
+  }
+  scratch.resize(raw.len());
+  scratch.resize(unescape_json_string(raw, scratch.data()));
+  text = TextSpan(scratch.data(), scratch.data() + scratch.size());
+  return true;
+}
+
+JsonNode* JsonCursor::parse(JsonParseContext& ctx) const {
+  auto text = span();
+  if (!text.is_valid()) return nullptr;
+  auto tail = parse_json(ctx, text);
+  return tail.is_valid() ? ctx.top_tail : nullptr;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,128 @@
+//------------------------------------------------------------------------------
+// Measures parsing array-heavy JSON with arrays captured by CaptureList<>, and
+// how long it takes to get at array elements by index through the item array
+// compared to walking the child list.
+
+// Example usage:
+// bin/json_list_benchmark data/canada.json
+
+// SPDX-FileCopyrightText:  2023 Austin Appleby <aappleby@gmail.com>
+// SPDX-License-Identifier: MIT License
+
+#include "json.hpp"
+#include "matcheroni/Utilities.hpp"
+
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+
+using namespace matcheroni;
+using namespace parseroni;
+
+const int reps = 100;
+const int probes = 16;
+
+//------------------------------------------------------------------------------
+
+void find_arrays(JsonNode* node, std::vector<JsonNode*>& out) {
+  for (auto c = node; c; c = c->node_next) {
+    if (c->has_items()) out.push_back(c);
+    find_arrays(c->child_head, out);
+  }
+}
+
+JsonNode* walk_to(JsonNode* node, size_t index) {
+  auto c = node->child_head;
+  for (; c && index; index--) c = c->node_next;
+  return c;
+}
+
+double median(std::vector<double>& times) {
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+  printf("Matcheroni JSON list capture benchmark\n");
+
+  const char* path = argc > 1 ? argv[1] : "data/canada.json";
+
+  std::string buf;
+  utils::read(path, buf);
+  if (buf.size() == 0) {
+    printf("Could not load %s\n", path);
+    return -1;
+  }
+  TextSpan text = utils::to_span(buf);
+
+  JsonParseContext ctx;
+
+  std::vector<double> parse_times;
+  for (int rep = 0; rep < reps; rep++) {
+    double time = -utils::timestamp_ms();
+    ctx.reset();
+    auto tail = parse_json(ctx, text);
+    time += utils::timestamp_ms();
+    matcheroni_assert(tail.is_valid() && tail.is_empty());
+    parse_times.push_back(time);
+  }
+
+  std::vector<JsonNode*> arrays;
+  find_arrays(ctx.top_head, arrays);
+
+  size_t item_total = 0;
+  size_t item_max = 0;
+  for (auto a : arrays) {
+    item_total += a->item_count();
+    item_max = std::max(item_max, a->item_count());
+  }
+
+  //----------------------------------------
+  // Look up a spread of indices in every array, both ways.
+
+  uint64_t sum_items = 0;
+  double items_time = -utils::timestamp_ms();
+  for (auto a : arrays) {
+    auto count = a->item_count();
+    for (int i = 0; i < probes; i++) {
+      sum_items += uint64_t(a->item(count * i / probes));
+    }
+  }
+  items_time += utils::timestamp_ms();
+
+  uint64_t sum_walk = 0;
+  double walk_time = -utils::timestamp_ms();
+  for (auto a : arrays) {
+    auto count = a->item_count();
+    for (int i = 0; i < probes; i++) {
+      sum_walk += uint64_t(walk_to(a, count * i / probes));
+    }
+  }
+  walk_time += utils::timestamp_ms();
+
+  if (sum_items != sum_walk) {
+    printf("Item array doesn't match the child list!\n");
+    return -1;
+  }
+
+  //----------------------------------------
+
+  double lookups = double(arrays.size()) * probes;
+
+  printf("\n");
+  printf("File               %s\n", path);
+  printf("Byte total         %d\n", text.len());
+  printf("Tree nodes         %ld\n", ctx.node_count());
+  printf("Arrays             %ld\n", arrays.size());
+  printf("Array items        %ld (longest %ld)\n", item_total, item_max);
+  printf("Parse time         %f msec\n", median(parse_times));
+  printf("Indexed lookup     %f nsec\n", items_time * 1e6 / lookups);
+  printf("Child list lookup  %f nsec\n", walk_time * 1e6 / lookups);
+  printf("\n");
+
+  return 0;
+}
+
+//------------------------------------------------------------------------------
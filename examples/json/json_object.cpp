@@ -0,0 +1,133 @@
+// SPDX-FileCopyrightText:  2023 Austin Appleby <aappleby@gmail.com>
+// SPDX-License-Identifier: MIT License
+
+#include "json.hpp"
+
+#include <string.h>
+#include <string>
+
+using namespace matcheroni;
+
+//------------------------------------------------------------------------------
+// Objects up to this many members are searched by walking them - comparing a
+// handful of short keys is about as quick as hashing one.
+
+namespace {
+
+const int small_object = 8;
+
+// Keys are compared with their escapes decoded on the fly, so lookups never
+// allocate.
+inline bool same_key(const JsonNode* member, TextSpan key) {
+  return ((JsonString*)member->child_head)->equals(key);
+}
+
+}; // namespace
+
+//------------------------------------------------------------------------------
+
+JsonNode* JsonObject::get(JsonParseContext& ctx, TextSpan key) {
+  if (!index) {
+    auto m = child_head;
+    for (int i = 0; m && i < small_object; i++, m = m->node_next) {
+      if (same_key(m, key)) return m->child_head->node_next;
+    }
+    if (!m) return nullptr;
+
+    // Big object - index every member. Members go in in order and a probe
+    // stops at the first match, so the first of any duplicates wins the same
+    // as in the walk above.
+    uint32_t count = 0;
+    for (auto c = child_head; c; c = c->node_next) count++;
+    uint32_t size = 16;
+    while (size < count * 2) size *= 2;
+
+    // Tables too big for the arena fall back to walking the rest.
+    Slot* slots = nullptr;
+    if (size * sizeof(Slot) <= size_t(parseroni::LifoAlloc::slab_size)) {
+      slots = (Slot*)ctx.alloc.bump(int(size * sizeof(Slot)));
+    }
+    if (!slots) {
+      for (; m; m = m->node_next) {
+        if (same_key(m, key)) return m->child_head->node_next;
+      }
+      return nullptr;
+    }
+    memset(slots, 0, size * sizeof(Slot));
+
+    for (auto c = child_head; c; c = c->node_next) {
+      auto h = ((JsonString*)c->child_head)->hash();
+      auto i = h & (size - 1);
+      while (slots[i].member) i = (i + 1) & (size - 1);
+      slots[i] = {h, c};
+    }
+
+    index = slots;
+    index_mask = size - 1;
+  }
+
+  auto h = hash_json_text(key);
+  for (auto i = h & index_mask; index[i].member; i = (i + 1) & index_mask) {
+    auto& slot = index[i];
+    if (slot.hash == h && same_key(slot.member, key)) {
+      return slot.member->child_head->node_next;
+    }
+  }
+  return nullptr;
+}
+
+//------------------------------------------------------------------------------
+// Each reference token is a member name with '/' and '~' escaped as "~1" and
+// "~0", or an array index in decimal without leading zeros. "-" names the
+// element after the end of an array, which never exists in a parsed tree.
+
+JsonNode* json_pointer(JsonParseContext& ctx, JsonNode* root, TextSpan pointer) {
+  auto node = root;
+  auto a = pointer.begin;
+  auto b = pointer.end;
+  if (a == b) return node;
+  if (*a != '/') return nullptr;
+
+  std::string unescaped;
+  while (node && a < b) {
+    auto token_begin = ++a;
+    while (a < b && *a != '/') a++;
+    TextSpan token(token_begin, a);
+
+    auto c = node->span.begin[0];
+    if (c == '{') {
+      if (memchr(token.begin, '~', token.len())) {
+        unescaped.clear();
+        for (auto t = token.begin; t < token.end; t++) {
+          if (*t != '~') {
+            unescaped.push_back(*t);
+          } else if (t + 1 < token.end && (t[1] == '0' || t[1] == '1')) {
+            unescaped.push_back(*++t == '0' ? '~' : '/');
+          } else {
+            return nullptr;
+          }
+        }
+        token = TextSpan(unescaped.data(), unescaped.data() + unescaped.size());
+      }
+      node = ((JsonObject*)node)->get(ctx, token);
+    }
+    else if (c == '[') {
+      // Arrays whose item array wouldn't fit in a slab don't have one, and
+      // item() walks their children instead.
+      if (token.is_empty() || (token.begin[0] == '0' && token.len() > 1)) return nullptr;
+      if (token.len() > 18) return nullptr;
+      size_t i = 0;
+      for (auto t = token.begin; t < token.end; t++) {
+        if (*t < '0' || *t > '9') return nullptr;
+        i = i * 10 + (*t - '0');
+      }
+      node = node->item(i);
+    }
+    else {
+      return nullptr;
+    }
+  }
+  return node;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,137 @@
+//------------------------------------------------------------------------------
+// Measures pulling three fields out of every tweet in twitter.json - the id,
+// the text and the user's screen name - with a JsonCursor, compared to parsing
+// the whole document and looking the fields up in the tree.
+
+// Example usage:
+// bin/json_ondemand_benchmark data/twitter.json
+
+// SPDX-FileCopyrightText:  2023 Austin Appleby <aappleby@gmail.com>
+// SPDX-License-Identifier: MIT License
+
+#include "json.hpp"
+#include "matcheroni/Utilities.hpp"
+
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace matcheroni;
+using namespace parseroni;
+
+const int reps = 100;
+
+struct Totals {
+  bool operator==(const Totals& t) const = default;
+
+  size_t tweets = 0;
+  int64_t id_sum = 0;
+  size_t text_bytes = 0;
+  size_t name_bytes = 0;
+};
+
+//------------------------------------------------------------------------------
+
+Totals extract_parsed(JsonParseContext& ctx, TextSpan text) {
+  Totals totals;
+  ctx.reset();
+  if (!parse_json(ctx, text).is_valid()) return totals;
+
+  auto root = (JsonObject*)ctx.top_head;
+  auto statuses = root->get(ctx, utils::to_span("statuses"));
+  for (size_t i = 0; i < statuses->item_count(); i++) {
+    auto tweet = (JsonObject*)statuses->item(i);
+    auto id = (JsonNumber*)tweet->get(ctx, utils::to_span("id"));
+    auto text = (JsonString*)tweet->get(ctx, utils::to_span("text"));
+    auto user = (JsonObject*)tweet->get(ctx, utils::to_span("user"));
+    auto name = (JsonString*)user->get(ctx, utils::to_span("screen_name"));
+
+    totals.tweets++;
+    totals.id_sum += id->as_int64();
+    totals.text_bytes += text->text(ctx).len();
+    totals.name_bytes += name->text(ctx).len();
+  }
+  return totals;
+}
+
+Totals extract_ondemand(TextSpan text) {
+  Totals totals;
+  std::string scratch;
+
+  auto statuses = JsonCursor(text).field(utils::to_span("statuses"));
+  for (auto tweet = statuses.first(); tweet.is_valid(); tweet = tweet.next()) {
+    int64_t id = 0;
+    TextSpan tweet_text, name;
+    tweet.field(utils::to_span("id")).as_int64(id);
+    tweet.field(utils::to_span("text")).as_string(tweet_text, scratch);
+    // The name can reuse the scratch buffer, so measure the text first.
+    auto text_bytes = tweet_text.is_valid() ? tweet_text.len() : 0;
+    tweet.field(utils::to_span("user")).field(utils::to_span("screen_name")).as_string(name, scratch);
+
+    totals.tweets++;
+    totals.id_sum += id;
+    totals.text_bytes += text_bytes;
+    totals.name_bytes += name.is_valid() ? name.len() : 0;
+  }
+  return totals;
+}
+
+double median(std::vector<double>& times) {
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+  printf("Matcheroni JSON on-demand benchmark\n");
+
+  const char* path = argc > 1 ? argv[1] : "data/twitter.json";
+
+  std::string buf;
+  utils::read(path, buf);
+  if (buf.size() == 0) {
+    printf("Could not load %s\n", path);
+    return -1;
+  }
+  TextSpan text = utils::to_span(buf);
+
+  JsonParseContext ctx;
+  Totals parsed, ondemand;
+  std::vector<double> parse_times;
+  std::vector<double> ondemand_times;
+  for (int rep = 0; rep < reps; rep++) {
+    double time = -utils::timestamp_ms();
+    parsed = extract_parsed(ctx, text);
+    time += utils::timestamp_ms();
+    parse_times.push_back(time);
+
+    time = -utils::timestamp_ms();
+    ondemand = extract_ondemand(text);
+    time += utils::timestamp_ms();
+    ondemand_times.push_back(time);
+  }
+
+  if (!parsed.tweets || !(parsed == ondemand)) {
+    printf("On-demand fields don't match the parsed tree!\n");
+    return -1;
+  }
+
+  double parse_time = median(parse_times);
+  double ondemand_time = median(ondemand_times);
+
+  printf("\n");
+  printf("File               %s\n", path);
+  printf("Byte total         %d\n", text.len());
+  printf("Tweets             %ld\n", parsed.tweets);
+  printf("Full parse         %f msec, %f megabytes per second\n", parse_time,
+         (text.len() / 1e6) / (parse_time / 1e3));
+  printf("On demand          %f msec, %f megabytes per second (%.1fx faster)\n", ondemand_time,
+         (text.len() / 1e6) / (ondemand_time / 1e3), parse_time / ondemand_time);
+  printf("\n");
+
+  return 0;
+}
+
+//------------------------------------------------------------------------------
@@ -16,29 +16,38 @@ using exponent  = Seq<Atoms<'e', 'E'>, Opt<sign>, digits>;
 using number    = Seq<integer, Opt<fraction>, Opt<exponent>>;
 
 using ws        = Any<Atoms<' ', '\n', '\r', '\t'>>;
-using hex       = Ranges<'0','9','a','f','A','F'>;
-using escape    = Oneof<Charset<"\"\\/bfnrt">, Seq<Atom<'u'>, Rep<4, hex>>>;
-using character = Oneof<
-  Seq<Not<Atom<'"'>>, Not<Atom<'\\'>>, Range<0x0020, 0x10FFFF>>,
-  Seq<Atom<'\\'>, escape>
->;
-using string = Seq<Atom<'"'>, Any<character>, Atom<'"'>>;
+
+// Strings are scanned by hand, so they can skip ahead 32 bytes at a time and
+// check their UTF-8 on the way.
+static TextSpan match_string(JsonParseContext&, TextSpan body) {
+  auto end = scan_json_string(body.begin, body.end);
+  return end ? TextSpan(end, body.end) : body.fail();
+}
+using string = Ref<match_string>;
 
 template <typename P>
 using list = Seq<P, Any<Seq<ws, Atom<','>, ws, P>>>;
 
 TextSpan match_value(JsonParseContext& ctx, TextSpan body);
 using value  = Ref<match_value>;
-using array  = Seq<Atom<'['>, ws, Opt<list<value>>, ws, Atom<']'>>;
+using array  = CaptureList<"val", Seq<Atom<'['>, ws>, value, Seq<ws, Atom<','>, ws>, Seq<ws, Atom<']'>>, JsonArray>;
 using key    = Capture<"key", string, JsonString>;
 using member = Capture<"member", Seq<key, ws, Atom<':'>, ws, value>, JsonKeyVal>;
 using object = Seq<Atom<'{'>, ws, Opt<list<member>>, ws, Atom<'}'>>;
 
+// The number node is the last one appended, so eager decoding can reach it
+// without a node type of its own.
+static TextSpan match_number(JsonParseContext& ctx, TextSpan body) {
+  auto tail = Capture<"val", number, JsonNumber>::match(ctx, body);
+  if (ctx.eager_numbers && tail.is_valid()) ((JsonNumber*)ctx.top_tail)->decode();
+  return tail;
+}
+
 TextSpan match_value(JsonParseContext& ctx, TextSpan body) {
   using value = Oneof<
     Capture<"val", string,       JsonString>,
-    Capture<"val", number,       JsonNumber>,
-    Capture<"val", array,        JsonArray>,
+    Ref<match_number>,
+    array,
     Capture<"val", object,       JsonObject>,
     Capture<"val", Lit<"true">,  JsonKeyword>,
     Capture<"val", Lit<"false">, JsonKeyword>,
@@ -52,3 +61,30 @@ using json = Seq<ws, value, ws>;
 TextSpan parse_json(JsonParseContext& ctx, TextSpan body) {
   return json::match(ctx, body);
 }
+
+//------------------------------------------------------------------------------
+// Values and members are only ever matched by match_value and member, and each
+// alternative inside them starts with a different character - so rematching
+// one in place makes the same choices the full parse did.
+
+static matcher_function<JsonParseContext, char> restart_rule(JsonNode* node) {
+  if (node->tag_is("val"))    return match_value;
+  if (node->tag_is("member")) return member::match<JsonParseContext, char>;
+  return nullptr;
+}
+
+TextSpan reparse_json(JsonParseContext& ctx, TextSpan old_text, TextSpan new_text, const SpanEdit& edit) {
+  if (auto node = reparse(ctx, old_text, new_text, edit, restart_rule)) {
+    // The objects around the rematched value may have indexed the old one.
+    for (auto p = node->node_parent; p; p = p->node_parent) {
+      if (p->span.begin[0] == '{') ((JsonObject*)p)->index = nullptr;
+    }
+
+    // Everything after the root value is unchanged, so match the trailing
+    // whitespace again - the old parse may have stopped short of the end.
+    return ws::match(ctx, TextSpan(ctx.top_tail->span.end, new_text.end));
+  }
+
+  ctx.reset();
+  return parse_json(ctx, new_text);
+}
@@ -0,0 +1,188 @@
+//------------------------------------------------------------------------------
+// Measures looking up every value in a document by its JSON Pointer, with
+// object members found through JsonObject's hashed index compared to walking
+// each object's members until the key turns up.
+
+// Example usage:
+// bin/json_pointer_benchmark data/twitter.json data/citm_catalog.json
+
+// SPDX-FileCopyrightText:  2023 Austin Appleby <aappleby@gmail.com>
+// SPDX-License-Identifier: MIT License
+
+#include "json.hpp"
+#include "matcheroni/Utilities.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace matcheroni;
+using namespace parseroni;
+
+const int reps = 20;
+
+//------------------------------------------------------------------------------
+// Pointers to every value under 'node', in document order.
+
+void collect(JsonParseContext& ctx, JsonNode* node, const std::string& path,
+             std::vector<std::string>& out) {
+  out.push_back(path);
+  auto c = node->span.begin[0];
+  if (c == '{') {
+    for (auto m = node->child_head; m; m = m->node_next) {
+      auto key = ((JsonString*)m->child_head)->text(ctx);
+      std::string token;
+      for (auto k = key.begin; k < key.end; k++) {
+        if (*k == '~') token += "~0";
+        else if (*k == '/') token += "~1";
+        else token.push_back(*k);
+      }
+      collect(ctx, m->child_head->node_next, path + "/" + token, out);
+    }
+  } else if (c == '[') {
+    for (size_t i = 0; i < node->item_count(); i++) {
+      collect(ctx, node->item(i), path + "/" + std::to_string(i), out);
+    }
+  }
+}
+
+// The same walk as json_pointer() with a linear search through each object.
+JsonNode* linear_pointer(JsonParseContext& ctx, JsonNode* root, TextSpan pointer) {
+  auto node = root;
+  auto a = pointer.begin;
+  auto b = pointer.end;
+
+  std::string key;
+  while (node && a < b) {
+    auto token_begin = ++a;
+    while (a < b && *a != '/') a++;
+
+    auto c = node->span.begin[0];
+    if (c == '{') {
+      key.clear();
+      for (auto t = token_begin; t < a; t++) {
+        if (*t == '~') key.push_back(*++t == '0' ? '~' : '/');
+        else key.push_back(*t);
+      }
+      auto m = node->child_head;
+      for (; m; m = m->node_next) {
+        auto text = ((JsonString*)m->child_head)->text(ctx);
+        if (text.len() == int(key.size()) && memcmp(text.begin, key.data(), key.size()) == 0) break;
+      }
+      node = m ? m->child_head->node_next : nullptr;
+    } else if (c == '[') {
+      size_t i = 0;
+      for (auto t = token_begin; t < a; t++) i = i * 10 + (*t - '0');
+      node = node->item(i);
+    } else {
+      return nullptr;
+    }
+  }
+  return node;
+}
+
+double median(std::vector<double>& times) {
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+//------------------------------------------------------------------------------
+
+int run(const char* path) {
+  std::string buf;
+  utils::read(path, buf);
+  if (buf.size() == 0) {
+    printf("Could not load %s\n", path);
+    return -1;
+  }
+  TextSpan text = utils::to_span(buf);
+
+  JsonParseContext ctx;
+  auto tail = parse_json(ctx, text);
+  matcheroni_assert(tail.is_valid() && tail.is_empty());
+  auto root = ctx.top_head;
+
+  std::vector<std::string> pointers;
+  collect(ctx, root, "", pointers);
+
+  size_t objects = 0;
+  size_t big_objects = 0;
+  auto count = [&](auto& self, JsonNode* node) -> void {
+    for (auto n = node; n; n = n->node_next) {
+      if (n->span.begin[0] == '{') {
+        objects++;
+        size_t members = 0;
+        for (auto m = n->child_head; m; m = m->node_next) members++;
+        if (members > 8) big_objects++;
+      }
+      self(self, n->child_head);
+    }
+  };
+  count(count, root);
+
+  //----------------------------------------
+  // The first pass builds the index of every big object it goes through.
+
+  auto bytes_before = ctx.alloc.used_bytes;
+  double first_time = -utils::timestamp_ms();
+  for (auto& p : pointers) {
+    matcheroni_assert(json_pointer(ctx, root, utils::to_span(p)));
+  }
+  first_time += utils::timestamp_ms();
+  auto index_bytes = ctx.alloc.used_bytes - bytes_before;
+
+  std::vector<double> index_times;
+  std::vector<double> linear_times;
+  uint64_t sum_index = 0;
+  uint64_t sum_linear = 0;
+  for (int rep = 0; rep < reps; rep++) {
+    double time = -utils::timestamp_ms();
+    for (auto& p : pointers) sum_index += uint64_t(json_pointer(ctx, root, utils::to_span(p)));
+    time += utils::timestamp_ms();
+    index_times.push_back(time);
+
+    time = -utils::timestamp_ms();
+    for (auto& p : pointers) sum_linear += uint64_t(linear_pointer(ctx, root, utils::to_span(p)));
+    time += utils::timestamp_ms();
+    linear_times.push_back(time);
+  }
+
+  if (sum_index != sum_linear) {
+    printf("Indexed lookups don't match the linear search!\n");
+    return -1;
+  }
+
+  //----------------------------------------
+
+  double lookups = double(pointers.size());
+
+  printf("\n");
+  printf("File               %s\n", path);
+  printf("Byte total         %d\n", text.len());
+  printf("Objects            %ld (%ld with more than 8 members)\n", objects, big_objects);
+  printf("Pointers           %ld\n", pointers.size());
+  printf("Index bytes        %ld\n", index_bytes);
+  printf("First pass         %f nsec/pointer\n", first_time * 1e6 / lookups);
+  printf("Indexed lookup     %f nsec/pointer\n", median(index_times) * 1e6 / lookups);
+  printf("Linear lookup      %f nsec/pointer\n", median(linear_times) * 1e6 / lookups);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  printf("Matcheroni JSON Pointer benchmark\n");
+
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; i++) paths.push_back(argv[i]);
+  if (paths.empty()) paths = {"data/twitter.json", "data/citm_catalog.json"};
+
+  for (auto& path : paths) {
+    if (run(path.c_str())) return -1;
+  }
+  printf("\n");
+
+  return 0;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,107 @@
+//------------------------------------------------------------------------------
+// Measures a server-style workload - many threads, each creating a context,
+// parsing a document, and destroying the context again - with every context
+// allocating its own slabs vs. borrowing them from the global SlabPool.
+
+// Example usage:
+// bin/json_pool_benchmark
+
+// SPDX-FileCopyrightText:  2023 Austin Appleby <aappleby@gmail.com>
+// SPDX-License-Identifier: MIT License
+
+#include "json.hpp"
+#include "matcheroni/Utilities.hpp"
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace matcheroni;
+using namespace parseroni;
+
+const int thread_count = 8;
+const int iterations = 200;
+
+//------------------------------------------------------------------------------
+
+double wall_ms() {
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration<double, std::milli>(now).count();
+}
+
+// Returns the wall time for all threads to finish, and the number of slabs the
+// contexts had to take (from malloc or from the pool).
+double run(const std::vector<std::string>& docs, SlabPool* pool, size_t& slabs) {
+  std::atomic<size_t> slab_total = 0;
+
+  double time = -wall_ms();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_count; t++) {
+    threads.emplace_back([&, t]() {
+      size_t thread_slabs = 0;
+      for (int i = 0; i < iterations; i++) {
+        auto& doc = docs[(t + i) % docs.size()];
+        JsonParseContext ctx;
+        ctx.alloc.pool = pool;
+        auto tail = parse_json(ctx, utils::to_span(doc));
+        matcheroni_assert(tail.is_valid() && tail.is_empty());
+        thread_slabs += ctx.alloc.slab_count;
+      }
+      slab_total += thread_slabs;
+    });
+  }
+  for (auto& t : threads) t.join();
+  time += wall_ms();
+
+  slabs = slab_total;
+  return time;
+}
+
+//------------------------------------------------------------------------------
+
+int main() {
+  printf("Matcheroni JSON slab pool benchmark\n");
+
+  const char* paths[] = {
+    "data/canada.json",
+    "data/citm_catalog.json",
+    "data/twitter.json",
+    "data/rapidjson_sample.json",
+  };
+
+  std::vector<std::string> docs;
+  for (auto path : paths) {
+    std::string buf;
+    utils::read(path, buf);
+    if (buf.size() == 0) {
+      printf("Could not load %s\n", path);
+      return -1;
+    }
+    docs.push_back(buf);
+  }
+
+  size_t private_slabs = 0;
+  size_t pooled_slabs = 0;
+
+  double private_time = run(docs, nullptr, private_slabs);
+  double pooled_time = run(docs, &SlabPool::global(), pooled_slabs);
+
+  printf("\n");
+  printf("Threads            %d\n", thread_count);
+  printf("Contexts           %d\n", thread_count * iterations);
+  printf("Private slabs time %f msec\n", private_time);
+  printf("Private slabs      %ld mallocs\n", private_slabs);
+  printf("Pooled slabs time  %f msec (%.2fx)\n", pooled_time, private_time / pooled_time);
+  printf("Pooled slabs       %ld taken, %ld mallocs\n", pooled_slabs,
+         size_t(SlabPool::global().malloc_count));
+  printf("Pool retained      %ld slabs\n", SlabPool::global().retained());
+  printf("Peak RSS           %ld bytes\n", utils::peak_rss());
+  printf("\n");
+
+  return 0;
+}
+
+//------------------------------------------------------------------------------
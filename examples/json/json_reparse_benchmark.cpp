@@ -0,0 +1,168 @@
+//------------------------------------------------------------------------------
+// Measures how long it takes to bring a parse tree up to date after a single
+// character edit, compared to reparsing the whole document.
+
+// Example usage:
+// bin/json_reparse_benchmark data/twitter.json
+
+// SPDX-FileCopyrightText:  2023 Austin Appleby <aappleby@gmail.com>
+// SPDX-License-Identifier: MIT License
+
+#include "json.hpp"
+#include "matcheroni/Utilities.hpp"
+
+#include <stdio.h>
+#include <algorithm>
+#include <ctype.h>
+#include <vector>
+
+using namespace matcheroni;
+using namespace parseroni;
+
+const int reps = 100;
+
+//------------------------------------------------------------------------------
+// Collects string values made of plain alphanumerics in the middle of the
+// document, so our edits keep the document valid.
+
+void find_edit_targets(JsonNode* node, TextSpan text, std::vector<JsonNode*>& out) {
+  for (auto c = node; c; c = c->node_next) {
+    find_edit_targets(c->child_head, text, out);
+
+    if (!c->tag_is("val") || c->span.len() < 5 || *c->span.begin != '"') continue;
+
+    auto offset = c->span.begin - text.begin;
+    if (offset < text.len() * 2 / 5 || offset > text.len() * 3 / 5) continue;
+
+    bool plain = true;
+    for (auto s = c->span.begin + 1; s < c->span.end - 1; s++) {
+      if (!isalnum(*s)) plain = false;
+    }
+    if (plain) out.push_back(c);
+  }
+}
+
+double median(std::vector<double>& times) {
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+void check_same(JsonParseContext& ctx, TextSpan text) {
+  JsonParseContext ref;
+  auto tail = parse_json(ref, text);
+  matcheroni_assert(tail.is_valid() && tail.is_empty());
+  if (utils::hash_context(ctx) != utils::hash_context(ref)) {
+    printf("Incremental tree does not match full parse!\n");
+    exit(-1);
+  }
+}
+
+//------------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+  printf("Matcheroni JSON incremental reparse benchmark\n");
+
+  const char* path = argc > 1 ? argv[1] : "data/twitter.json";
+
+  std::string buf_a;
+  utils::read(path, buf_a);
+  if (buf_a.size() == 0) {
+    printf("Could not load %s\n", path);
+    return -1;
+  }
+  TextSpan text = utils::to_span(buf_a);
+
+  JsonParseContext ctx;
+
+  //----------------------------------------
+  // Full parse, for reference
+
+  std::vector<double> full_times;
+  for (int rep = 0; rep < reps; rep++) {
+    double time = -utils::timestamp_ms();
+    ctx.reset();
+    auto tail = parse_json(ctx, text);
+    time += utils::timestamp_ms();
+    matcheroni_assert(tail.is_valid() && tail.is_empty());
+    full_times.push_back(time);
+  }
+
+  std::vector<JsonNode*> targets;
+  find_edit_targets(ctx.top_head, text, targets);
+  if (targets.empty()) {
+    printf("No editable strings found in %s\n", path);
+    return -1;
+  }
+
+  std::vector<int64_t> offsets;
+  for (int i = 0; i < reps; i++) {
+    auto node = targets[(i * 7919) % targets.size()];
+    offsets.push_back((node->span.begin - text.begin) + node->span.len() / 2);
+  }
+
+  //----------------------------------------
+  // Overwrite one character in place, then put it back.
+
+  std::vector<double> replace_times;
+  for (auto offset : offsets) {
+    char old_c = buf_a[offset];
+    SpanEdit edit = {offset, offset + 1, offset + 1};
+
+    buf_a[offset] = old_c == 'x' ? 'y' : 'x';
+    double time = -utils::timestamp_ms();
+    auto tail = reparse_json(ctx, text, text, edit);
+    time += utils::timestamp_ms();
+    matcheroni_assert(tail.is_valid() && tail.is_empty());
+    replace_times.push_back(time);
+    check_same(ctx, text);
+
+    buf_a[offset] = old_c;
+    reparse_json(ctx, text, text, edit);
+  }
+  check_same(ctx, text);
+
+  //----------------------------------------
+  // Insert one character, which shifts everything after it.
+
+  std::vector<double> insert_times;
+  std::string buf_b;
+  for (auto offset : offsets) {
+    buf_b = buf_a;
+    buf_b.insert(buf_b.begin() + offset, 'x');
+    TextSpan new_text = utils::to_span(buf_b);
+    SpanEdit edit = {offset, offset, offset + 1};
+
+    double time = -utils::timestamp_ms();
+    auto tail = reparse_json(ctx, text, new_text, edit);
+    time += utils::timestamp_ms();
+    matcheroni_assert(tail.is_valid() && tail.is_empty());
+    insert_times.push_back(time);
+    check_same(ctx, new_text);
+
+    // And take it back out again.
+    SpanEdit undo = {offset, offset + 1, offset};
+    reparse_json(ctx, new_text, text, undo);
+  }
+  check_same(ctx, text);
+
+  //----------------------------------------
+
+  double full_time    = median(full_times);
+  double replace_time = median(replace_times);
+  double insert_time  = median(insert_times);
+
+  printf("\n");
+  printf("File            %s\n", path);
+  printf("Byte total      %d\n", text.len());
+  printf("Tree nodes      %ld\n", ctx.node_count());
+  printf("Edits           %d\n", reps);
+  printf("Full parse      %f msec\n", full_time);
+  printf("Replace reparse %f msec (%.1fx faster)\n", replace_time, full_time / replace_time);
+  printf("Insert reparse  %f msec (%.1fx faster)\n", insert_time, full_time / insert_time);
+  printf("All incremental trees matched a full reparse\n");
+  printf("\n");
+
+  return 0;
+}
+
+//------------------------------------------------------------------------------
@@ -0,0 +1,292 @@
+// SPDX-FileCopyrightText:  2023 Austin Appleby <aappleby@gmail.com>
+// SPDX-License-Identifier: MIT License
+
+#include "json.hpp"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace matcheroni;
+
+//------------------------------------------------------------------------------
+// Strings are scanned 32 bytes at a time for the bytes that need a closer
+// look - quotes, backslashes, control characters and anything that isn't
+// ASCII. Runs of plain ASCII are skipped without touching each byte, and each
+// non-ASCII sequence is checked to be well-formed UTF-8 as it's reached, so
+// the string is only read once.
+
+namespace {
+
+// Length of the well-formed UTF-8 sequence at 'a', or 0 if it isn't one.
+// Rejects overlong forms, surrogates and code points past U+10FFFF.
+int utf8_length(const uint8_t* a, const uint8_t* b) {
+  auto cont = [](uint8_t c) { return (c & 0xC0) == 0x80; };
+  auto c = a[0];
+
+  if (c < 0xC2) return 0;
+  if (c < 0xE0) {
+    return b - a >= 2 && cont(a[1]) ? 2 : 0;
+  }
+  if (c < 0xF0) {
+    if (b - a < 3 || !cont(a[1]) || !cont(a[2])) return 0;
+    if (c == 0xE0 && a[1] < 0xA0) return 0;  // Overlong
+    if (c == 0xED && a[1] > 0x9F) return 0;  // Surrogate
+    return 3;
+  }
+  if (c < 0xF5) {
+    if (b - a < 4 || !cont(a[1]) || !cont(a[2]) || !cont(a[3])) return 0;
+    if (c == 0xF0 && a[1] < 0x90) return 0;  // Overlong
+    if (c == 0xF4 && a[1] > 0x8F) return 0;  // Past U+10FFFF
+    return 4;
+  }
+  return 0;
+}
+
+inline bool is_hex(char c) {
+  return uint8_t(c - '0') < 10 || uint8_t((c | 0x20) - 'a') < 6;
+}
+
+inline uint32_t hex_value(char c) {
+  return uint8_t(c - '0') < 10 ? uint32_t(c - '0') : uint32_t((c | 0x20) - 'a' + 10);
+}
+
+inline uint32_t hex4(const char* c) {
+  return (hex_value(c[0]) << 12) | (hex_value(c[1]) << 8) | (hex_value(c[2]) << 4) | hex_value(c[3]);
+}
+
+// First byte in [a, b) that is a quote, a backslash, a control character or
+// not ASCII, or b.
+const char* skip_plain(const char* a, const char* b) {
+#if defined(__SSE2__)
+  auto quote = _mm_set1_epi8('"');
+  auto backslash = _mm_set1_epi8('\\');
+  // Signed compare - bytes >= 0x80 are negative and come out as stops too.
+  auto space = _mm_set1_epi8(0x20);
+  auto stops = [&](__m128i x) {
+    return _mm_movemask_epi8(_mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, backslash)),
+      _mm_cmplt_epi8(x, space)));
+  };
+
+  for (; b - a >= 32; a += 32) {
+    auto x0 = _mm_loadu_si128((const __m128i*)a);
+    auto x1 = _mm_loadu_si128((const __m128i*)(a + 16));
+    uint32_t mask = uint32_t(stops(x0)) | (uint32_t(stops(x1)) << 16);
+    if (mask) return a + __builtin_ctz(mask);
+  }
+#endif
+  while (a < b && uint8_t(*a) >= 0x20 && *a != '"' && *a != '\\' && uint8_t(*a) < 0x80) a++;
+  return a;
+}
+
+}; // namespace
+
+//------------------------------------------------------------------------------
+
+const char* scan_json_string(const char* a, const char* b) {
+  if (a == b || *a != '"') return nullptr;
+  a++;
+
+  while (1) {
+    a = skip_plain(a, b);
+    if (a == b) return nullptr;
+
+    auto c = uint8_t(*a);
+    if (c == '"') {
+      return a + 1;
+    }
+    else if (c == '\\') {
+      if (b - a < 2) return nullptr;
+      switch (a[1]) {
+        case '"': case '\\': case '/': case 'b':
+        case 'f': case 'n':  case 'r': case 't':
+          a += 2;
+          break;
+        case 'u':
+          if (b - a < 6 || !is_hex(a[2]) || !is_hex(a[3]) || !is_hex(a[4]) || !is_hex(a[5])) return nullptr;
+          a += 6;
+          break;
+        default:
+          return nullptr;
+      }
+    }
+    else if (c < 0x20) {
+      return nullptr;
+    }
+    else {
+      auto len = utf8_length((const uint8_t*)a, (const uint8_t*)b);
+      if (!len) return nullptr;
+      a += len;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+
+const char* find_json_string_end(const char* a, const char* b) {
+  a++;
+  while (1) {
+#if defined(__SSE2__)
+    auto quote = _mm_set1_epi8('"');
+    auto backslash = _mm_set1_epi8('\\');
+    for (; b - a >= 16; a += 16) {
+      auto x = _mm_loadu_si128((const __m128i*)a);
+      auto mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, backslash)));
+      if (mask) {
+        a += __builtin_ctz(mask);
+        break;
+      }
+    }
+#endif
+    while (a < b && *a != '"' && *a != '\\') a++;
+    if (a >= b) return nullptr;
+    if (*a == '"') return a + 1;
+    a += 2;
+  }
+}
+
+//------------------------------------------------------------------------------
+// Hands the decoded contents of the quoted string 'text' to 'sink' as a series
+// of runs - the stretches between escapes straight from the source, and each
+// escape decoded on its own. The sink returns false to stop early. \u escapes
+// that aren't part of a surrogate pair decode to U+FFFD.
+
+namespace {
+
+template <typename Sink>
+bool decode_runs(TextSpan text, Sink sink) {
+  auto a = text.begin + 1;
+  auto b = text.end - 1;
+  char buf[4];
+
+  auto put = [&](uint32_t cp) {
+    if (cp < 0x80) {
+      buf[0] = char(cp);
+      return sink(buf, 1);
+    } else if (cp < 0x800) {
+      buf[0] = char(0xC0 | (cp >> 6));
+      buf[1] = char(0x80 | (cp & 0x3F));
+      return sink(buf, 2);
+    } else if (cp < 0x10000) {
+      buf[0] = char(0xE0 | (cp >> 12));
+      buf[1] = char(0x80 | ((cp >> 6) & 0x3F));
+      buf[2] = char(0x80 | (cp & 0x3F));
+      return sink(buf, 3);
+    } else {
+      buf[0] = char(0xF0 | (cp >> 18));
+      buf[1] = char(0x80 | ((cp >> 12) & 0x3F));
+      buf[2] = char(0x80 | ((cp >> 6) & 0x3F));
+      buf[3] = char(0x80 | (cp & 0x3F));
+      return sink(buf, 4);
+    }
+  };
+
+  while (a < b) {
+    auto run = (const char*)memchr(a, '\\', b - a);
+    if (!run) run = b;
+    if (run > a && !sink(a, size_t(run - a))) return false;
+    a = run;
+    if (a == b) break;
+
+    char e = a[1];
+    a += 2;
+    uint32_t cp = uint8_t(e);  // '"', '\\' and '/'
+    switch (e) {
+      case 'b': cp = '\b'; break;
+      case 'f': cp = '\f'; break;
+      case 'n': cp = '\n'; break;
+      case 'r': cp = '\r'; break;
+      case 't': cp = '\t'; break;
+      case 'u': {
+        cp = hex4(a);
+        a += 4;
+        if (cp >= 0xD800 && cp < 0xDC00) {
+          if (b - a >= 6 && a[0] == '\\' && a[1] == 'u') {
+            uint32_t lo = hex4(a + 2);
+            if (lo >= 0xDC00 && lo < 0xE000) {
+              cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+              a += 6;
+            } else {
+              cp = 0xFFFD;
+            }
+          } else {
+            cp = 0xFFFD;
+          }
+        } else if (cp >= 0xDC00 && cp < 0xE000) {
+          cp = 0xFFFD;
+        }
+        break;
+      }
+    }
+    if (!put(cp)) return false;
+  }
+  return true;
+}
+
+inline uint32_t fnv1a(uint32_t h, const char* a, size_t len) {
+  for (size_t i = 0; i < len; i++) h = (h ^ uint8_t(a[i])) * 16777619u;
+  return h;
+}
+
+}; // namespace
+
+// Escapes never decode to more bytes than they take up, so the output fits in
+// the input's length.
+size_t unescape_json_string(TextSpan text, char* out) {
+  auto start = out;
+  decode_runs(text, [&](const char* a, size_t len) {
+    memcpy(out, a, len);
+    out += len;
+    return true;
+  });
+  return out - start;
+}
+
+bool json_string_equals(TextSpan quoted, TextSpan text) {
+  auto a = text.begin;
+  auto b = text.end;
+  bool same = decode_runs(quoted, [&](const char* run, size_t len) {
+    if (size_t(b - a) < len || memcmp(run, a, len) != 0) return false;
+    a += len;
+    return true;
+  });
+  return same && a == b;
+}
+
+uint32_t hash_json_text(TextSpan text) {
+  return fnv1a(2166136261u, text.begin, size_t(text.end - text.begin));
+}
+
+//------------------------------------------------------------------------------
+
+TextSpan JsonString::text(JsonParseContext& ctx) const {
+  TextSpan body(span.begin + 1, span.end - 1);
+  if (!memchr(body.begin, '\\', body.end - body.begin)) return body;
+
+  // Rounded up so the nodes allocated after it stay aligned.
+  auto size = ((span.end - span.begin) + 7) & ~7;
+  if (size > parseroni::LifoAlloc::slab_size) return body.fail();
+  auto buf = (char*)ctx.alloc.bump(int(size));
+  if (!buf) return body.fail();
+  return TextSpan(buf, buf + unescape_json_string(span, buf));
+}
+
+//------------------------------------------------------------------------------
+
+bool JsonString::equals(TextSpan text) const {
+  return json_string_equals(span, text);
+}
+
+uint32_t JsonString::hash() const {
+  uint32_t h = 2166136261u;
+  decode_runs(span, [&](const char* run, size_t len) {
+    h = fnv1a(h, run, len);
+    return true;
+  });
+  return h;
+}
+
+//------------------------------------------------------------------------------
@@ -5,7 +5,10 @@
 #include "json.hpp"
 #include "matcheroni/Utilities.hpp"
 
+#include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 using namespace matcheroni;
 
@@ -49,6 +52,234 @@ int main(int argc, char** argv) {
   printf("Parsing json took %f msec\n", time_b - time_a);
   utils::print_summary(ctx, text, tail, 50);
 
+  // Numbers should decode to exactly what strtod gives, including the ones
+  // that are too long or too close to halfway for the fast paths.
+  const char* numbers[] = {
+    "0", "-0", "0.1", "-65.613616999999977", "9007199254740993",
+    "1.00000000000000011102230246251565404236316680908203125",
+    "2.2250738585072011e-308", "4.9406564584124654e-324", "1e-400",
+    "1.7976931348623157e308", "1.7976931348623159e308", "1e400",
+    "123456789012345678901234567890e-10",
+  };
+  for (auto n : numbers) {
+    double d;
+    int64_t i;
+    decode_json_number(utils::to_span(n), d, i);
+    double expected = strtod(n, nullptr);
+    assert(memcmp(&d, &expected, sizeof(d)) == 0);
+  }
+
+  int64_t i;
+  double d;
+  decode_json_number(utils::to_span("-9223372036854775808"), d, i);
+  assert(i == INT64_MIN);
+  decode_json_number(utils::to_span("9223372036854775808"), d, i);
+  assert(i == INT64_MAX);
+  decode_json_number(utils::to_span("-12.9"), d, i);
+  assert(i == -12);
+
+  // Strings are checked for UTF-8 as they're scanned, and only the ones with
+  // escapes get copied when they're decoded.
+  auto scans = [](const char* s) {
+    return scan_json_string(s, s + strlen(s)) == s + strlen(s);
+  };
+  assert(scans("\"caf\xC3\xA9 \xF0\x9F\x98\x80\""));
+  assert(!scans("\"\xC3\""));          // Truncated
+  assert(!scans("\"\xC0\xAF\""));      // Overlong
+  assert(!scans("\"\xED\xA0\x80\""));  // Surrogate
+  assert(!scans("\"\xF4\x90\x80\x80\""));  // Past U+10FFFF
+  assert(!scans("\"a\tb\""));
+  assert(!scans("\"\\x\""));
+
+  const char* escaped = R"(["plain", "a\"\\\/\b\f\n\r\t", "\u00e9\ud83d\ude00", "\ud83d!"])";
+  ctx.reset();
+  assert(parse_json(ctx, utils::to_span(escaped)).is_valid());
+  auto strings = ctx.top_head->items();
+  auto plain = ((JsonString*)strings[0])->text(ctx);
+  assert(plain.begin == strings[0]->span.begin + 1);
+  assert(utils::to_string(((JsonString*)strings[1])->text(ctx)) == "a\"\\/\b\f\n\r\t");
+  assert(utils::to_string(((JsonString*)strings[2])->text(ctx)) == "\xC3\xA9\xF0\x9F\x98\x80");
+  assert(utils::to_string(((JsonString*)strings[3])->text(ctx)) == "\xEF\xBF\xBD!");
+
+  // Member lookups decode keys before comparing them, agree between small
+  // objects and indexed ones, and take the first of duplicate keys.
+  std::string members = R"({"a/b": [10, {"m~n": 20}], "\u0041": 30, "dup": 1, "dup": 2)";
+  for (int i = 0; i < 20; i++) members += ", \"k" + std::to_string(i) + "\": " + std::to_string(i);
+  members += "}";
+  auto value_of = [&](JsonNode* root, const char* pointer) {
+    auto node = json_pointer(ctx, root, utils::to_span(pointer));
+    return node ? utils::to_string(node->span) : std::string("<none>");
+  };
+  for (int big = 0; big < 2; big++) {
+    ctx.reset();
+    auto source = big ? members : members.substr(0, members.find(", \"k")) + "}";
+    assert(parse_json(ctx, utils::to_span(source)).is_valid());
+    auto root = ctx.top_head;
+    for (int pass = 0; pass < 2; pass++) {
+      assert(value_of(root, "") == source);
+      assert(value_of(root, "/a~1b/0") == "10");
+      assert(value_of(root, "/a~1b/1/m~0n") == "20");
+      assert(value_of(root, "/A") == "30");
+      assert(value_of(root, "/dup") == "1");
+      assert(value_of(root, "/a~1b/2") == "<none>");
+      assert(value_of(root, "/a~1b/01") == "<none>");
+      assert(value_of(root, "/a~1b/-") == "<none>");
+      assert(value_of(root, "/a~2b") == "<none>");
+      assert(value_of(root, "/missing") == "<none>");
+      assert(value_of(root, "a") == "<none>");
+      if (big) assert(value_of(root, "/k19") == "19");
+    }
+    assert(bool(((JsonObject*)root)->index) == bool(big));
+
+    // Escaped keys are compared in place, so looking them up again doesn't
+    // take any more of the arena.
+    auto used = ctx.alloc.used_bytes;
+    for (int i = 0; i < 100; i++) assert(value_of(root, "/A") == "30");
+    assert(ctx.alloc.used_bytes == used);
+  }
+
+  // Reparsing drops the index of the object around the edit.
+  auto edited = members;
+  auto at = edited.find("[10,") + 1;
+  edited.replace(at, 2, "99");
+  assert(reparse_json(ctx, utils::to_span(members), utils::to_span(edited),
+                                 {int64_t(at), int64_t(at) + 2, int64_t(at) + 2}).is_valid());
+  assert(!((JsonObject*)ctx.top_head)->index);
+  assert(value_of(ctx.top_head, "/a~1b/0") == "99");
+  assert(value_of(ctx.top_head, "/k19") == "19");
+
+  // A document that stopped short of the end still does after an edit.
+  std::string partial = "[1, 2] x";
+  std::string partial_edit = "[3, 2] x";
+  ctx.reset();
+  assert(utils::to_string(parse_json(ctx, utils::to_span(partial))) == "x");
+  auto partial_tail = reparse_json(ctx, utils::to_span(partial), utils::to_span(partial_edit), {1, 2, 2});
+  assert(partial_tail.is_valid() && utils::to_string(partial_tail) == "x");
+  assert(partial_tail.begin == partial_edit.data() + 7);
+
+  // Writing a tree back out, with and without edits.
+  const char* doc = "{ \"a\" : [1, 2,\n 3], \"b\": {\"s\": \"x y\\\" z\", \"e\": {}}, \"c\": null }";
+  ctx.reset();
+  assert(parse_json(ctx, utils::to_span(doc)).is_valid());
+  auto root = ctx.top_head;
+  auto written = [&](JsonWriter::Style style) {
+    JsonWriter writer;
+    writer.style = style;
+    writer.write(root);
+    return writer.out;
+  };
+  assert(written(JsonWriter::VERBATIM) == doc);
+  assert(written(JsonWriter::MINIFY) == R"({"a":[1,2,3],"b":{"s":"x y\" z","e":{}},"c":null})");
+  assert(written(JsonWriter::PRETTY) ==
+    "{\n  \"a\": [\n    1,\n    2,\n    3\n  ],\n  \"b\": {\n    \"s\": \"x y\\\" z\",\n"
+    "    \"e\": {}\n  },\n  \"c\": null\n}");
+
+  JsonWriter editor;
+  editor.replace(json_pointer(ctx, root, utils::to_span("/a/1")), utils::to_span("[ 20, 21 ]"));
+  editor.remove(json_pointer(ctx, root, utils::to_span("/a/0")));
+  editor.remove(json_pointer(ctx, root, utils::to_span("/b/s")));
+  editor.write(root);
+  assert(editor.out == "{ \"a\" : [[ 20, 21 ],\n 3], \"b\": {\"e\": {}}, \"c\": null }");
+  editor.out.clear();
+  editor.style = JsonWriter::MINIFY;
+  editor.write(root);
+  assert(editor.out == R"({"a":[[20,21],3],"b":{"e":{}},"c":null})");
+
+  // Cursors find values without parsing what's around them, and only check
+  // the values they're asked for.
+  const char* lazy = R"( {"skip": [1, {"x": "]}\\"}, "\"{"], "k\u0065y": -2.5e1,
+                         "list": [10, "t\u00e9xt", {"deep": [true]}], "bad": [1 2]} )";
+  JsonCursor cursor(utils::to_span(lazy));
+  assert(cursor.kind() == '{');
+  double dval = 0;
+  int64_t ival = 0;
+  TextSpan sval;
+  std::string scratch;
+  assert(cursor.field(utils::to_span("key")).as_double(dval) && dval == -25.0);
+  assert(cursor.field(utils::to_span("list")).at(0).as_int64(ival) && ival == 10);
+  assert(cursor.field(utils::to_span("list")).at(1).as_string(sval, scratch));
+  assert(utils::to_string(sval) == "t\xC3\xA9xt");
+  assert(cursor.field(utils::to_span("list")).at(2).field(utils::to_span("deep")).first().kind() == 't');
+  assert(!cursor.field(utils::to_span("list")).at(3).is_valid());
+  assert(!cursor.field(utils::to_span("missing")).first().field(utils::to_span("x")).is_valid());
+  assert(!cursor.field(utils::to_span("key")).as_string(sval, scratch));
+  assert(cursor.field(utils::to_span("bad")).kind() == '[');
+  assert(!cursor.field(utils::to_span("bad")).span().is_valid());
+
+  ctx.reset();
+  auto deep = cursor.field(utils::to_span("list")).at(2).parse(ctx);
+  assert(deep && ctx.top_head == deep && !deep->node_next);
+  assert(utils::to_string(deep->span) == R"({"deep": [true]})");
+
+  // And every number in canada.json, lazily and eagerly.
+  std::string buf;
+  utils::read("../../data/canada.json", buf);
+  assert(buf.size());
+  auto canada = utils::to_span(buf);
+
+  for (int eager = 0; eager < 2; eager++) {
+    ctx.reset();
+    ctx.eager_numbers = eager;
+    assert(parse_json(ctx, canada).is_valid());
+
+    size_t count = 0;
+    auto check = [&](auto& self, JsonNode* node) -> void {
+      for (auto n = node; n; n = n->node_next) {
+        auto c = n->span.begin[0];
+        if (c == '-' || (c >= '0' && c <= '9')) {
+          auto number = (JsonNumber*)n;
+          assert(number->decoded == bool(eager));
+          double expected = strtod(utils::to_string(n->span).c_str(), nullptr);
+          double actual = number->as_double();
+          assert(memcmp(&actual, &expected, sizeof(actual)) == 0);
+          count++;
+        }
+        self(self, n->child_head);
+      }
+    };
+    check(check, ctx.top_head);
+    assert(count > 100000);
+  }
+  printf("canada.json numbers match strtod\n");
+
+  // Minifying twitter.json gives the same text whether it was pretty printed
+  // first or not, and the same bytes through a file as into the buffer.
+  utils::read("../../data/twitter.json", buf);
+  assert(buf.size());
+  ctx.reset();
+  assert(parse_json(ctx, utils::to_span(buf)).is_valid());
+  JsonWriter minify;
+  minify.style = JsonWriter::MINIFY;
+  minify.write(ctx.top_head);
+  JsonWriter pretty;
+  pretty.style = JsonWriter::PRETTY;
+  pretty.write(ctx.top_head);
+
+  JsonParseContext ctx2;
+  assert(parse_json(ctx2, utils::to_span(pretty.out)).is_valid());
+  JsonWriter reminify;
+  reminify.style = JsonWriter::MINIFY;
+  reminify.write(ctx2.top_head);
+  assert(reminify.out == minify.out);
+  assert(minify.out.size() < buf.size());
+
+  for (int style = 0; style < 3; style++) {
+    JsonWriter in_memory, to_file;
+    in_memory.style = to_file.style = JsonWriter::Style(style);
+    in_memory.write(ctx.top_head);
+
+    auto file = tmpfile();
+    to_file.fd = fileno(file);
+    assert(to_file.write(ctx.top_head));
+    assert(to_file.bytes_written == in_memory.out.size());
+    std::string readback(in_memory.out.size(), 0);
+    rewind(file);
+    assert(fread(readback.data(), 1, readback.size(), file) == readback.size());
+    assert(readback == in_memory.out);
+    fclose(file);
+  }
+  printf("twitter.json writes match\n");
+
   return 0;
 }
 
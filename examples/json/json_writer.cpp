@@ -0,0 +1,267 @@
+// SPDX-FileCopyrightText:  2023 Austin Appleby <aappleby@gmail.com>
+// SPDX-License-Identifier: MIT License
+
+#include "json.hpp"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace matcheroni;
+
+namespace {
+
+// Source runs at least this long go to writev() in place instead of being
+// copied into the batch.
+const size_t big_run = 4096;
+
+// A batch is written out once it holds this many bytes or chunks.
+const size_t batch_bytes = 256 * 1024;
+const size_t batch_chunks = 1024;
+
+inline bool is_ws(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+// First byte in [a, b) that is whitespace or a quote, or b. Only used outside
+// strings, where every other byte is printable ASCII.
+const char* skip_to_ws_or_quote(const char* a, const char* b) {
+#if defined(__SSE2__)
+  auto quote = _mm_set1_epi8('"');
+  auto space = _mm_set1_epi8(0x21);
+  for (; b - a >= 16; a += 16) {
+    auto x = _mm_loadu_si128((const __m128i*)a);
+    auto mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmplt_epi8(x, space)));
+    if (mask) return a + __builtin_ctz(mask);
+  }
+#endif
+  while (a < b && uint8_t(*a) > 0x20 && *a != '"') a++;
+  return a;
+}
+
+}; // namespace
+
+//------------------------------------------------------------------------------
+
+void JsonWriter::replace(const JsonNode* node, TextSpan json) {
+  replaced[node] = json;
+  for (auto p = node->node_parent; p && dirty.insert(p).second; p = p->node_parent);
+}
+
+void JsonWriter::remove(const JsonNode* node) {
+  if (node->node_parent && node->node_parent->tag_is("member")) node = node->node_parent;
+  removed.insert(node);
+  for (auto p = node->node_parent; p && dirty.insert(p).second; p = p->node_parent);
+}
+
+void JsonWriter::clear_edits() {
+  replaced.clear();
+  removed.clear();
+  dirty.clear();
+}
+
+//------------------------------------------------------------------------------
+
+bool JsonWriter::write(const JsonNode* root) {
+  level = 0;
+  pending = NONE;
+  emit_value(root);
+  return fd >= 0 ? flush() : true;
+}
+
+bool JsonWriter::flush() {
+  if (fd < 0 || failed) return !failed;
+  cut();
+
+  std::vector<iovec> iov(chunks.size());
+  for (size_t i = 0; i < chunks.size(); i++) {
+    auto& c = chunks[i];
+    iov[i].iov_base = (void*)(c.source ? c.source : out.data() + c.offset);
+    iov[i].iov_len = c.len;
+  }
+
+  // writev() can stop short, so pick up where it left off.
+  size_t i = 0;
+  while (i < iov.size()) {
+    auto n = writev(fd, &iov[i], int(std::min(iov.size() - i, batch_chunks)));
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      failed = true;
+      break;
+    }
+    bytes_written += n;
+    while (i < iov.size() && size_t(n) >= iov[i].iov_len) n -= iov[i++].iov_len;
+    if (n) {
+      iov[i].iov_base = (char*)iov[i].iov_base + n;
+      iov[i].iov_len -= n;
+    }
+  }
+
+  chunks.clear();
+  out.clear();
+  out_flushed = 0;
+  return !failed;
+}
+
+// Ends the chunk of 'out' that hasn't been batched yet.
+void JsonWriter::cut() {
+  if (out.size() > out_flushed) {
+    chunks.push_back({nullptr, out_flushed, out.size() - out_flushed});
+    out_flushed = out.size();
+  }
+}
+
+void JsonWriter::maybe_flush() {
+  if (fd >= 0 && (out.size() - out_flushed >= batch_bytes || chunks.size() >= batch_chunks)) flush();
+}
+
+//------------------------------------------------------------------------------
+
+void JsonWriter::emit_value(const JsonNode* node) {
+  if (!replaced.empty()) {
+    auto r = replaced.find(node);
+    if (r != replaced.end()) {
+      emit_text(r->second);
+      return;
+    }
+  }
+  if (!dirty.empty() && dirty.count(node)) {
+    emit_container(node);
+  } else {
+    emit_text(node->span);
+  }
+}
+
+// Writes a container with an edit under it one child at a time. The text
+// between the children - brackets, commas, colons and whitespace - comes from
+// the source too, taking the gap in front of each child that's kept.
+void JsonWriter::emit_container(const JsonNode* node) {
+  bool object = node->span.begin[0] == '{';
+  emit_text(TextSpan(node->span.begin, node->child_head->span.begin));
+
+  bool first = true;
+  for (auto c = node->child_head; c; c = c->node_next) {
+    if (!removed.empty() && removed.count(c)) continue;
+    if (!first) emit_text(TextSpan(c->node_prev->span.end, c->span.begin));
+    first = false;
+
+    if (object) {
+      auto value = c->child_head->node_next;
+      emit_text(TextSpan(c->span.begin, value->span.begin));
+      emit_value(value);
+    } else {
+      emit_value(c);
+    }
+  }
+
+  emit_text(TextSpan(node->child_tail->span.end, node->span.end));
+}
+
+void JsonWriter::emit_text(TextSpan text) {
+  switch (style) {
+    case VERBATIM: emit_source(text.begin, text.end); break;
+    case MINIFY:   emit_minified(text); break;
+    case PRETTY:   emit_pretty(text); break;
+  }
+}
+
+void JsonWriter::emit_source(const char* a, const char* b) {
+  if (fd >= 0 && size_t(b - a) >= big_run) {
+    cut();
+    chunks.push_back({a, 0, size_t(b - a)});
+  } else {
+    out.append(a, b);
+  }
+  maybe_flush();
+}
+
+// Copies everything but the whitespace between tokens, skipping ahead 16
+// bytes at a time to the next space or string.
+void JsonWriter::emit_minified(TextSpan text) {
+  auto a = text.begin;
+  auto b = text.end;
+  while (a < b) {
+    auto run = skip_to_ws_or_quote(a, b);
+    out.append(a, run);
+    a = run;
+    if (a == b) break;
+
+    if (*a == '"') {
+      auto end = find_json_string_end(a, b);
+      out.append(a, end);
+      a = end;
+    } else {
+      while (a < b && is_ws(*a)) a++;
+      maybe_flush();
+    }
+  }
+}
+
+// Re-indents a piece of JSON text. Pieces can end in the middle of a
+// container, so the nesting level and whether a line break is due carry over
+// to the next piece. Empty containers stay on one line.
+void JsonWriter::emit_pretty(TextSpan text) {
+  auto a = text.begin;
+  auto b = text.end;
+  while (a < b) {
+    char c = *a;
+    switch (c) {
+      case ' ': case '\n': case '\r': case '\t':
+        a++;
+        break;
+      case '{': case '[':
+        if (pending != NONE) newline();
+        out.push_back(c);
+        level++;
+        pending = OPENED;
+        a++;
+        break;
+      case '}': case ']':
+        level--;
+        if (pending != OPENED) newline();
+        out.push_back(c);
+        pending = NONE;
+        a++;
+        break;
+      case ',':
+        out.push_back(',');
+        pending = SEPARATED;
+        a++;
+        break;
+      case ':':
+        out.append(": ");
+        a++;
+        break;
+      case '"': {
+        if (pending != NONE) newline();
+        pending = NONE;
+        auto end = find_json_string_end(a, b);
+        out.append(a, end);
+        a = end;
+        break;
+      }
+      default: {
+        // Numbers, true, false and null.
+        if (pending != NONE) newline();
+        pending = NONE;
+        auto end = a + 1;
+        while (end < b && !is_ws(*end) && *end != ',' && *end != ']' && *end != '}') end++;
+        out.append(a, end);
+        a = end;
+        break;
+      }
+    }
+  }
+}
+
+void JsonWriter::newline() {
+  out.push_back('\n');
+  out.append(size_t(level * indent), ' ');
+  maybe_flush();
+}
+
+//------------------------------------------------------------------------------
@@ -2,20 +2,119 @@
 
 #include "Matcheroni.hpp"
 
-#include <new>      // for implicit align_val_t
-#include <stdint.h> // for uint64_t
-#include <stdlib.h> // for malloc/free
-#include <string.h> // for strcmp
+#include <atomic>
+#include <mutex>
+#include <new>         // for implicit align_val_t
+#include <stdint.h>    // for uint64_t
+#include <stdlib.h>    // for malloc/free
+#include <string.h>    // for strcmp
+#include <type_traits> // for is_trivially_destructible
+#include <vector>
 
 namespace parseroni {
 
 using namespace matcheroni;
 
+//------------------------------------------------------------------------------
+// A process-wide pool of free slabs that LifoAllocs can share, so that
+// programs creating lots of short-lived contexts don't have to malloc and free
+// (and page-fault in) fresh 2 meg slabs for every one of them.
+
+// Each thread keeps a small cache of slabs that it can use without locking.
+// When that cache over- or underflows, half a cache's worth of slabs moves
+// to or from a shared depot under a mutex. The depot holds at most
+// max_retained slabs - anything past that goes back to the system.
+
+struct SlabPool {
+  static constexpr size_t slab_bytes = 2 * 1024 * 1024;
+  static constexpr int cache_size = 8;
+
+  static SlabPool& global() {
+    static SlabPool pool;
+    return pool;
+  }
+
+  ~SlabPool() {
+    for (auto s : depot) ::free(s);
+  }
+
+  void* get() {
+    auto& c = cache();
+    if (c.count == 0) {
+      std::lock_guard<std::mutex> lock(mutex);
+      while (c.count < cache_size / 2 && depot.size()) {
+        c.slabs[c.count++] = depot.back();
+        depot.pop_back();
+      }
+    }
+    if (c.count) return c.slabs[--c.count];
+
+    malloc_count++;
+    return malloc(slab_bytes);
+  }
+
+  void put(void* slab) {
+    auto& c = cache();
+    if (c.count == cache_size) flush(c, cache_size / 2);
+    c.slabs[c.count++] = slab;
+  }
+
+  size_t retained() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return depot.size();
+  }
+
+  size_t max_retained = 64;
+  std::atomic<size_t> malloc_count = 0;
+
+private:
+
+  struct ThreadCache {
+    ~ThreadCache() { SlabPool::global().flush(*this, count); }
+    void* slabs[cache_size];
+    int count = 0;
+  };
+
+  static ThreadCache& cache() {
+    static thread_local ThreadCache c;
+    return c;
+  }
+
+  void flush(ThreadCache& c, int count) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int i = 0; i < count; i++) {
+      auto slab = c.slabs[--c.count];
+      if (depot.size() < max_retained) {
+        depot.push_back(slab);
+      }
+      else {
+        ::free(slab);
+      }
+    }
+  }
+
+  std::mutex mutex;
+  std::vector<void*> depot;
+};
+
 //------------------------------------------------------------------------------
 // This is an optimized allocator for Parseroni - it allows for alloc/free, but
 // frees must be in LIFO order - if you allocate A, B, and C, you must
 // deallocate in C-B-A order.
 
+// alloc() writes the size of each allocation after it so that free() can pop
+// them one at a time. If nothing needs to be done per allocation when it goes
+// away, bump() skips the size and rewind() drops everything allocated after a
+// saved cursor in one step.
+
+// The allocator keeps track of how many bytes are in use, the peak, and how
+// many slabs it holds. If byte_limit is set, allocations that would
+// take us over the limit return nullptr and latch over_limit until the next
+// reset() - parsing untrusted input can't grow the tree without bound.
+
+// Slabs are allocated on first use. If 'pool' is set, they come from and go
+// back to that pool - reset() keeps the first slab and returns the rest.
+
 struct LifoAlloc {
   struct Slab {
     size_t size() { return cursor - buf; }
@@ -27,31 +126,54 @@ struct LifoAlloc {
     char buf[];
   };
 
+  struct Cursor {
+    bool operator==(const Cursor& c) const = default;
+    Slab* slab;
+    char* pos;
+    size_t used;
+  };
+
   // Default slab size is 2 megs = 1 hugepage. Seems to work ok.
   static constexpr int header_size = sizeof(Slab);
-  static constexpr int slab_size = 2 * 1024 * 1024 - header_size;
+  static constexpr int slab_size = SlabPool::slab_bytes - header_size;
   static constexpr int alloc_overhead = 8;
 
   LifoAlloc() {
-    add_slab();
   }
 
   ~LifoAlloc() {
     reset();
-    auto c = top_slab;
-    while (c) {
-      auto next = c->next;
-      ::free((void*)c);
-      c = next;
-    }
+    if (top_slab) release(top_slab);
     top_slab = nullptr;
   }
 
-
   void reset() {
+    alloc_count = 0;
+    used_bytes = 0;
+    over_limit = false;
+    if (!top_slab) return;
+
     while (top_slab->prev) top_slab = top_slab->prev;
     for (auto c = top_slab; c; c = c->next) c->clear();
-    alloc_count = 0;
+    if (pool && top_slab->next) {
+      release(top_slab->next);
+      top_slab->next = nullptr;
+    }
+  }
+
+  // Frees or returns to the pool 'slab' and every slab after it.
+  void release(Slab* slab) {
+    while (slab) {
+      auto next = slab->next;
+      slab_count--;
+      if (pool) {
+        pool->put(slab);
+      }
+      else {
+        ::free((void*)slab);
+      }
+      slab = next;
+    }
   }
 
   void add_slab() {
@@ -60,7 +182,8 @@ struct LifoAlloc {
       return;
     }
 
-    auto new_slab = (Slab*)malloc(header_size + slab_size);
+    auto new_slab = (Slab*)(pool ? pool->get() : malloc(header_size + slab_size));
+    slab_count++;
     new_slab->prev = nullptr;
     new_slab->next = nullptr;
     new_slab->cursor = new_slab->buf;
@@ -70,8 +193,20 @@ struct LifoAlloc {
     top_slab = new_slab;
   }
 
+  bool reserve(size_t size) {
+    if (over_limit || used_bytes + size > byte_limit) {
+      over_limit = true;
+      return false;
+    }
+    used_bytes += size;
+    if (used_bytes > peak_bytes) peak_bytes = used_bytes;
+    return true;
+  }
+
   void* alloc(int alloc_size) {
-    if (top_slab->size() + alloc_size + alloc_overhead > slab_size) {
+    if (!reserve(alloc_size + alloc_overhead)) return nullptr;
+
+    if (!top_slab || top_slab->size() + alloc_size + alloc_overhead > slab_size) {
       add_slab();
     }
 
@@ -88,6 +223,7 @@ struct LifoAlloc {
     top_slab->cursor -= alloc_overhead;
     uint64_t alloc_size = *(uint64_t*)top_slab->cursor;
     top_slab->cursor -= alloc_size;
+    used_bytes -= alloc_size + alloc_overhead;
 
     if (top_slab->size() == 0 && top_slab->prev) {
       top_slab = top_slab->prev;
@@ -95,22 +231,110 @@ struct LifoAlloc {
     alloc_count--;
   }
 
-  int current_size() const {
-    auto slab = top_slab;
-    while (slab->prev) slab = slab->prev;
-    int sum = 0;
-    for (; slab; slab = slab->next) {
-      sum += slab->size();
+  void* bump(int alloc_size) {
+    if (!reserve(alloc_size)) return nullptr;
+
+    if (!top_slab || top_slab->size() + alloc_size > slab_size) {
+      add_slab();
+    }
+
+    auto result = top_slab->cursor;
+    top_slab->cursor += alloc_size;
+    return result;
+  }
+
+  Cursor cursor() const {
+    if (!top_slab) return {nullptr, nullptr, 0};
+    return {top_slab, top_slab->cursor, used_bytes};
+  }
+
+  // Slabs past the cursor's slab are cleared until we hit an empty one, as
+  // add_slab() expects the slabs after the top one to be empty. A cursor taken
+  // before the first slab existed rewinds to the start of the first slab.
+  void rewind(Cursor c) {
+    if (!top_slab) return;
+    if (!c.slab) {
+      c.slab = top_slab;
+      while (c.slab->prev) c.slab = c.slab->prev;
+      c.pos = c.slab->buf;
     }
-    return sum;
+    for (auto s = c.slab->next; s && s->size(); s = s->next) s->clear();
+    top_slab = c.slab;
+    top_slab->cursor = c.pos;
+    used_bytes = c.used;
+  }
+
+  size_t current_size() const {
+    return used_bytes;
+  }
+
+  size_t peak_size() const {
+    return peak_bytes;
   }
 
   bool is_empty() const {
-    return top_slab->prev == nullptr && top_slab->size() == 0;
+    return !top_slab || (top_slab->prev == nullptr && top_slab->size() == 0);
   }
 
   Slab* top_slab = nullptr;
+  SlabPool* pool = nullptr;
   int alloc_count = 0;
+  int slab_count = 0;
+
+  size_t used_bytes = 0;
+  size_t peak_bytes = 0;
+  size_t byte_limit = SIZE_MAX;
+  bool over_limit = false;
+};
+
+//------------------------------------------------------------------------------
+// Optional per-tag node counts - point NodeContext::tag_stats at one of these
+// to see which rules create (and throw away) the most nodes. Tags are compared
+// by pointer, so every Capture<> with the same tag string shares an entry.
+
+struct TagStats {
+  struct Entry {
+    const char* tag;
+    size_t created;
+    size_t rewound;
+  };
+
+  static constexpr int table_bits = 10;
+  static constexpr int table_size = 1 << table_bits;
+
+  Entry* find(const char* tag) {
+    auto h = (uint64_t(tag) * 0x9E3779B97F4A7C15ull) >> (64 - table_bits);
+    for (int i = 0; i < table_size; i++) {
+      auto& e = entries[(h + i) & (table_size - 1)];
+      if (e.tag == tag) return &e;
+      if (e.tag == nullptr) {
+        e.tag = tag;
+        return &e;
+      }
+    }
+    return &overflow;
+  }
+
+  void clear() {
+    for (auto& e : entries) e = {nullptr, 0, 0};
+    overflow = {"<overflow>", 0, 0};
+  }
+
+  Entry entries[table_size] = {};
+  Entry overflow = {"<overflow>", 0, 0};
+};
+
+//------------------------------------------------------------------------------
+// Describes an edit to the atoms a tree was parsed from - the atoms in
+// [begin, old_end) of the old buffer were replaced by the atoms in
+// [begin, new_end) of the new buffer. All values are offsets in atoms.
+
+struct SpanEdit {
+  int64_t delta() const { return new_end - old_end; }
+
+  int64_t begin;
+  int64_t old_end;
+  int64_t new_end;
 };
 
 //------------------------------------------------------------------------------
@@ -147,11 +371,46 @@ struct NodeBase {
     return strcmp(match_tag, name) == 0;
   }
 
+  //----------------------------------------
+  // Nodes created by CaptureList<> keep an array of their children in the same
+  // allocation, right after the node. The array starts with its length, and the
+  // upper bits of 'flags' hold its offset from the node.
+
+  static constexpr uint32_t list_flag = 2;
+  static constexpr int list_offset_shift = 8;
+
+  bool has_items() const {
+    return flags & list_flag;
+  }
+
+  // O(1) for nodes with an item array, O(n) otherwise.
+  size_t item_count() const {
+    if (has_items()) return *(size_t*)((const char*)this + (flags >> list_offset_shift));
+    size_t count = 0;
+    for (auto c = child_head; c; c = c->node_next) count++;
+    return count;
+  }
+
+  // Only for nodes with an item array.
+  NodeType** items() {
+    matcheroni_assert(has_items());
+    return (NodeType**)((char*)this + (flags >> list_offset_shift)) + 1;
+  }
+
+  // O(1) for nodes with an item array, O(n) otherwise.
+  NodeType* item(size_t i) {
+    if (has_items()) return i < item_count() ? items()[i] : nullptr;
+    auto c = child_head;
+    for (; c && i; i--) c = c->node_next;
+    return c;
+  }
+
   //----------------------------------------
 
   const char* match_tag = nullptr;
   SpanType    span;
-  uint64_t    flags = 0;
+  uint32_t    flags = 0;
+  uint32_t    subtree_id = 0; // Only valid after utils::SubtreeInterner::intern()
 
   NodeType*   node_parent = nullptr;
   NodeType*   node_prev = nullptr;
@@ -171,6 +430,41 @@ struct NodeContext {
   static constexpr bool call_constructors = _call_constructors;
   static constexpr bool call_destructors  = _call_destructors;
 
+  // If we never need to run destructors, nodes don't need to be freed one at
+  // a time. In "bump mode" nodes are allocated without size trailers, a
+  // rewind truncates the allocator back to the checkpoint's cursor, and reset()
+  // only touches the slabs.
+  static constexpr bool bump_mode =
+    !call_destructors || std::is_trivially_destructible_v<NodeType>;
+
+  struct Checkpoint {
+    bool operator==(const Checkpoint& c) const = default;
+    NodeType* tail;
+    LifoAlloc::Cursor cursor;
+    size_t live_nodes;
+    size_t undo_len;
+  };
+
+  struct LifoCheckpoint {
+    bool operator==(const LifoCheckpoint& c) const = default;
+    NodeType* tail;
+    size_t undo_len;
+  };
+
+  using CheckpointType = std::conditional_t<bump_mode, Checkpoint, LifoCheckpoint>;
+
+  // Parsers that keep their own state while matching (symbol tables, scopes)
+  // log how to undo each change. The log's length is part of every checkpoint,
+  // and rewind() runs the entries logged after the checkpoint in reverse, so
+  // that state always agrees with the node list.
+  using UndoFunc = void (*)(void* a, void* b);
+
+  struct UndoEntry {
+    UndoFunc func;
+    void* a;
+    void* b;
+  };
+
   NodeContext() {
     top_head = nullptr;
     top_tail = nullptr;
@@ -185,7 +479,7 @@ struct NodeContext {
 
   void reset() {
     // Call destructors for all the nodes in the allocator.
-    if (call_destructors) {
+    if constexpr (!bump_mode) {
       for (auto slab = alloc.top_slab; slab; slab = slab->prev) {
         while(slab->cursor > slab->buf) {
           slab->cursor -= LifoAlloc::alloc_overhead;
@@ -199,6 +493,8 @@ struct NodeContext {
 
     top_head = nullptr;
     top_tail = nullptr;
+    live_nodes = 0;
+    undo_log.clear();
     alloc.reset();
   }
 
@@ -267,13 +563,41 @@ struct NodeContext {
     if (top_tail == child_tail) top_tail = new_node;
   }
 
+  //----------------------------------------
+
+  // Returns nullptr if the allocator is over its byte limit.
+
+  void* alloc_node(int size) {
+    void* result;
+    if constexpr (bump_mode) {
+      result = alloc.bump(size);
+    }
+    else {
+      result = alloc.alloc(size);
+    }
+    if (result) live_nodes++;
+    return result;
+  }
+
+  void count_capture(const char* tag) {
+    if (tag_stats && tag) tag_stats->find(tag)->created++;
+  }
+
+  void count_rewound(NodeType* node) {
+    for (; node; node = node->node_next) {
+      if (node->match_tag) tag_stats->find(node->match_tag)->rewound++;
+      count_rewound(node->child_head);
+    }
+  }
+
   //----------------------------------------
   // FIXME - MUST MANUALLY CALL INIT() WHEN YOU'RE DONE WITH THIS
 
   template<typename node_type>
-  void enclose_tail(int count) {
+  node_type* enclose_tail(int count) {
 
-    node_type* new_node = (node_type*)alloc.alloc(sizeof(node_type));
+    node_type* new_node = (node_type*)alloc_node(sizeof(node_type));
+    if (!new_node) return nullptr;
     if (call_constructors) {
       new (new_node) node_type();
     }
@@ -287,6 +611,7 @@ struct NodeContext {
     }
 
     splice(new_node, child_head, child_tail);
+    return new_node;
   }
 
   //----------------------------------------
@@ -295,16 +620,65 @@ struct NodeContext {
   // we must also throw away any parse nodes that were created during the failed
   // match.
 
-  NodeType* checkpoint() {
-    return top_tail;
+  CheckpointType checkpoint() {
+    if constexpr (bump_mode) {
+      return {top_tail, alloc.cursor(), live_nodes, undo_log.size()};
+    }
+    else {
+      return {top_tail, undo_log.size()};
+    }
+  }
+
+  void rewind(CheckpointType bookmark) {
+    undo_to(bookmark.undo_len);
+
+    if constexpr (bump_mode) {
+      // Everything after the checkpoint's tail was allocated after the
+      // checkpoint, so we can drop it all at once. We only have to visit the
+      // dead nodes if we're counting them.
+      if (tag_stats) {
+        count_rewound(bookmark.tail ? bookmark.tail->node_next : top_head);
+      }
+      top_tail = bookmark.tail;
+      if (top_tail) {
+        top_tail->node_next = nullptr;
+      }
+      else {
+        top_head = nullptr;
+      }
+      alloc.rewind(bookmark.cursor);
+      live_nodes = bookmark.live_nodes;
+    }
+    else {
+      while(top_tail != bookmark.tail) {
+        //printf("rewind!\n");
+        auto dead = top_tail;
+        top_tail = top_tail->node_prev;
+        recycle(dead);
+      }
+    }
+  }
+
+  //----------------------------------------
+
+  void log_undo(UndoFunc func, void* a, void* b = nullptr) {
+    undo_log.push_back({func, a, b});
+  }
+
+  // Forgets every entry logged so far, keeping the changes they would undo.
+  // Only for parsers that know no checkpoint from before now will be rewound
+  // to - a rewind to one would leave those changes in place.
+  void drop_undo() {
+    undo_log.clear();
   }
 
-  void rewind(NodeType* old_tail) {
-    while(top_tail != old_tail) {
-      //printf("rewind!\n");
-      auto dead = top_tail;
-      top_tail = top_tail->node_prev;
-      recycle(dead);
+  // Entries are popped before they run, so undo functions can safely touch
+  // the log themselves.
+  void undo_to(size_t len) {
+    while (undo_log.size() > len) {
+      auto e = undo_log.back();
+      undo_log.pop_back();
+      e.func(e.a, e.b);
     }
   }
 
@@ -312,7 +686,8 @@ struct NodeContext {
 
   template<typename node_type>
   node_type* create_node() {
-    node_type* new_node = (node_type*)alloc.alloc(sizeof(node_type));
+    node_type* new_node = (node_type*)alloc_node(sizeof(node_type));
+    if (!new_node) return nullptr;
     if (call_constructors) {
       new (new_node) node_type();
     }
@@ -321,7 +696,8 @@ struct NodeContext {
 
   template<typename node_type>
   node_type* create_and_append_node(NodeType* old_tail) {
-    node_type* new_node = (node_type*)alloc.alloc(sizeof(node_type));
+    node_type* new_node = (node_type*)alloc_node(sizeof(node_type));
+    if (!new_node) return nullptr;
     if (call_constructors) {
       new (new_node) node_type();
     }
@@ -330,6 +706,64 @@ struct NodeContext {
     return new_node;
   }
 
+  //----------------------------------------
+  // Creates a node with room for an item array after it, and makes the last
+  // 'count' nodes on the list its children. Parent links and the array are
+  // filled in one pass, from the tail. Lists too long for their array to fit
+  // in a slab just don't get one.
+
+  template<typename node_type>
+  node_type* create_and_append_list(NodeType* old_tail, size_t count) {
+    size_t array_bytes = sizeof(size_t) + count * sizeof(NodeType*);
+    bool has_array = sizeof(node_type) + array_bytes + LifoAlloc::alloc_overhead <= LifoAlloc::slab_size;
+
+    node_type* new_node = (node_type*)alloc_node(sizeof(node_type) + (has_array ? array_bytes : 0));
+    if (!new_node) return nullptr;
+    if (call_constructors) {
+      new (new_node) node_type();
+    }
+
+    new_node->flags = 0;
+    if (has_array) {
+      new_node->flags = NodeType::list_flag | (sizeof(node_type) << NodeType::list_offset_shift);
+      *(size_t*)(new_node + 1) = count;
+    }
+
+    if (count == 0) {
+      append(new_node);
+      return new_node;
+    }
+
+    auto items = has_array ? new_node->items() : nullptr;
+    auto child_tail = top_tail;
+    auto child_head = top_tail;
+    for (size_t i = count - 1;; i--) {
+      matcheroni_assert(child_head && child_head->node_parent == nullptr);
+      child_head->node_parent = new_node;
+      if (items) items[i] = child_head;
+      if (i == 0) break;
+      child_head = child_head->node_prev;
+    }
+    matcheroni_assert(child_head->node_prev == old_tail);
+
+    new_node->node_parent = nullptr;
+    new_node->node_prev   = old_tail;
+    new_node->node_next   = nullptr;
+    new_node->child_head  = child_head;
+    new_node->child_tail  = child_tail;
+
+    if (old_tail) {
+      old_tail->node_next = new_node;
+    }
+    else {
+      top_head = new_node;
+    }
+    child_head->node_prev = nullptr;
+    top_tail = new_node;
+
+    return new_node;
+  }
+
   //----------------------------------------
   // FIXME could this be faster if there was an append-only version for
   // captures without children?
@@ -381,6 +815,68 @@ struct NodeContext {
     return node_b;
   }
 
+  //----------------------------------------
+  // Moves the spans of every node in the tree (except 'skip' and its children)
+  // from the old input buffer to the new one after an edit. Spans that end
+  // before the edit keep their offsets, spans past it shift by the edit delta.
+
+  void rebase(const AtomType* old_base, const AtomType* new_base,
+              const SpanEdit& edit, NodeType* skip = nullptr) {
+    if (old_base == new_base && edit.delta() == 0) return;
+    for (auto n = top_head; n; n = n->node_next) {
+      rebase_tree(n, old_base, new_base, edit, skip);
+    }
+  }
+
+  void rebase_tree(NodeType* node, const AtomType* old_base,
+                   const AtomType* new_base, const SpanEdit& edit,
+                   NodeType* skip) {
+    if (node == skip) return;
+
+    auto remap = [&](const AtomType* p) {
+      int64_t offset = p - old_base;
+      if (offset >= edit.old_end) offset += edit.delta();
+      return new_base + offset;
+    };
+    node->span = SpanType(remap(node->span.begin), remap(node->span.end));
+
+    for (auto c = node->child_head; c; c = c->node_next) {
+      rebase_tree(c, old_base, new_base, edit, skip);
+    }
+  }
+
+  //----------------------------------------
+  // Puts new_node in old_node's place in the tree. The old node and its
+  // children are unlinked but stay in the allocator until the next reset().
+
+  void replace(NodeType* old_node, NodeType* new_node) {
+    new_node->node_parent = old_node->node_parent;
+    new_node->node_prev   = old_node->node_prev;
+    new_node->node_next   = old_node->node_next;
+
+    if (old_node->node_prev) old_node->node_prev->node_next = new_node;
+    if (old_node->node_next) old_node->node_next->node_prev = new_node;
+
+    if (auto p = old_node->node_parent) {
+      if (p->child_head == old_node) p->child_head = new_node;
+      if (p->child_tail == old_node) p->child_tail = new_node;
+      if (p->has_items()) {
+        auto items = p->items();
+        for (size_t i = 0; i < p->item_count(); i++) {
+          if (items[i] == old_node) items[i] = new_node;
+        }
+      }
+    }
+    else {
+      if (top_head == old_node) top_head = new_node;
+      if (top_tail == old_node) top_tail = new_node;
+    }
+
+    old_node->node_parent = nullptr;
+    old_node->node_prev   = nullptr;
+    old_node->node_next   = nullptr;
+  }
+
   //----------------------------------------
   // Nodes _must_ be deleted in the reverse order they were allocated.
   // In practice, this means we must delete the "parent" node first and then
@@ -391,8 +887,10 @@ struct NodeContext {
     auto tail = node->child_tail;
 
     detach(node);
+    if (tag_stats && node->match_tag) tag_stats->find(node->match_tag)->rewound++;
     if (call_destructors) node->~NodeType();
     alloc.free(node);
+    live_nodes--;
 
     while (tail) {
       auto prev = tail->node_prev;
@@ -406,6 +904,9 @@ struct NodeContext {
   LifoAlloc alloc;
   NodeType* top_head;
   NodeType* top_tail;
+  size_t live_nodes = 0;
+  std::vector<UndoEntry> undo_log;
+  TagStats* tag_stats = nullptr;
   int trace_depth;
   const typename SpanType::AtomType* _highwater = nullptr;
 };
@@ -427,10 +928,12 @@ struct Capture {
     if (tail.is_valid()) {
       Span<atom> node_span = {body.begin, tail.begin};
       auto new_node = ctx.template create_and_append_node<node_type>(old_tail);
+      if (!new_node) return body.fail();
       new_node->match_tag = match_tag.str_val;
       new_node->span = node_span;
       new_node->flags = 0;
       new_node->init();
+      ctx.count_capture(match_tag.str_val);
     }
 
     return tail;
@@ -454,6 +957,67 @@ struct Capture {
   */
 };
 
+//------------------------------------------------------------------------------
+// CaptureList<> matches "ldelim (item (sep item)*)? rdelim" and captures it
+// like Capture<> would, but the new node also gets an array of its children
+// for O(1) indexed access (see NodeBase::items()). If 'trailing_sep' is set,
+// a separator may follow the last item, like in DelimitedList<>.
+
+template <StringParam match_tag, typename ldelim, typename item, typename sep,
+          typename rdelim, typename node_type, bool trailing_sep = false>
+struct CaptureList {
+  static_assert((sizeof(node_type) & 7) == 0);
+
+  // Counts the nodes added to the node list after 'old_tail'.
+  template<typename context>
+  static size_t count_new(context& ctx, typename context::NodeType* old_tail) {
+    size_t count = 0;
+    for (auto c = old_tail ? old_tail->node_next : ctx.top_head; c; c = c->node_next) count++;
+    return count;
+  }
+
+  template<typename context, typename atom>
+  static Span<atom> match(context& ctx, Span<atom> body) {
+    auto old_tail = ctx.top_tail;
+
+    auto tail = ldelim::match(ctx, body);
+    if (!tail.is_valid()) return tail;
+    size_t count = count_new(ctx, old_tail);
+
+    bool first = true;
+    for (;; first = false) {
+      auto bookmark = ctx.checkpoint();
+      auto item_tail = ctx.top_tail;
+      auto next = first ? item::match(ctx, tail) : Seq<sep, item>::match(ctx, tail);
+      if (!next.is_valid()) {
+        if (bookmark != ctx.checkpoint()) ctx.rewind(bookmark);
+        break;
+      }
+      count += count_new(ctx, item_tail);
+      tail = next;
+    }
+
+    auto rdelim_tail = ctx.top_tail;
+    if (trailing_sep && !first) {
+      tail = Seq<Opt<sep>, rdelim>::match(ctx, tail);
+    }
+    else {
+      tail = rdelim::match(ctx, tail);
+    }
+    if (!tail.is_valid()) return tail;
+    count += count_new(ctx, rdelim_tail);
+
+    auto new_node = ctx.template create_and_append_list<node_type>(old_tail, count);
+    if (!new_node) return body.fail();
+    new_node->match_tag = match_tag.str_val;
+    new_node->span = {body.begin, tail.begin};
+    new_node->init();
+    ctx.count_capture(match_tag.str_val);
+
+    return tail;
+  }
+};
+
 //------------------------------------------------------------------------------
 
 template <typename pattern, typename node_type>
@@ -468,6 +1032,7 @@ struct CaptureAnon {
     if (tail.is_valid()) {
       Span<atom> node_span = {body.begin, tail.begin};
       auto new_node = ctx.template create_and_append_node<node_type>(old_tail);
+      if (!new_node) return body.fail();
       new_node->match_tag = nullptr;
       new_node->span = node_span;
       new_node->flags = 0;
@@ -554,10 +1119,12 @@ struct CaptureEnd {
       Span<atom> new_span(tail.begin, tail.begin);
 
       auto new_node = ctx.template create_and_append_node<node_type>(ctx.top_tail);
+      if (!new_node) return body.fail();
       new_node->match_tag = match_tag.str_val;
       new_node->span = new_span;
       new_node->flags = 1;
       new_node->init();
+      ctx.count_capture(match_tag.str_val);
       // if (new_node->span.end > ctx._highwater) ctx._highwater = new_node->span.end;
     }
     return tail;
@@ -565,6 +1132,88 @@ struct CaptureEnd {
   }
 };
 
+//------------------------------------------------------------------------------
+// Incremental reparsing - after an edit we find the deepest node that strictly
+// contains the edited atoms and can be restarted, rematch its rule from the
+// node's start, and keep the result if it ends exactly where the old node did
+// (shifted by the edit). Everything outside that node is reused as-is with its
+// spans moved to the new buffer. If the rematch doesn't line up, we try the
+// next enclosing restartable node.
+
+// 'restart' maps an old node to the matcher that produced it, or nullptr if the
+// node can't be restarted on its own. For the result to be identical to a full
+// parse, that matcher must make the same decisions at the node's start that
+// the full parse made there - in practice it's the rule the node was captured
+// by, called from a place where no earlier alternative could have consumed it.
+
+// Returns the node that replaced the old one, or nullptr if nothing could be
+// reused and the caller should do a full parse instead.
+
+template<typename context, typename restart_fn>
+inline typename context::NodeType* reparse(context& ctx,
+                                           typename context::SpanType old_text,
+                                           typename context::SpanType new_text,
+                                           const SpanEdit& edit,
+                                           restart_fn restart) {
+  using NodeType = typename context::NodeType;
+  using SpanType = typename context::SpanType;
+
+  auto old_base = old_text.begin;
+  auto new_base = new_text.begin;
+
+  // Find the deepest node that strictly contains the edit. Nodes that merely
+  // touch it could grow or shrink, so they don't count.
+  NodeType* deepest = nullptr;
+  for (auto n = ctx.top_head; n;) {
+    if (n->span.begin - old_base < edit.begin && n->span.end - old_base > edit.old_end) {
+      deepest = n;
+      n = n->child_head;
+    }
+    else {
+      n = n->node_next;
+    }
+  }
+
+  for (auto old_node = deepest; old_node; old_node = old_node->node_parent) {
+    auto rule = restart(old_node);
+    if (!rule) continue;
+
+    auto begin = new_base + (old_node->span.begin - old_base);
+    auto end   = new_base + (old_node->span.end - old_base) + edit.delta();
+
+    // Rematch with the node list temporarily emptied, so a successful match
+    // leaves exactly one node on it.
+    auto old_head = ctx.top_head;
+    auto old_tail = ctx.top_tail;
+    ctx.top_head = nullptr;
+    ctx.top_tail = nullptr;
+
+    auto bookmark = ctx.checkpoint();
+    auto tail = rule(ctx, SpanType(begin, new_text.end));
+    auto new_node = ctx.top_head;
+
+    bool same_tag = new_node && (new_node->match_tag == old_node->match_tag ||
+                                 (old_node->match_tag && new_node->tag_is(old_node->match_tag)));
+
+    bool lined_up = tail.is_valid() && tail.begin == end && same_tag &&
+                    new_node == ctx.top_tail &&
+                    new_node->span.begin == begin && new_node->span.end == end;
+
+    if (!lined_up && bookmark != ctx.checkpoint()) ctx.rewind(bookmark);
+
+    ctx.top_head = old_head;
+    ctx.top_tail = old_tail;
+
+    if (lined_up) {
+      ctx.rebase(old_base, new_base, edit, old_node);
+      ctx.replace(old_node, new_node);
+      return new_node;
+    }
+  }
+
+  return nullptr;
+}
+
 //------------------------------------------------------------------------------
 // We'll be parsing text a lot, so these are convenience declarations.
 
@@ -6,11 +6,13 @@
 
 #include "dump.hpp"
 
+#include <algorithm>   // for lower_bound
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>    // for exit
 #include <string.h>
 #include <string>
+#include <sys/resource.h> // for getrusage
 #include <sys/stat.h>
 #include <time.h>      // for clock_gettime, CLOCK_PROCESS_CP...
 #include <typeinfo>    // for type_info
@@ -18,6 +20,10 @@
 
 #include <string_view>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace matcheroni {
 namespace utils {
 
@@ -148,6 +154,19 @@ inline double timestamp_ms() {
   return double(t.tv_sec) * 1e3 + double(t.tv_nsec) * 1e-6;
 }
 
+//------------------------------------------------------------------------------
+// Peak resident set size of this process, in bytes.
+
+inline size_t peak_rss() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return size_t(usage.ru_maxrss);
+#else
+  return size_t(usage.ru_maxrss) * 1024;
+#endif
+}
+
 //------------------------------------------------------------------------------
 
 inline std::string read(const char* path) {
@@ -195,6 +214,95 @@ inline void read(const char* path, char*& text_out, size_t& size_out) {
 }
 
 //------------------------------------------------------------------------------
+// The offset of every newline in a text, so that a position can be turned
+// into a line and column without rescanning the text from the start. Lines
+// and columns count from 1, and columns count bytes.
+
+struct LineIndex {
+  struct Pos {
+    size_t line;
+    size_t col;
+  };
+
+  LineIndex() {}
+  LineIndex(TextSpan text) { build(text); }
+
+  // With SSE2 this looks at 64 bytes at a time and pulls the newlines out of
+  // the comparison mask, so the cost barely depends on how many there are.
+  void build(TextSpan text) {
+    matcheroni_assert(uint64_t(text.end - text.begin) <= UINT32_MAX);
+    this->text = text;
+    size_t count = 0;
+    auto a = text.begin;
+    auto b = text.end;
+
+#if defined(__SSE2__)
+    auto nl = _mm_set1_epi8('\n');
+    for (; b - a >= 64; a += 64) {
+      uint64_t mask = 0;
+      for (int i = 0; i < 4; i++) {
+        auto x = _mm_loadu_si128((const __m128i*)(a + 16 * i));
+        mask |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(x, nl)))) << (16 * i);
+      }
+      if (!mask) continue;
+      if (count + 64 > newlines.size()) newlines.resize(std::max(2 * newlines.size(), count + 64));
+      uint32_t base = uint32_t(a - text.begin);
+      for (; mask; mask &= mask - 1) newlines[count++] = base + __builtin_ctzll(mask);
+    }
+#endif
+
+    for (; a < b; a++) {
+      if (*a != '\n') continue;
+      if (count == newlines.size()) newlines.resize(std::max(2 * newlines.size(), size_t(64)));
+      newlines[count++] = uint32_t(a - text.begin);
+    }
+    newlines.resize(count);
+  }
+
+  size_t line_count() const { return newlines.size(); }
+
+  Pos locate(const char* c) const {
+    matcheroni_assert(c >= text.begin && c <= text.end);
+    uint32_t offset = uint32_t(c - text.begin);
+    size_t line = std::lower_bound(newlines.begin(), newlines.end(), offset) - newlines.begin();
+    size_t start = line ? newlines[line - 1] + 1 : 0;
+    return {line + 1, offset - start + 1};
+  }
+
+  // The text of a line, without its newline.
+  TextSpan line_text(size_t line) const {
+    matcheroni_assert(line >= 1 && line <= newlines.size() + 1);
+    auto begin = line > 1 ? text.begin + newlines[line - 2] + 1 : text.begin;
+    auto end = line <= newlines.size() ? text.begin + newlines[line - 1] : text.end;
+    return TextSpan(begin, end);
+  }
+
+  TextSpan text = TextSpan(nullptr, nullptr);
+  std::vector<uint32_t> newlines;  // Offsets from text.begin
+};
+
+// Prints "path:line:col: message" and the line with a caret under the column.
+inline void print_location(const char* path, const LineIndex& index, const char* c,
+                           const char* message) {
+  auto pos = index.locate(c);
+  auto line = index.line_text(pos.line);
+  printf("%s:%zu:%zu: %s\n", path, pos.line, pos.col, message);
+  printf("%.*s\n", int(line.end - line.begin), line.begin);
+  printf("%*s^\n", int(pos.col - 1), "");
+}
+
+//------------------------------------------------------------------------------
+
+// Atom types other than char can provide their own hash_atom() overload, which
+// will be found by argument-dependent lookup.
+
+inline uint64_t hash_atom(char c) {
+  return c;
+}
+
+inline bool atom_eq(char a, char b) {
+  return a == b;
+}
 
 template<typename node_type>
 inline uint64_t hash_tree(const node_type* node, int depth = 0) {
@@ -205,7 +313,7 @@ inline uint64_t hash_tree(const node_type* node, int depth = 0) {
   }
 
   for (auto c = node->span.begin; c < node->span.end; c++) {
-    h = (h * 123456789) ^ *c;
+    h = (h * 123456789) ^ hash_atom(*c);
   }
 
   for (auto c = node->child_head; c; c = c->node_next) {
@@ -224,6 +332,131 @@ inline uint64_t hash_context(context& ctx) {
   return h;
 }
 
+//------------------------------------------------------------------------------
+// Finds the repeated structure in parse trees. intern() gives every node in a
+// tree a subtree_id such that two nodes get the same id exactly when they have
+// the same tag and either the same atoms (leaves) or children with the same
+// ids in the same order (everything else). Once a tree has been interned,
+// comparing two subtrees is just comparing their ids. Atoms between children,
+// like whitespace, don't affect the id.
+
+// This only measures duplication - nodes keep their own parent and sibling
+// links, so repeated subtrees are not shared and the tree takes the same
+// memory as before.
+
+// Each unique subtree's Merkle hash is kept in the table along with the first
+// node seen with that shape, which we compare against to rule out collisions.
+
+template<typename node_type>
+struct SubtreeInterner {
+  struct Entry {
+    uint64_t   hash;
+    node_type* node;
+  };
+
+  uint32_t intern(node_type* node) {
+    uint64_t h = 0x9E3779B97F4A7C15ull;
+    for (auto c = node->match_tag; c && *c; c++) {
+      h = (h * 975313579) ^ *c;
+    }
+
+    if (node->child_head) {
+      for (auto c = node->child_head; c; c = c->node_next) {
+        h = (h * 987654321) ^ entries[intern(c) - 1].hash;
+      }
+    }
+    else {
+      for (auto c = node->span.begin; c < node->span.end; c++) {
+        h = (h * 123456789) ^ hash_atom(*c);
+      }
+    }
+    h ^= h >> 29;
+    node_total++;
+
+    if (entries.size() * 2 >= table.size()) grow();
+
+    size_t mask = table.size() - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+      auto id = table[i];
+      if (id == 0) {
+        entries.push_back({h, node});
+        table[i] = uint32_t(entries.size());
+        return node->subtree_id = table[i];
+      }
+      if (entries[id - 1].hash == h && same_shape(entries[id - 1].node, node)) {
+        return node->subtree_id = id;
+      }
+    }
+  }
+
+  template<typename context>
+  void intern(context& ctx) {
+    for (auto n = ctx.top_head; n; n = n->node_next) intern(n);
+  }
+
+  void clear() {
+    entries.clear();
+    table.clear();
+    node_total = 0;
+  }
+
+  size_t unique_count() const { return entries.size(); }
+
+  // An estimate of how big the tree would be if each unique subtree were
+  // stored once, from 'node_bytes(node)' - the real size of one node. Nodes
+  // link to their parents and siblings, so they can't actually be shared.
+  template<typename size_fn>
+  size_t unique_bytes(size_fn node_bytes) const {
+    size_t total = 0;
+    for (auto& e : entries) total += node_bytes(e.node);
+    return total;
+  }
+
+  size_t table_bytes() const {
+    return entries.capacity() * sizeof(Entry) + table.capacity() * sizeof(uint32_t);
+  }
+
+  //----------------------------------------
+
+  // Both nodes' children have already been interned.
+  static bool same_shape(node_type* a, node_type* b) {
+    if (a->match_tag != b->match_tag) {
+      if (!a->match_tag || !b->match_tag) return false;
+      if (strcmp(a->match_tag, b->match_tag)) return false;
+    }
+
+    if (a->child_head || b->child_head) {
+      auto ca = a->child_head;
+      auto cb = b->child_head;
+      for (; ca && cb; ca = ca->node_next, cb = cb->node_next) {
+        if (ca->subtree_id != cb->subtree_id) return false;
+      }
+      return ca == nullptr && cb == nullptr;
+    }
+
+    if (a->span.len() != b->span.len()) return false;
+    for (int i = 0; i < a->span.len(); i++) {
+      if (!atom_eq(a->span.begin[i], b->span.begin[i])) return false;
+    }
+    return true;
+  }
+
+  void grow() {
+    std::vector<uint32_t> old_table(table.size() ? table.size() * 2 : 1024, 0);
+    old_table.swap(table);
+    size_t mask = table.size() - 1;
+    for (uint32_t id = 1; id <= entries.size(); id++) {
+      size_t i = entries[id - 1].hash & mask;
+      while (table[i]) i = (i + 1) & mask;
+      table[i] = id;
+    }
+  }
+
+  std::vector<Entry>    entries; // indexed by subtree_id - 1
+  std::vector<uint32_t> table;   // open addressing, 0 = empty
+  size_t node_total = 0;
+};
+
 //------------------------------------------------------------------------------
 
 constexpr uint32_t pack_color(double r, double g, double b) {
@@ -2,9 +2,11 @@
 #include "matcheroni/Parseroni.hpp"
 #include "matcheroni/Utilities.hpp"
 
+#include <assert.h>
 #include <stdio.h>
 #include <string.h>
 #include <string>
+#include <vector>
 
 using namespace matcheroni;
 using namespace parseroni;
@@ -32,7 +34,7 @@ void sexp_to_string(TestNode* n, std::string& out) {
     }
     out.push_back(')');
   } else {
-    matcheroni_assert(false);
+    assert(false);
   }
 }
 
@@ -43,15 +45,15 @@ void check_hash(context& ctx, uint64_t hash_a) {
   uint64_t hash_b = utils::hash_context(ctx);
   //printf("Expected hash 0x%016lx\n", hash_a);
   //printf("Actual hash   0x%016lx\n", hash_b);
-  matcheroni_assert(hash_a == hash_b && "bad hash");
+  assert(hash_a == hash_b && "bad hash");
 }
 
 //----------------------------------------
 
 void reset_everything() {
   TestNode::reset_count();
-  matcheroni_assert(TestNode::live == 0);
-  matcheroni_assert(TestNode::dead == 0);
+  assert(TestNode::live == 0);
+  assert(TestNode::dead == 0);
 }
 
 //------------------------------------------------------------------------------
@@ -87,7 +89,7 @@ void test_basic() {
     ctx.reset();
     auto text = utils::to_span(expression);
     auto tail = SExpression::match(ctx, text);
-    matcheroni_assert(tail.is_valid() && tail.is_empty());
+    assert(tail.is_valid() && tail.is_empty());
 
     //utils::print_summary(ctx, text, tail, 50);
 
@@ -96,15 +98,15 @@ void test_basic() {
     sexp_to_string((TestNode*)ctx.top_head, new_text);
     //printf("Old : %s\n", text.begin);
     //printf("New : %s\n", new_text.c_str());
-    matcheroni_assert(expression == new_text && "Mismatch!");
+    assert(expression == new_text && "Mismatch!");
     //printf("\n");
 
     //utils::print_summary(ctx, text, tail, 50);
 
     check_hash(ctx, 0x7073c4e1b84277f0);
 
-    matcheroni_assert(TestNode::live == 11);
-    matcheroni_assert(TestNode::dead == 0);
+    assert(TestNode::live == 11);
+    assert(TestNode::dead == 0);
   }
 
   TestContext ctx;
@@ -114,17 +116,17 @@ void test_basic() {
   ctx.reset();
   span = utils::to_span("((((a))))");
   tail = SExpression::match(ctx, span);
-  matcheroni_assert(tail.is_valid() && tail.is_empty());
+  assert(tail.is_valid() && tail.is_empty());
 
   ctx.reset();
   span = utils::to_span("(((())))");
   tail = SExpression::match(ctx, span);
-  matcheroni_assert(tail.is_valid() && tail.is_empty());
+  assert(tail.is_valid() && tail.is_empty());
 
   ctx.reset();
   span = utils::to_span("(((()))(");
   tail = SExpression::match(ctx, span);
-  matcheroni_assert(!tail.is_valid() && std::string(tail.end) == "(");
+  assert(!tail.is_valid() && std::string(tail.end) == "(");
 
   //printf("test_basic() end\n\n");
 }
@@ -157,12 +159,256 @@ void test_rewind() {
   //utils::print_summary(ctx, text, tail, 50);
   check_hash(ctx, 0x2850a87bce45242a);
 
-  matcheroni_assert(TestNode::live == 1);
-  matcheroni_assert(TestNode::dead == 5);
+  assert(TestNode::live == 1);
+  assert(TestNode::dead == 5);
 
   //printf("test_rewind() end\n\n");
 }
 
+//------------------------------------------------------------------------------
+// Same as above, but with trivially destructible nodes - the context should be
+// in bump mode and rewinding should hand the dead nodes' memory back.
+
+struct BumpNode : public NodeBase<BumpNode, char> {
+  TextSpan as_text_span() const { return span; }
+};
+
+struct BumpContext : public NodeContext<BumpNode> {
+  static int atom_cmp(char a, int b) { return (unsigned char)a - b; }
+};
+
+void test_bump_rewind() {
+  static_assert(BumpContext::bump_mode);
+  static_assert(!TestContext::bump_mode);
+
+  using pattern =
+  Oneof<
+    Seq<
+      Capture<"a", Atom<'a'>, BumpNode>,
+      Capture<"b", Atom<'b'>, BumpNode>,
+      Capture<"c", Atom<'c'>, BumpNode>,
+      Capture<"d", Atom<'d'>, BumpNode>,
+      Capture<"e", Atom<'e'>, BumpNode>,
+
+      Capture<"g", Atom<'g'>, BumpNode>
+    >,
+    Capture<"lit", Lit<"abcdef">, BumpNode>
+  >;
+
+  BumpContext ctx;
+
+  auto text = utils::to_span("abcdef");
+  auto tail = pattern::match(ctx, text);
+  assert(tail.is_valid() && tail.is_empty());
+
+  check_hash(ctx, 0x2850a87bce45242a);
+  assert(ctx.top_head == ctx.top_tail);
+  assert(ctx.alloc.current_size() == sizeof(BumpNode));
+
+  ctx.reset();
+  assert(ctx.top_head == nullptr);
+  assert(ctx.alloc.is_empty());
+}
+
+//------------------------------------------------------------------------------
+// Matches a letter and "declares" it, logging how to take the declaration
+// back. Rewinding a failed match should leave only the declarations from the
+// match that succeeded, in both allocation modes.
+
+std::string declared;
+
+struct Declare {
+  static void undo(void*, void*) { declared.pop_back(); }
+
+  template<typename context>
+  static TextSpan match(context& ctx, TextSpan body) {
+    auto tail = Range<'a', 'z'>::match(ctx, body);
+    if (tail.is_valid()) {
+      declared.push_back(*body.begin);
+      ctx.log_undo(undo, nullptr);
+    }
+    return tail;
+  }
+};
+
+template<typename context, typename node>
+void check_undo_log() {
+  using decl = Capture<"decl", Declare, node>;
+  using pattern =
+  Oneof<
+    Seq<decl, decl, Atom<'!'>>,
+    Seq<decl, Capture<"list", Seq<Atom<'('>, Some<decl>, Atom<')'>>, node>, Atom<'?'>>
+  >;
+
+  declared.clear();
+  context ctx;
+  auto tail = pattern::match(ctx, utils::to_span("a(bcd)?"));
+  assert(tail.is_valid() && tail.is_empty());
+  assert(declared == "abcd");
+  assert(ctx.undo_log.size() == 4);
+
+  // Oneof<> leaves its last alternative's failure for the caller to rewind,
+  // and rewinding to before the match should take back everything.
+  ctx.reset();
+  declared.clear();
+  auto bookmark = ctx.checkpoint();
+  tail = pattern::match(ctx, utils::to_span("a(bcd)!"));
+  assert(!tail.is_valid());
+  assert(declared == "abcd" && ctx.undo_log.size() == 4);
+  ctx.rewind(bookmark);
+  assert(declared.empty() && ctx.undo_log.empty());
+  assert(ctx.top_head == nullptr);
+}
+
+void test_undo_log() {
+  reset_everything();
+  check_undo_log<TestContext, TestNode>();
+  check_undo_log<BumpContext, BumpNode>();
+  assert(TestNode::live == 0);
+}
+
+//------------------------------------------------------------------------------
+// CaptureList<> should produce the same tree as the equivalent Capture<>, plus
+// an item array.
+
+void test_capture_list() {
+  reset_everything();
+
+  using atom   = Capture<"atom", Some<Range<'a','z'>>, TestNode>;
+  using strict = CaptureList<"list", Atom<'['>, atom, Atom<','>, Atom<']'>, TestNode>;
+  using loose  = CaptureList<"list", Atom<'['>, atom, Atom<','>, Atom<']'>, TestNode, true>;
+  using plain  = Capture<"list", Seq<Atom<'['>, Opt<Seq<atom, Any<Seq<Atom<','>, atom>>>>, Atom<']'>>, TestNode>;
+
+  {
+    TestContext ctx1, ctx2;
+    auto text = utils::to_span("[ab,c,def]");
+    auto tail1 = strict::match(ctx1, text);
+    auto tail2 = plain::match(ctx2, text);
+    assert(tail1.is_valid() && tail1.is_empty());
+    assert(tail2.is_valid() && tail2.is_empty());
+    assert(utils::hash_context(ctx1) == utils::hash_context(ctx2));
+
+    auto list = ctx1.top_head;
+    assert(list->has_items() && !ctx2.top_head->has_items());
+    assert(list->item_count() == 3);
+    assert(ctx2.top_head->item_count() == 3);
+    assert(ctx2.top_head->item(1) == ctx2.top_head->child_head->node_next);
+    assert(list->item(0) == list->child_head);
+    assert(list->item(2) == list->child_tail);
+    assert(utils::to_string(list->item(1)->span) == "c");
+    assert(list->item(3) == nullptr);
+    for (auto c = list->child_head; c; c = c->node_next) {
+      assert(c->node_parent == list);
+    }
+  }
+  assert(TestNode::live == 0);
+
+  TestContext ctx;
+  assert(strict::match(ctx, utils::to_span("[]")).is_valid());
+  assert(ctx.top_head->has_items() && ctx.top_head->item_count() == 0);
+
+  ctx.reset();
+  assert(!strict::match(ctx, utils::to_span("[a,]")).is_valid());
+  ctx.reset();
+  assert(!loose::match(ctx, utils::to_span("[,]")).is_valid());
+  ctx.reset();
+  auto tail = loose::match(ctx, utils::to_span("[a,b,]"));
+  assert(tail.is_valid() && tail.is_empty());
+  assert(ctx.top_head->item_count() == 2);
+}
+
+//------------------------------------------------------------------------------
+// Structurally identical subtrees should get the same id, everything else
+// should get different ids.
+
+void test_intern() {
+  reset_everything();
+
+  std::string expression = "(a,(b, c),(b,c),a,(a),(b,c,d),( b , c ))";
+  auto text = utils::to_span(expression);
+
+  TestContext ctx;
+  auto tail = SExpression::match(ctx, text);
+  assert(tail.is_valid() && tail.is_empty());
+
+  utils::SubtreeInterner<TestNode> interner;
+  interner.intern(ctx);
+
+  std::vector<TestNode*> kids;
+  for (auto c = ctx.top_head->child_head; c; c = c->node_next) kids.push_back(c);
+  assert(kids.size() == 7);
+
+  assert(kids[0]->subtree_id == kids[3]->subtree_id); // a, a
+  assert(kids[1]->subtree_id == kids[2]->subtree_id); // (b, c), (b,c)
+  assert(kids[1]->subtree_id == kids[6]->subtree_id); // ( b , c )
+  assert(kids[0]->subtree_id != kids[4]->subtree_id); // a, (a)
+  assert(kids[1]->subtree_id != kids[5]->subtree_id); // (b,c), (b,c,d)
+
+  // 18 nodes, of which a b c d (a) (b,c) (b,c,d) and the root are unique
+  assert(interner.node_total == 18);
+  assert(interner.unique_count() == 8);
+}
+
+//------------------------------------------------------------------------------
+// Parsing should fail cleanly once the context's byte limit is hit, and the
+// accounting should match the tree that's left.
+
+void test_accounting() {
+  reset_everything();
+
+  std::string expression = "(abcd,efgh,(ab),(a,(bc,de)),ghijk)";
+  auto text = utils::to_span(expression);
+
+  TagStats stats;
+  TestContext ctx;
+  ctx.tag_stats = &stats;
+
+  auto tail = SExpression::match(ctx, text);
+  assert(tail.is_valid() && tail.is_empty());
+  assert(ctx.live_nodes == 11);
+  assert(ctx.live_nodes == TestNode::live);
+  assert(ctx.alloc.current_size() == 11 * (sizeof(TestNode) + LifoAlloc::alloc_overhead));
+  assert(ctx.alloc.peak_size() >= ctx.alloc.current_size());
+  // Entries are keyed by the tag's pointer, not the literal we'd pass to
+  // find(), so look them up by name.
+  auto entry = [&](const char* tag) {
+    for (auto& e : stats.entries) {
+      if (e.tag && strcmp(e.tag, tag) == 0) return e;
+    }
+    return TagStats::Entry{nullptr, 0, 0};
+  };
+  assert(entry("atom").created == 7);
+  assert(entry("list").created == 4);
+  assert(entry("list").rewound == 0);
+
+  size_t full_size = ctx.alloc.current_size();
+
+  ctx.reset();
+  assert(ctx.live_nodes == 0);
+  assert(TestNode::live == 0);
+
+  ctx.alloc.byte_limit = full_size / 2;
+  tail = SExpression::match(ctx, text);
+  assert(!tail.is_valid());
+  assert(ctx.alloc.over_limit);
+  assert(ctx.alloc.peak_size() <= full_size);
+
+  ctx.reset();
+  assert(!ctx.alloc.over_limit);
+  ctx.alloc.byte_limit = full_size;
+  tail = SExpression::match(ctx, text);
+  assert(tail.is_valid() && tail.is_empty());
+  assert(!ctx.alloc.over_limit);
+
+  // Slabs that reset() hands back to the pool stop being counted.
+  LifoAlloc alloc;
+  alloc.pool = &SlabPool::global();
+  for (int i = 0; i < 3; i++) alloc.bump(LifoAlloc::slab_size);
+  assert(alloc.slab_count == 3);
+  alloc.reset();
+  assert(alloc.slab_count == 1);
+}
+
 //------------------------------------------------------------------------------
 
 struct BeginEndTest {
@@ -209,8 +455,8 @@ void test_begin_end() {
   //utils::print_summary(ctx, text, tail, 50);
   check_hash(ctx, 0x8c3ca2b021e9a9b3);
 
-  matcheroni_assert(TestNode::live == 15);
-  matcheroni_assert(TestNode::dead == 0);
+  assert(TestNode::live == 15);
+  assert(TestNode::dead == 0);
 
   //printf("test_begin_end() end\n\n");
 }
@@ -250,7 +496,7 @@ void test_pathological() {
   // Matching this pattern should produce 7 live nodes and 137250 dead nodes.
   auto text = utils::to_span("[[[[[[a]]]]]]");
   auto tail = Pathological::match(ctx, text);
-  matcheroni_assert(tail.is_valid() && "pathological tree invalid");
+  assert(tail.is_valid() && "pathological tree invalid");
 
   // Tree should be
   // {[[[[[[a]]]]]]       } *none
@@ -264,20 +510,75 @@ void test_pathological() {
   //utils::print_summary(ctx, text, tail, 50);
   check_hash(ctx, 0x07a37a832d506209);
 
-  matcheroni_assert(TestNode::live == 7);
-  matcheroni_assert(TestNode::dead == 137250);
+  assert(TestNode::live == 7);
+  assert(TestNode::dead == 137250);
 
   //printf("test_pathological() end\n\n");
 }
 
+//------------------------------------------------------------------------------
+// Reparsing after an edit should produce the same tree as parsing the edited
+// text from scratch.
+
+void test_reparse() {
+  //printf("test_reparse()\n");
+  reset_everything();
+
+  auto restart = [](TestNode* node) -> matcher_function<TestContext, char> {
+    return node->match_tag ? SExpression::match : nullptr;
+  };
+
+  auto check_edit = [&](const char* before, const char* after, SpanEdit edit, bool reused) {
+    std::string old_text = before;
+    std::string new_text = after;
+
+    TestContext ctx;
+    auto tail = SExpression::match(ctx, utils::to_span(old_text));
+    assert(tail.is_valid() && tail.is_empty());
+
+    auto node = reparse(ctx, utils::to_span(old_text), utils::to_span(new_text), edit, restart);
+    assert((node != nullptr) == reused);
+    if (!node) return;
+
+    TestContext ref;
+    tail = SExpression::match(ref, utils::to_span(new_text));
+    assert(tail.is_valid() && tail.is_empty());
+    assert(utils::hash_context(ctx) == utils::hash_context(ref));
+    assert(ctx.node_count() == ref.node_count());
+  };
+
+  // Growing an atom only touches the atom.
+  check_edit("(abcd,efgh,(ab),(a,(bc,de)),ghijk)",
+             "(abcd,efgh,(ab),(a,(bxc,de)),ghijk)", {21, 21, 22}, true);
+
+  // Turning an atom into a list reparses the list containing it.
+  check_edit("(abcd,efgh,(ab),(a,(bc,de)),ghijk)",
+             "(abcd,efgh,(a,b),(a,(bc,de)),ghijk)", {13, 13, 14}, true);
+
+  // Shrinking the whole expression.
+  check_edit("(abcd,efgh,(ab),(a,(bc,de)),ghijk)",
+             "(abcd,(a,(bc,de)),ghijk)", {6, 16, 6}, true);
+
+  // Edits that touch the outermost list can't reuse anything.
+  check_edit("(abcd,efgh)", "(abcd,efgh),", {11, 11, 12}, false);
+
+  //printf("test_reparse() end\n\n");
+}
+
 //------------------------------------------------------------------------------
 
 int main(int argc, char** argv) {
   printf("parseroni_test begin\n");
   test_basic();
   test_rewind();
+  test_bump_rewind();
+  test_undo_log();
+  test_accounting();
+  test_capture_list();
+  test_intern();
   test_begin_end();
   test_pathological();
+  test_reparse();
   printf("parseroni_test done\n");
   return 0;
 }